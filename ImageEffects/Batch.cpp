@@ -0,0 +1,218 @@
+// ==========================================================================
+// Batch Filtering
+//
+// Author:  Matthew Sembinelli, University of Calgary
+// Date:    October 18, 2026
+// ==========================================================================
+#include "Batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <thread>
+
+#include <dirent.h>
+#include <glob.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "BoundedQueue.h"
+
+// An image on its way through the pipeline
+struct BatchImage
+{
+    string input;
+    string output;
+    ImageBuffer pixels;
+};
+
+typedef unique_ptr<BatchImage> BatchItem;
+
+BatchOptions::BatchOptions() : queue_depth(BATCH_QUEUE_DEPTH)
+{
+    // leave a core or so for filtering
+    GLuint cores = max(1u, thread::hardware_concurrency());
+    decoders = max(1u, cores / 2);
+    filterers = 1;
+    encoders = max(1u, cores / 2);
+}
+
+static bool IsDirectory(const string &path)
+{
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+static bool HasImageExtension(const string &filename)
+{
+    const char *extensions[] = { ".png", ".jpg", ".jpeg", ".bmp", ".gif", ".tif", ".tiff", ".ppm", ".pgm" };
+    for (GLuint i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++)
+    {
+        size_t length = strlen(extensions[i]);
+        if (filename.size() > length && strcasecmp(filename.c_str() + filename.size() - length, extensions[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+vector<string> ExpandInputs(const vector<string> &arguments)
+{
+    vector<string> inputs;
+    for (GLuint i = 0; i < arguments.size(); i++)
+    {
+        if (IsDirectory(arguments[i]))
+        {
+            DIR *directory = opendir(arguments[i].c_str());
+            if (!directory)
+            {
+                cout << "ERROR: Could not list " << arguments[i] << endl;
+                continue;
+            }
+            vector<string> files;
+            for (dirent *entry = readdir(directory); entry; entry = readdir(directory))
+            {
+                string path = arguments[i] + "/" + entry->d_name;
+                if (HasImageExtension(entry->d_name) && !IsDirectory(path))
+                    files.push_back(path);
+            }
+            closedir(directory);
+            sort(files.begin(), files.end());
+            inputs.insert(inputs.end(), files.begin(), files.end());
+            continue;
+        }
+
+        // quoted patterns reach us unexpanded, plain files match themselves
+        glob_t matches;
+        if (glob(arguments[i].c_str(), 0, NULL, &matches) != 0)
+        {
+            cout << "ERROR: Nothing matches " << arguments[i] << endl;
+            continue;
+        }
+        for (size_t j = 0; j < matches.gl_pathc; j++)
+        {
+            if (!IsDirectory(matches.gl_pathv[j]))
+                inputs.push_back(matches.gl_pathv[j]);
+        }
+        globfree(&matches);
+    }
+
+    // a file can match a directory and a pattern both, keep the first
+    vector<string> unique;
+    set<string> seen;
+    for (GLuint i = 0; i < inputs.size(); i++)
+    {
+        if (seen.insert(inputs[i]).second)
+            unique.push_back(inputs[i]);
+    }
+    return unique;
+}
+
+// where an input is written, under the output directory by its own name
+static string OutputName(const string &input, const BatchOptions &options)
+{
+    size_t slash = input.find_last_of('/');
+    string name = slash == string::npos ? input : input.substr(slash + 1);
+    if (!options.format.empty())
+    {
+        size_t dot = name.find_last_of('.');
+        name = (dot == string::npos ? name : name.substr(0, dot)) + "." + options.format;
+    }
+    return options.output_directory + "/" + name;
+}
+
+// runs count threads of step, closing next once all of them are done
+template <class Step>
+static void StartStep(vector<thread> *threads, GLuint count, BoundedQueue<BatchItem> *next, Step step)
+{
+    if (next)
+        next->set_producers(count);
+    for (GLuint i = 0; i < count; i++)
+    {
+        threads->push_back(thread([next, step]()
+        {
+            step();
+            if (next)
+                next->close();
+        }));
+    }
+}
+
+GLuint RunBatch(const vector<string> &inputs, const BatchOptions &options)
+{
+    // outputs are named after the inputs alone, so two encoders could
+    // otherwise write one file at once and both count it
+    vector<string> outputs(inputs.size());
+    map<string, GLuint> claimed;
+    bool collided = false;
+    for (GLuint i = 0; i < inputs.size(); i++)
+    {
+        outputs[i] = OutputName(inputs[i], options);
+        pair<map<string, GLuint>::iterator, bool> claim = claimed.insert(make_pair(outputs[i], i));
+        if (!claim.second)
+        {
+            cout << "ERROR: " << inputs[claim.first->second] << " and " << inputs[i]
+                 << " would both be written to " << outputs[i] << endl;
+            collided = true;
+        }
+    }
+    if (collided)
+        return 0;
+
+    BoundedQueue<BatchItem> decoded(options.queue_depth), filtered(options.queue_depth);
+    atomic<GLuint> next_input(0), written(0), failed(0);
+    vector<thread> threads;
+
+    StartStep(&threads, options.decoders, &decoded, [&]()
+    {
+        for (GLuint i = next_input++; i < inputs.size(); i = next_input++)
+        {
+            BatchItem image(new BatchImage());
+            image->input = inputs[i];
+            image->output = outputs[i];
+            if (!ReadImage(image->input, &image->pixels))
+            {
+                failed++;
+                continue;
+            }
+            if (!decoded.push(std::move(image)))
+                break;
+        }
+    });
+
+    StartStep(&threads, options.filterers, &filtered, [&]()
+    {
+        BatchItem image;
+        while (decoded.pop(&image))
+        {
+            ImageBuffer result;
+            RunFilters(image->pixels, options.stages, &result);
+            image->pixels = std::move(result);
+            if (!filtered.push(std::move(image)))
+                break;
+        }
+    });
+
+    StartStep(&threads, options.encoders, NULL, [&]()
+    {
+        BatchItem image;
+        while (filtered.pop(&image))
+        {
+            if (WriteImage(image->output, image->pixels))
+                written++;
+            else
+                failed++;
+            image.reset();
+        }
+    });
+
+    for (GLuint i = 0; i < threads.size(); i++)
+        threads[i].join();
+
+    if (failed > 0)
+        cout << failed << " of " << inputs.size() << " images failed" << endl;
+    return written;
+}
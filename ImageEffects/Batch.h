@@ -0,0 +1,46 @@
+// ==========================================================================
+// Batch Filtering
+//  - filters many image files at once, decoding, filtering and encoding on
+//    separate threads so disk and codec time overlaps the filtering
+//
+// Author:  Matthew Sembinelli, University of Calgary
+// Date:    October 18, 2026
+// ==========================================================================
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+#include <vector>
+
+#include "CpuFilters.h"
+
+using namespace std;
+
+// Images waiting between two steps. With the images each thread holds, this
+// bounds how many are in memory however many files are queued.
+#define BATCH_QUEUE_DEPTH 4
+
+struct BatchOptions
+{
+    vector<FilterStage> stages;
+    string output_directory;
+    // replaces each output's extension when set, "png" say
+    string format;
+    // threads for each step. Filtering threads itself, so one is enough
+    // there, while decoding and encoding run one image per thread.
+    GLuint decoders, filterers, encoders;
+    GLuint queue_depth;
+
+    BatchOptions();
+};
+
+// files named by each argument: a directory's images, the matches of a
+// glob pattern, or the file itself. A file named twice is listed once.
+vector<string> ExpandInputs(const vector<string> &arguments);
+
+// filters every input into the output directory, returning how many images
+// were written. Nothing is written if two inputs would land on the same
+// output file, a/x.png and b/x.png say.
+GLuint RunBatch(const vector<string> &inputs, const BatchOptions &options);
+
+#endif
@@ -0,0 +1,78 @@
+// ==========================================================================
+// Bounded Queue
+//  - hands items between the threads of two pipeline steps, blocking the
+//    producer while full so memory stays bounded
+//
+// Author:  Matthew Sembinelli, University of Calgary
+// Date:    October 18, 2026
+// ==========================================================================
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+using namespace std;
+
+template <class T>
+class BoundedQueue
+{
+    public:
+        explicit BoundedQueue(size_t capacity_) : capacity(capacity_), producers(1), closed(false)
+        {}
+
+        // closes the queue once this many producers have each called close
+        void set_producers(size_t producers_)
+        {
+            lock_guard<mutex> guard(lock);
+            producers = producers_;
+        }
+
+        // blocks while full, false if the queue was closed
+        bool push(T item)
+        {
+            unique_lock<mutex> guard(lock);
+            not_full.wait(guard, [this]() { return items.size() < capacity || closed; });
+            if (closed)
+                return false;
+            items.push_back(std::move(item));
+            not_empty.notify_one();
+            return true;
+        }
+
+        // blocks while empty, false once closed and drained
+        bool pop(T *item)
+        {
+            unique_lock<mutex> guard(lock);
+            not_empty.wait(guard, [this]() { return !items.empty() || closed; });
+            if (items.empty())
+                return false;
+            *item = std::move(items.front());
+            items.pop_front();
+            not_full.notify_one();
+            return true;
+        }
+
+        // called by each producer when it is done
+        void close()
+        {
+            lock_guard<mutex> guard(lock);
+            if (producers > 0 && --producers == 0)
+            {
+                closed = true;
+                not_empty.notify_all();
+                not_full.notify_all();
+            }
+        }
+
+    private:
+        mutex lock;
+        condition_variable not_full, not_empty;
+        deque<T> items;
+        size_t capacity;
+        size_t producers;
+        bool closed;
+};
+
+#endif
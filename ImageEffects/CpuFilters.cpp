@@ -0,0 +1,1025 @@
+// ==========================================================================
+// CPU Filters
+//
+// Author:  Matthew Sembinelli, University of Calgary
+// Date:    October 18, 2026
+// ==========================================================================
+#include "CpuFilters.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <complex>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <math.h>
+
+#include <Magick++.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// A tap on a whole texel, after splitting fractional offsets
+struct Tap
+{
+    GLint dx, dy;
+    GLfloat weight;
+};
+
+// --------------------------------------------------------------------------
+// Buffers
+
+void ImageBuffer::resize(GLuint width_, GLuint height_)
+{
+    width = width_;
+    height = height_;
+    for (GLuint c = 0; c < 3; c++)
+        planes[c].resize(width * height);
+}
+
+void ImportPixels(ImageBuffer *image, const unsigned char *rgb, GLuint width, GLuint height)
+{
+    image->resize(width, height);
+    image->depth = 8;
+    for (GLuint i = 0; i < width * height; i++)
+    {
+        for (GLuint c = 0; c < 3; c++)
+            image->planes[c][i] = rgb[i * 3 + c] / 255.0f;
+    }
+}
+
+void ImportPixels(ImageBuffer *image, const GLfloat *rgb, GLuint width, GLuint height)
+{
+    image->resize(width, height);
+    for (GLuint i = 0; i < width * height; i++)
+    {
+        for (GLuint c = 0; c < 3; c++)
+            image->planes[c][i] = rgb[i * 3 + c];
+    }
+}
+
+void ExportPixels(const ImageBuffer &image, unsigned char *rgb)
+{
+    for (GLuint i = 0; i < image.width * image.height; i++)
+    {
+        for (GLuint c = 0; c < 3; c++)
+            rgb[i * 3 + c] = (unsigned char)(std::min(std::max(image.planes[c][i], 0.0f), 1.0f) * 255 + 0.5f);
+    }
+}
+
+void ExportPixels(const ImageBuffer &image, GLfloat *rgb)
+{
+    for (GLuint i = 0; i < image.width * image.height; i++)
+    {
+        for (GLuint c = 0; c < 3; c++)
+            rgb[i * 3 + c] = std::min(std::max(image.planes[c][i], 0.0f), 1.0f);
+    }
+}
+
+bool ReadImage(const string &filename, ImageBuffer *image)
+{
+    Magick::Image myImage;
+    vector<GLfloat> rgb;
+    try {
+        myImage.read(filename);
+        rgb.resize(myImage.columns() * myImage.rows() * 3);
+        myImage.write(0, 0, myImage.columns(), myImage.rows(), "RGB", Magick::FloatPixel, &rgb[0]);
+    }
+    catch (Magick::Error &error) {
+        cout << "Magick++ failed to read image " << filename << endl;
+        cout << "ERROR: " << error.what() << endl;
+        return false;
+    }
+    ImportPixels(image, &rgb[0], myImage.columns(), myImage.rows());
+    image->depth = myImage.depth() > 8 ? 16 : 8;
+    return true;
+}
+
+bool WriteImage(const string &filename, const ImageBuffer &image)
+{
+    vector<GLfloat> rgb(image.width * image.height * 3);
+    ExportPixels(image, &rgb[0]);
+    try {
+        Magick::Image myImage(image.width, image.height, "RGB", Magick::FloatPixel, &rgb[0]);
+        myImage.depth(image.depth);
+        myImage.write(filename);
+    }
+    catch (Magick::Error &error) {
+        cout << "Magick++ failed to write image " << filename << endl;
+        cout << "ERROR: " << error.what() << endl;
+        return false;
+    }
+    return true;
+}
+
+// --------------------------------------------------------------------------
+// Row kernels
+
+// out += in * weight over count floats
+static void AccumulateRow(GLfloat *out, const GLfloat *in, GLfloat weight, GLuint count)
+{
+    GLuint x = 0;
+#if defined(__AVX2__)
+    __m256 w = _mm256_set1_ps(weight);
+    for (; x + 8 <= count; x += 8)
+        _mm256_storeu_ps(out + x, _mm256_add_ps(_mm256_loadu_ps(out + x), _mm256_mul_ps(_mm256_loadu_ps(in + x), w)));
+#elif defined(__ARM_NEON)
+    float32x4_t w = vdupq_n_f32(weight);
+    for (; x + 4 <= count; x += 4)
+        vst1q_f32(out + x, vmlaq_f32(vld1q_f32(out + x), vld1q_f32(in + x), w));
+#endif
+    for (; x < count; x++)
+        out[x] += in[x] * weight;
+}
+
+// out = in * matrix for a row of row vector colours held as three planes
+static void ColourRow(GLfloat *const out[3], const GLfloat *const in[3], const glm::mat3 &matrix, GLuint count)
+{
+    bool identity = matrix == glm::mat3(1.0);
+    for (GLuint j = 0; j < 3; j++)
+    {
+        if (identity)
+        {
+            std::copy(in[j], in[j] + count, out[j]);
+            continue;
+        }
+        std::fill(out[j], out[j] + count, 0.0f);
+        for (GLuint i = 0; i < 3; i++)
+        {
+            if (matrix[j][i] != 0)
+                AccumulateRow(out[j], in[i], matrix[j][i], count);
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+// Threads
+
+// runs rows in strips of strip_rows across one thread per core
+static void RunStrips(GLuint rows, const function<void(GLuint, GLuint)> &work, GLuint strip_rows = CPU_STRIP)
+{
+    GLuint strips = (rows + strip_rows - 1) / strip_rows;
+    atomic<GLuint> next(0);
+    auto worker = [&]()
+    {
+        for (GLuint strip = next++; strip < strips; strip = next++)
+            work(strip * strip_rows, std::min(rows, (strip + 1) * strip_rows));
+    };
+
+    vector<thread> threads;
+    GLuint thread_count = std::min(strips, std::max(1u, thread::hardware_concurrency()));
+    for (GLuint i = 1; i < thread_count; i++)
+        threads.push_back(thread(worker));
+    worker();
+    for (GLuint i = 0; i < threads.size(); i++)
+        threads[i].join();
+}
+
+static void AddTap(vector<Tap> *taps, GLint dx, GLint dy, GLfloat weight)
+{
+    if (weight == 0)
+        return;
+    for (GLuint i = 0; i < taps->size(); i++)
+    {
+        if ((*taps)[i].dx == dx && (*taps)[i].dy == dy)
+        {
+            (*taps)[i].weight += weight;
+            return;
+        }
+    }
+    Tap tap = { dx, dy, weight };
+    taps->push_back(tap);
+}
+
+// a stage's taps on whole texels, each fractional one shared between the
+// texels around it as linear filtering shares it
+static vector<Tap> WholeTaps(const FilterStage &stage)
+{
+    vector<Tap> taps;
+    for (GLint i = 0; i < stage.taps; i++)
+    {
+        glm::vec2 offset = stage.offsets[i];
+        GLint x0 = (GLint)floor(offset.x), y0 = (GLint)floor(offset.y);
+        GLfloat fx = offset.x - x0, fy = offset.y - y0;
+        GLfloat weight = stage.weights[i];
+        AddTap(&taps, x0, y0, weight * (1 - fx) * (1 - fy));
+        AddTap(&taps, x0 + 1, y0, weight * fx * (1 - fy));
+        AddTap(&taps, x0, y0 + 1, weight * (1 - fx) * fy);
+        AddTap(&taps, x0 + 1, y0 + 1, weight * fx * fy);
+    }
+    return taps;
+}
+
+// --------------------------------------------------------------------------
+// Recursive gaussian
+
+// Deriche's fourth order recursive gaussian, the sum of a causal filter
+// run forward along a row and an anticausal one run backward, both on the
+// input:
+//   y+[n] = b+[0] x[n] + .. + b+[3] x[n - 3] - a[1] y+[n - 1] - .. - a[4] y+[n - 4]
+//   y-[n] = b-[1] x[n + 1] + .. + b-[4] x[n + 4] - a[1] y-[n + 1] - .. - a[4] y-[n + 4]
+struct RecursiveGaussian
+{
+    double causal[4];
+    double anticausal[5];
+    double a[5];
+    // what each half settles to, per unit of input, where the input has been
+    // constant for ever, as it has past the ends of a row clamped there
+    double causal_gain, anticausal_gain;
+};
+
+// Deriche's fit of exp(-x^2 / 2) for x >= 0 by two damped sinusoids,
+// (a0 cos(w0 x) + a1 sin(w0 x)) exp(-b0 x) + (c0 cos(w1 x) + c1 sin(w1 x)) exp(-b1 x)
+static const double DERICHE_A0 = 1.680, DERICHE_A1 = 3.735, DERICHE_B0 = 1.783, DERICHE_W0 = 0.6318;
+static const double DERICHE_C0 = -0.6803, DERICHE_C1 = -0.2598, DERICHE_B1 = 1.723, DERICHE_W1 = 1.997;
+
+static double DericheResponse(double x)
+{
+    return (DERICHE_A0 * cos(DERICHE_W0 * x) + DERICHE_A1 * sin(DERICHE_W0 * x)) * exp(-DERICHE_B0 * x) +
+           (DERICHE_C0 * cos(DERICHE_W1 * x) + DERICHE_C1 * sin(DERICHE_W1 * x)) * exp(-DERICHE_B1 * x);
+}
+
+static RecursiveGaussian RecursiveCoefficients(GLfloat sigma)
+{
+    // the denominator has a conjugate pair of poles for each sinusoid
+    complex<double> poles[2] = { exp(complex<double>(-DERICHE_B0, DERICHE_W0) / (double)sigma),
+                                 exp(complex<double>(-DERICHE_B1, DERICHE_W1) / (double)sigma) };
+    complex<double> denominator[5] = { 1.0, 0.0, 0.0, 0.0, 0.0 };
+    for (GLuint k = 0; k < 4; k++)
+    {
+        complex<double> pole = k % 2 ? conj(poles[k / 2]) : poles[k / 2];
+        for (GLuint i = k + 1; i > 0; i--)
+            denominator[i] -= pole * denominator[i - 1];
+    }
+
+    // numerators from the response times the denominator, which ends
+    // within four taps since the response is a sum of the poles' powers
+    RecursiveGaussian gaussian;
+    double h[5];
+    for (GLuint n = 0; n < 5; n++)
+    {
+        h[n] = DericheResponse(n / (double)sigma);
+        gaussian.a[n] = denominator[n].real();
+    }
+    double causal_sum = 0, anticausal_sum = 0, a_sum = 0;
+    for (GLuint j = 0; j < 5; j++)
+    {
+        double causal = 0, anticausal = 0;
+        for (GLuint i = 0; i <= j; i++)
+        {
+            causal += h[j - i] * gaussian.a[i];
+            if (i < j)
+                anticausal += h[j - i] * gaussian.a[i];
+        }
+        if (j < 4)
+            gaussian.causal[j] = causal;
+        gaussian.anticausal[j] = anticausal;
+        causal_sum += j < 4 ? causal : 0;
+        anticausal_sum += anticausal;
+        a_sum += gaussian.a[j];
+    }
+
+    // normalized so a constant row stays as it is
+    double scale = a_sum / (causal_sum + anticausal_sum);
+    for (GLuint j = 0; j < 5; j++)
+    {
+        if (j < 4)
+            gaussian.causal[j] *= scale;
+        gaussian.anticausal[j] *= scale;
+    }
+    gaussian.causal_gain = causal_sum * scale / a_sum;
+    gaussian.anticausal_gain = anticausal_sum * scale / a_sum;
+    return gaussian;
+}
+
+// blurs count floats in place, clamped at both ends. forward holds count
+// doubles of scratch.
+static void RecursiveRow(GLfloat *row, GLuint count, const RecursiveGaussian &gaussian, double *forward)
+{
+    const double *b = gaussian.causal, *a = gaussian.a;
+
+    // before the start the input has always been the first value, so the
+    // causal half starts where it settles for it
+    double x1 = row[0], x2 = row[0], x3 = row[0];
+    double y1 = row[0] * gaussian.causal_gain, y2 = y1, y3 = y1, y4 = y1;
+    for (GLuint n = 0; n < count; n++)
+    {
+        double x0 = row[n];
+        double value = b[0] * x0 + b[1] * x1 + b[2] * x2 + b[3] * x3 - a[1] * y1 - a[2] * y2 - a[3] * y3 - a[4] * y4;
+        x3 = x2; x2 = x1; x1 = x0;
+        y4 = y3; y3 = y2; y2 = y1; y1 = value;
+        forward[n] = value;
+    }
+
+    // and past the end the last value, for the anticausal half
+    b = gaussian.anticausal;
+    double last = row[count - 1];
+    double x4 = last;
+    x1 = x2 = x3 = last;
+    y1 = y2 = y3 = y4 = last * gaussian.anticausal_gain;
+    for (GLint n = count - 1; n >= 0; n--)
+    {
+        double value = b[1] * x1 + b[2] * x2 + b[3] * x3 + b[4] * x4 - a[1] * y1 - a[2] * y2 - a[3] * y3 - a[4] * y4;
+        x4 = x3; x3 = x2; x2 = x1; x1 = row[n];
+        y4 = y3; y3 = y2; y2 = y1; y1 = value;
+        row[n] = forward[n] + value;
+    }
+}
+
+// rows in strips, then columns a tile at a time, each tile transposed so
+// its columns become rows and back again
+static void RecursiveBlur(const ImageBuffer &input, GLfloat sigma, ImageBuffer *output)
+{
+    RecursiveGaussian gaussian = RecursiveCoefficients(sigma);
+    GLuint width = input.width, height = input.height;
+    *output = input;
+
+    RunStrips(height, [&](GLuint first, GLuint last)
+    {
+        vector<double> forward(width);
+        for (GLuint y = first; y < last; y++)
+            for (GLuint c = 0; c < 3; c++)
+                RecursiveRow(output->row(c, y), width, gaussian, &forward[0]);
+    });
+
+    RunStrips(width, [&](GLuint first, GLuint last)
+    {
+        vector<double> forward(height);
+        vector<GLfloat> columns((last - first) * height);
+        for (GLuint c = 0; c < 3; c++)
+        {
+            for (GLuint y = 0; y < height; y++)
+            {
+                const GLfloat *source = output->row(c, y) + first;
+                for (GLuint x = 0; x < last - first; x++)
+                    columns[x * height + y] = source[x];
+            }
+            for (GLuint x = 0; x < last - first; x++)
+                RecursiveRow(&columns[x * height], height, gaussian, &forward[0]);
+            for (GLuint y = 0; y < height; y++)
+            {
+                GLfloat *target = output->row(c, y) + first;
+                for (GLuint x = 0; x < last - first; x++)
+                    target[x] = columns[x * height + y];
+            }
+        }
+    }, CPU_COLUMN_TILE);
+}
+
+// --------------------------------------------------------------------------
+// Summed area tables
+
+// Sums of the input padded by the box's reach with its edges repeated,
+// behind a leading zero row and column, so table (x, y) holds everything
+// above and left of padded pixel (x, y). A fourth table holds squared
+// luminance when the stage needs the box's variance. Rows are summed in
+// parallel, then columns as a parallel prefix sum: each strip sums down
+// itself, the strips' totals are carried down in order, and each strip
+// adds what was carried into it.
+static void SummedArea(const ImageBuffer &input, const FilterStage &stage, vector<double> tables[4])
+{
+    GLint width = input.width, height = input.height;
+    GLint size = stage.box_to - stage.box_from + 1;
+    GLint table_width = width + size, table_height = height + size;
+    GLuint count = stage.box_noise > 0 ? 4 : 3;
+    for (GLuint c = 0; c < count; c++)
+        tables[c].assign(table_width * table_height, 0.0);
+
+    RunStrips(table_height, [&](GLuint first, GLuint last)
+    {
+        for (GLuint y = std::max(first, 1u); y < last; y++)
+        {
+            GLint source_y = std::min(std::max((GLint)y - 1 + stage.box_from, 0), height - 1);
+            const GLfloat *source[3] = { input.row(0, source_y), input.row(1, source_y), input.row(2, source_y) };
+            double sums[4] = { 0, 0, 0, 0 };
+            for (GLint x = 1; x < table_width; x++)
+            {
+                GLint source_x = std::min(std::max(x - 1 + stage.box_from, 0), width - 1);
+                for (GLuint c = 0; c < 3; c++)
+                    tables[c][y * table_width + x] = sums[c] += source[c][source_x];
+                if (count == 4)
+                {
+                    double luminance = greyscale.x * source[0][source_x] + greyscale.y * source[1][source_x] +
+                                       greyscale.z * source[2][source_x];
+                    tables[3][y * table_width + x] = sums[3] += luminance * luminance;
+                }
+            }
+        }
+    });
+
+    // a strip per core, or near enough, keeps the carrying short
+    GLuint cores = std::max(1u, thread::hardware_concurrency());
+    GLuint strip_rows = std::max((GLuint)CPU_STRIP, (table_height + cores - 1) / cores);
+    RunStrips(table_height, [&](GLuint first, GLuint last)
+    {
+        for (GLuint c = 0; c < count; c++)
+            for (GLuint y = first + 1; y < last; y++)
+            {
+                double *row = &tables[c][y * table_width];
+                const double *above = row - table_width;
+                for (GLint x = 0; x < table_width; x++)
+                    row[x] += above[x];
+            }
+    }, strip_rows);
+
+    GLuint strips = (table_height + strip_rows - 1) / strip_rows;
+    vector<double> carried[4];
+    for (GLuint c = 0; c < count; c++)
+    {
+        carried[c].assign(strips * table_width, 0.0);
+        for (GLuint strip = 1; strip < strips; strip++)
+        {
+            double *carry = &carried[c][strip * table_width];
+            const double *previous = &carried[c][(strip - 1) * table_width];
+            const double *total = &tables[c][(strip * strip_rows - 1) * table_width];
+            for (GLint x = 0; x < table_width; x++)
+                carry[x] = previous[x] + total[x];
+        }
+    }
+
+    RunStrips(table_height, [&](GLuint first, GLuint last)
+    {
+        if (first == 0)
+            return;
+        for (GLuint c = 0; c < count; c++)
+        {
+            const double *carry = &carried[c][first / strip_rows * table_width];
+            for (GLuint y = first; y < last; y++)
+            {
+                double *row = &tables[c][y * table_width];
+                for (GLint x = 0; x < table_width; x++)
+                    row[x] += carry[x];
+            }
+        }
+    }, strip_rows);
+}
+
+// each pixel's box mean, four table reads whatever the box's size, or for
+// an adaptive mean the pixel moved toward it by how flat the box is
+static void BoxMean(const ImageBuffer &input, const FilterStage &stage, ImageBuffer *output)
+{
+    vector<double> tables[4];
+    SummedArea(input, stage, tables);
+
+    GLint width = input.width, height = input.height;
+    GLint size = stage.box_to - stage.box_from + 1;
+    GLint table_width = width + size;
+    double area = (double)size * size;
+    double noise = (double)stage.box_noise * stage.box_noise;
+    output->resize(width, height);
+    RunStrips(height, [&](GLuint first, GLuint last)
+    {
+        double means[4][CPU_SEGMENT];
+        for (GLuint y = first; y < last; y++)
+        {
+            for (GLint x0 = 0; x0 < width; x0 += CPU_SEGMENT)
+            {
+                GLint count = std::min(width - x0, (GLint)CPU_SEGMENT);
+                for (GLuint c = 0; c < (noise > 0 ? 4u : 3u); c++)
+                {
+                    const double *top = &tables[c][y * table_width + x0];
+                    const double *bottom = top + size * table_width;
+                    for (GLint x = 0; x < count; x++)
+                        means[c][x] = (bottom[x + size] - bottom[x] - top[x + size] + top[x]) / area;
+                }
+
+                if (noise == 0)
+                {
+                    for (GLuint c = 0; c < 3; c++)
+                        std::copy(means[c], means[c] + count, output->row(c, y) + x0);
+                    continue;
+                }
+                for (GLint x = 0; x < count; x++)
+                {
+                    double luminance = greyscale.x * means[0][x] + greyscale.y * means[1][x] + greyscale.z * means[2][x];
+                    double variance = std::max(means[3][x] - luminance * luminance, 0.0);
+                    double keep = variance / (variance + noise);
+                    for (GLuint c = 0; c < 3; c++)
+                        output->row(c, y)[x0 + x] = means[c][x] + keep * (input.row(c, y)[x0 + x] - means[c][x]);
+                }
+            }
+        }
+    });
+}
+
+// --------------------------------------------------------------------------
+// Rank filters
+
+// each channel as levels of its depth, 0 to 2^depth - 1
+static void QuantizeLevels(const ImageBuffer &input, vector<GLushort> levels[3])
+{
+    GLfloat top = (GLfloat)((1 << input.depth) - 1);
+    for (GLuint c = 0; c < 3; c++)
+        levels[c].resize(input.width * input.height);
+    RunStrips(input.height, [&](GLuint first, GLuint last)
+    {
+        for (GLuint c = 0; c < 3; c++)
+            for (GLuint i = first * input.width; i < last * input.width; i++)
+                levels[c][i] = (GLushort)(std::min(std::max(input.planes[c][i], 0.0f), 1.0f) * top + 0.5f);
+    });
+}
+
+// a level that left or entered a column histogram as it moved down
+struct RankMove
+{
+    GLint column;
+    GLushort level;
+    GLint change;
+};
+
+// Histograms a worker ranks tiles with. Column counts stay under 256 as
+// no window is over 255 tall, and they are all zero between tiles.
+struct RankHistograms
+{
+    vector<GLubyte> coarse, fine;
+    vector<GLushort> window_coarse, window_fine;
+    // column and row each coarse bin's fine counts were last brought to
+    vector<GLint> fine_at, fine_row;
+    // the levels that moved on the last row, by coarse bin from
+    // moved_first[bin] and then by column
+    vector<RankMove> moved;
+    vector<GLint> moved_first, moved_next;
+};
+
+// Ranks columns x0 to x1 of rows y0 to y1 of one channel of 2^BITS levels
+// with Perreault and Hebert's constant time median. Each column keeps a
+// histogram of its 2r + 1 levels from r above the row to r below, which
+// moves down with two updates. The window's histogram moves sideways by
+// adding one column histogram and taking one away, and rows are walked
+// back and forth so it moves down between them with 2(2r + 1) updates
+// rather than being summed again. Counts are split into coarse bins of the
+// high half of each level and fine bins of the whole level, so a rank is
+// found by walking one coarse and one fine run. The window keeps fine
+// counts only for the coarse bins it looks in, brought up to date when it
+// next looks by whichever is less work: moving them down the rows since and
+// across from where they were, or summing them afresh. Moving down a row
+// only visits the bin's own levels that moved, so the work per pixel
+// does not grow with r.
+template <GLuint BITS>
+static void RankTile(const vector<GLushort> &levels, GLint width, GLint height, GLint radius, GLuint rank,
+                     GLint x0, GLint x1, GLint y0, GLint y1, RankHistograms *histograms, GLfloat *output)
+{
+    const GLuint fine_bins = 1 << BITS, coarse_bins = 1 << (BITS / 2);
+    const GLuint segment = fine_bins / coarse_bins, shift = BITS - BITS / 2;
+    GLint window = 2 * radius + 1;
+
+    // columns x0 - radius to x1 + radius - 1, edge columns repeating
+    GLint span = x1 - x0 + 2 * radius;
+    vector<GLint> source_x(span);
+    for (GLint i = 0; i < span; i++)
+        source_x[i] = std::min(std::max(x0 - radius + i, 0), width - 1);
+    if (histograms->fine.size() < (size_t)span * fine_bins)
+    {
+        histograms->coarse.resize(span * coarse_bins);
+        histograms->fine.resize(span * fine_bins);
+    }
+    histograms->window_coarse.assign(coarse_bins, 0);
+    histograms->window_fine.resize(fine_bins);
+    histograms->fine_at.resize(coarse_bins);
+    histograms->fine_row.assign(coarse_bins, INT_MIN);
+    histograms->moved.resize(2 * span);
+    histograms->moved_first.resize(coarse_bins + 1);
+    histograms->moved_next.resize(coarse_bins);
+    GLubyte *coarse = &histograms->coarse[0], *fine = &histograms->fine[0];
+    GLushort *window_coarse = &histograms->window_coarse[0], *window_fine = &histograms->window_fine[0];
+    GLint *fine_at = &histograms->fine_at[0], *fine_row = &histograms->fine_row[0];
+    RankMove *moved = &histograms->moved[0];
+    GLint *moved_first = &histograms->moved_first[0], *moved_next = &histograms->moved_next[0];
+
+    auto row_of = [&](GLint y) { return &levels[std::min(std::max(y, 0), height - 1) * width]; };
+    auto count = [&](GLint y, GLubyte change)
+    {
+        const GLushort *row = row_of(y);
+        for (GLint i = 0; i < span; i++)
+        {
+            GLushort level = row[source_x[i]];
+            coarse[i * coarse_bins + (level >> shift)] += change;
+            fine[i * fine_bins + level] += change;
+        }
+    };
+    for (GLint y = y0 - radius; y <= y0 + radius; y++)
+        count(y, 1);
+    for (GLint i = 0; i < window; i++)
+        for (GLuint b = 0; b < coarse_bins; b++)
+            window_coarse[b] += coarse[i * coarse_bins + b];
+
+    GLint x = x0;
+    for (GLint y = y0; y < y1; y++)
+    {
+        if (y > y0)
+        {
+            // adding the largest count takes one away, as it wraps
+            count(y - radius - 1, (GLubyte)-1);
+            count(y + radius, 1);
+            const GLushort *leaving = row_of(y - radius - 1), *entering = row_of(y + radius);
+            for (GLint i = x - x0; i < x - x0 + window; i++)
+            {
+                window_coarse[leaving[source_x[i]] >> shift]--;
+                window_coarse[entering[source_x[i]] >> shift]++;
+            }
+
+            std::fill(moved_first, moved_first + coarse_bins + 1, 0);
+            for (GLint i = 0; i < span; i++)
+            {
+                moved_first[(leaving[source_x[i]] >> shift) + 1]++;
+                moved_first[(entering[source_x[i]] >> shift) + 1]++;
+            }
+            for (GLuint b = 1; b <= coarse_bins; b++)
+                moved_first[b] += moved_first[b - 1];
+            std::copy(moved_first, moved_first + coarse_bins, moved_next);
+            for (GLint i = 0; i < span; i++)
+            {
+                GLushort out = leaving[source_x[i]], in = entering[source_x[i]];
+                RankMove out_move = { i, out, -1 }, in_move = { i, in, 1 };
+                moved[moved_next[out >> shift]++] = out_move;
+                moved[moved_next[in >> shift]++] = in_move;
+            }
+        }
+
+        GLint step = (y - y0) % 2 == 0 ? 1 : -1;
+        for (GLint n = 0; n < x1 - x0; n++)
+        {
+            if (n > 0)
+            {
+                // the column beyond the window on the side it moves to
+                // enters, the one on its far side leaves
+                x += step;
+                GLint left = x - x0;
+                const GLubyte *entering = &coarse[(step > 0 ? left + window - 1 : left) * coarse_bins];
+                const GLubyte *leaving = &coarse[(step > 0 ? left - 1 : left + window) * coarse_bins];
+                for (GLuint b = 0; b < coarse_bins; b++)
+                    window_coarse[b] += entering[b] - leaving[b];
+            }
+
+            GLuint below = 0, bin = 0;
+            while (below + window_coarse[bin] <= rank)
+                below += window_coarse[bin++];
+
+            GLushort *counts = &window_fine[bin * segment];
+            long long rows = (long long)y - fine_row[bin], columns = std::abs(x - fine_at[bin]);
+            long long moves = rows > 0 ? (rows - 1) * 2 * window + moved_first[bin + 1] - moved_first[bin] : 0;
+            if (moves + columns * 2 * segment > (long long)window * segment)
+            {
+                std::fill(counts, counts + segment, 0);
+                for (GLint i = x - x0; i < x - x0 + window; i++)
+                {
+                    const GLubyte *column = &fine[i * fine_bins + bin * segment];
+                    for (GLuint f = 0; f < segment; f++)
+                        counts[f] += column[f];
+                }
+            }
+            else
+            {
+                // down to the row above over the columns it was at, from
+                // the levels themselves, then this bin's moves into the row
+                GLint from_left = fine_at[bin] - x0;
+                for (GLint below_row = fine_row[bin] + 1; below_row < y; below_row++)
+                {
+                    const GLushort *leaving = row_of(below_row - radius - 1), *entering = row_of(below_row + radius);
+                    for (GLint i = from_left; i < from_left + window; i++)
+                    {
+                        GLushort out = leaving[source_x[i]], in = entering[source_x[i]];
+                        if ((GLuint)(out >> shift) == bin)
+                            counts[out & (segment - 1)]--;
+                        if ((GLuint)(in >> shift) == bin)
+                            counts[in & (segment - 1)]++;
+                    }
+                }
+                if (rows > 0)
+                {
+                    const RankMove *move = moved + moved_first[bin], *end = moved + moved_first[bin + 1];
+                    move = std::lower_bound(move, end, from_left, [](const RankMove &m, GLint i) { return m.column < i; });
+                    for (; move != end && move->column < from_left + window; move++)
+                        counts[move->level & (segment - 1)] += move->change;
+                }
+                // then across to this column
+                GLint across = x > fine_at[bin] ? 1 : -1;
+                for (GLint from = fine_at[bin]; from != x; from += across)
+                {
+                    GLint left = from + across - x0;
+                    const GLubyte *entering = &fine[(across > 0 ? left + window - 1 : left) * fine_bins + bin * segment];
+                    const GLubyte *leaving = &fine[(across > 0 ? left - 1 : left + window) * fine_bins + bin * segment];
+                    for (GLuint f = 0; f < segment; f++)
+                        counts[f] += entering[f] - leaving[f];
+                }
+            }
+            fine_at[bin] = x;
+            fine_row[bin] = y;
+
+            GLuint f = 0;
+            while (below + counts[f] <= rank)
+                below += counts[f++];
+            output[y * width + x] = (bin * segment + f) / (GLfloat)(fine_bins - 1);
+        }
+    }
+
+    // take the last rows back out, leaving the columns empty for the next
+    // tile
+    for (GLint y = y1 - 1 - radius; y <= y1 - 1 + radius; y++)
+        count(y, (GLubyte)-1);
+}
+
+// the index into a window's sorted levels a percentile falls on
+static GLuint RankIndex(const FilterStage &stage)
+{
+    GLuint window = (2 * stage.rank_radius + 1) * (2 * stage.rank_radius + 1);
+    return (GLuint)(stage.rank_percentile / 100 * (window - 1) + 0.5f);
+}
+
+// each channel's percentile over the window, in tiles of whole rows where
+// the histograms fit and as wide as they allow where not, so the window
+// either side adds little. Rows are split into bands to give every core a
+// tile, and each core keeps its histograms from tile to tile.
+static void RankFilter(const ImageBuffer &input, const FilterStage &stage, ImageBuffer *output)
+{
+    vector<GLushort> levels[3];
+    QuantizeLevels(input, levels);
+    output->resize(input.width, input.height);
+    GLuint rank = RankIndex(stage);
+    GLint width = input.width, height = input.height, radius = stage.rank_radius;
+
+    GLint tile_width = input.depth > 8 ? std::min(width, CPU_RANK_COLUMNS - 2 * radius) : width;
+    GLint tiles_across = (width + tile_width - 1) / tile_width;
+    GLint cores = std::max(1u, thread::hardware_concurrency());
+    GLint bands = std::max(1, std::min((cores + tiles_across - 1) / tiles_across, (height + CPU_STRIP - 1) / CPU_STRIP));
+    GLint band_rows = (height + bands - 1) / bands;
+    bands = (height + band_rows - 1) / band_rows;
+    GLuint tiles = tiles_across * bands;
+
+    atomic<GLuint> next(0);
+    RunStrips(std::min(tiles, (GLuint)cores), [&](GLuint, GLuint)
+    {
+        RankHistograms histograms;
+        for (GLuint tile = next++; tile < tiles; tile = next++)
+        {
+            GLint x0 = tile % tiles_across * tile_width, y0 = tile / tiles_across * band_rows;
+            GLint x1 = std::min(width, x0 + tile_width), y1 = std::min(height, y0 + band_rows);
+            for (GLuint c = 0; c < 3; c++)
+            {
+                if (input.depth > 8)
+                    RankTile<16>(levels[c], width, height, radius, rank, x0, x1, y0, y1, &histograms, &output->planes[c][0]);
+                else
+                    RankTile<8>(levels[c], width, height, radius, rank, x0, x1, y0, y1, &histograms, &output->planes[c][0]);
+            }
+        }
+    }, 1);
+}
+
+// --------------------------------------------------------------------------
+// Stages
+
+// the image a stage's taps read, its input or that blurred, boxed or ranked
+// first
+static const ImageBuffer &TapInput(const ImageBuffer &input, const FilterStage &stage, ImageBuffer *smoothed)
+{
+    if (stage.recursive_sigma > 0)
+        RecursiveBlur(input, stage.recursive_sigma, smoothed);
+    else if (stage.boxed())
+        BoxMean(input, stage, smoothed);
+    else if (stage.rank_radius > 0)
+        RankFilter(input, stage, smoothed);
+    else
+        return input;
+    return *smoothed;
+}
+
+void RunStage(const ImageBuffer &original, const FilterStage &stage, ImageBuffer *output)
+{
+    ImageBuffer smoothed;
+    const ImageBuffer &input = TapInput(original, stage, &smoothed);
+
+    vector<Tap> taps = WholeTaps(stage);
+    GLint border = 0;
+    for (GLuint i = 0; i < taps.size(); i++)
+        border = std::max(border, std::max(abs(taps[i].dx), abs(taps[i].dy)));
+
+    // copy the input with its edges repeated border texels out, so every
+    // tap reads a plain run of floats
+    GLint width = input.width, height = input.height;
+    GLint padded_width = width + 2 * border;
+    vector<GLfloat> padded[3];
+    for (GLuint c = 0; c < 3; c++)
+        padded[c].resize(padded_width * (height + 2 * border));
+    RunStrips(height + 2 * border, [&](GLuint first, GLuint last)
+    {
+        for (GLuint y = first; y < last; y++)
+        {
+            GLint source_y = std::min(std::max((GLint)y - border, 0), height - 1);
+            for (GLuint c = 0; c < 3; c++)
+            {
+                const GLfloat *source = input.row(c, source_y);
+                GLfloat *target = &padded[c][y * padded_width];
+                std::fill(target, target + border, source[0]);
+                std::copy(source, source + width, target + border);
+                std::fill(target + border + width, target + padded_width, source[width - 1]);
+            }
+        }
+    });
+
+    output->resize(width, height);
+    RunStrips(height, [&](GLuint first, GLuint last)
+    {
+        GLfloat sums[3][CPU_SEGMENT], mixed[3][CPU_SEGMENT];
+        GLfloat *sum_rows[3] = { sums[0], sums[1], sums[2] };
+        GLfloat *mixed_rows[3] = { mixed[0], mixed[1], mixed[2] };
+        for (GLuint y = first; y < last; y++)
+        {
+            for (GLint x = 0; x < width; x += CPU_SEGMENT)
+            {
+                GLuint count = std::min(width - x, CPU_SEGMENT);
+                for (GLuint c = 0; c < 3; c++)
+                    std::fill(sums[c], sums[c] + count, 0.0f);
+                for (GLuint i = 0; i < taps.size(); i++)
+                {
+                    GLint start = (y + border + taps[i].dy) * padded_width + x + border + taps[i].dx;
+                    for (GLuint c = 0; c < 3; c++)
+                        AccumulateRow(sums[c], &padded[c][start], taps[i].weight, count);
+                }
+
+                ColourRow(mixed_rows, sum_rows, stage.pre, count);
+                if (stage.absolute)
+                {
+                    for (GLuint c = 0; c < 3; c++)
+                        for (GLuint j = 0; j < count; j++)
+                            mixed[c][j] = fabsf(mixed[c][j]);
+                }
+                GLfloat *out_rows[3] = { output->row(0, y) + x, output->row(1, y) + x, output->row(2, y) + x };
+                ColourRow(out_rows, mixed_rows, stage.post, count);
+            }
+        }
+    });
+    output->depth = original.depth;
+}
+
+void RunFilters(const ImageBuffer &input, const vector<FilterStage> &stages, ImageBuffer *output)
+{
+    if (stages.empty())
+    {
+        *output = input;
+        return;
+    }
+
+    // ping-pong between the output and one spare buffer
+    ImageBuffer spare;
+    bool into_output = stages.size() % 2 == 1;
+    const ImageBuffer *source = &input;
+    for (GLuint i = 0; i < stages.size(); i++)
+    {
+        ImageBuffer *target = into_output ? output : &spare;
+        RunStage(*source, stages[i], target);
+        source = target;
+        into_output = !into_output;
+    }
+}
+
+// a true gaussian reaching six sigma, one direction then the other
+static void GaussianReference(const ImageBuffer &input, GLfloat sigma, ImageBuffer *output)
+{
+    GLint width = input.width, height = input.height;
+    GLint radius = (GLint)ceil(6 * sigma);
+    vector<double> weights(2 * radius + 1);
+    double weight_sum = 0;
+    for (GLint i = -radius; i <= radius; i++)
+        weight_sum += weights[i + radius] = exp(-0.5 * (i / sigma) * (i / sigma));
+
+    ImageBuffer across;
+    across.resize(width, height);
+    output->resize(width, height);
+    for (GLuint c = 0; c < 3; c++)
+    {
+        for (GLint y = 0; y < height; y++)
+            for (GLint x = 0; x < width; x++)
+            {
+                double sum = 0;
+                for (GLint i = -radius; i <= radius; i++)
+                    sum += weights[i + radius] * input.row(c, y)[std::min(std::max(x + i, 0), width - 1)];
+                across.row(c, y)[x] = sum / weight_sum;
+            }
+        for (GLint y = 0; y < height; y++)
+            for (GLint x = 0; x < width; x++)
+            {
+                double sum = 0;
+                for (GLint i = -radius; i <= radius; i++)
+                    sum += weights[i + radius] * across.row(c, std::min(std::max(y + i, 0), height - 1))[x];
+                output->row(c, y)[x] = sum / weight_sum;
+            }
+    }
+}
+
+// box means summed one pixel at a time, across then down
+static void BoxReference(const ImageBuffer &input, const FilterStage &stage, ImageBuffer *output)
+{
+    GLint width = input.width, height = input.height;
+    GLint size = stage.box_to - stage.box_from + 1;
+    GLuint count = stage.box_noise > 0 ? 4 : 3;
+    vector<double> across[4], means[4];
+    for (GLuint c = 0; c < count; c++)
+    {
+        across[c].resize(width * height);
+        means[c].resize(width * height);
+    }
+    for (GLint y = 0; y < height; y++)
+        for (GLint x = 0; x < width; x++)
+            for (GLint i = stage.box_from; i <= stage.box_to; i++)
+            {
+                GLint source_x = std::min(std::max(x + i, 0), width - 1);
+                glm::vec3 colour(input.row(0, y)[source_x], input.row(1, y)[source_x], input.row(2, y)[source_x]);
+                for (GLuint c = 0; c < 3; c++)
+                    across[c][y * width + x] += colour[c];
+                if (count == 4)
+                    across[3][y * width + x] += (double)glm::dot(colour, greyscale) * glm::dot(colour, greyscale);
+            }
+    for (GLuint c = 0; c < count; c++)
+        for (GLint y = 0; y < height; y++)
+            for (GLint x = 0; x < width; x++)
+            {
+                for (GLint i = stage.box_from; i <= stage.box_to; i++)
+                    means[c][y * width + x] += across[c][std::min(std::max(y + i, 0), height - 1) * width + x];
+                means[c][y * width + x] /= (double)size * size;
+            }
+
+    output->resize(width, height);
+    for (GLint i = 0; i < width * height; i++)
+    {
+        double keep = 0;
+        if (count == 4)
+        {
+            double luminance = greyscale.x * means[0][i] + greyscale.y * means[1][i] + greyscale.z * means[2][i];
+            double variance = std::max(means[3][i] - luminance * luminance, 0.0);
+            keep = variance / (variance + (double)stage.box_noise * stage.box_noise);
+        }
+        for (GLuint c = 0; c < 3; c++)
+            output->planes[c][i] = means[c][i] + keep * (input.planes[c][i] - means[c][i]);
+    }
+}
+
+// ranks found by sorting each pixel's window
+static void RankReference(const ImageBuffer &input, const FilterStage &stage, ImageBuffer *output)
+{
+    GLint width = input.width, height = input.height, radius = stage.rank_radius;
+    vector<GLushort> levels[3];
+    QuantizeLevels(input, levels);
+    GLfloat top = (GLfloat)((1 << input.depth) - 1);
+    output->resize(width, height);
+    GLuint rank = RankIndex(stage);
+    vector<GLushort> window;
+    for (GLuint c = 0; c < 3; c++)
+        for (GLint y = 0; y < height; y++)
+            for (GLint x = 0; x < width; x++)
+            {
+                window.clear();
+                for (GLint j = -radius; j <= radius; j++)
+                    for (GLint i = -radius; i <= radius; i++)
+                        window.push_back(levels[c][std::min(std::max(y + j, 0), height - 1) * width +
+                                                   std::min(std::max(x + i, 0), width - 1)]);
+                std::nth_element(window.begin(), window.begin() + rank, window.end());
+                output->row(c, y)[x] = window[rank] / top;
+            }
+}
+
+void RunStageReference(const ImageBuffer &original, const FilterStage &stage, ImageBuffer *output)
+{
+    ImageBuffer smoothed;
+    if (stage.recursive_sigma > 0)
+        GaussianReference(original, stage.recursive_sigma, &smoothed);
+    else if (stage.boxed())
+        BoxReference(original, stage, &smoothed);
+    else if (stage.rank_radius > 0)
+        RankReference(original, stage, &smoothed);
+    const ImageBuffer &input = stage.recursive_sigma > 0 || stage.boxed() || stage.rank_radius > 0 ? smoothed : original;
+
+    GLint width = input.width, height = input.height;
+    output->resize(width, height);
+    for (GLint y = 0; y < height; y++)
+        for (GLint x = 0; x < width; x++)
+        {
+            glm::vec3 sum(0);
+            for (GLint i = 0; i < stage.taps; i++)
+            {
+                // bilinear between the four texels around the tap, clamped
+                GLfloat u = x + stage.offsets[i].x, v = y + stage.offsets[i].y;
+                GLint x0 = (GLint)floor(u), y0 = (GLint)floor(v);
+                GLfloat fx = u - x0, fy = v - y0;
+                GLint xa = std::min(std::max(x0, 0), width - 1), xb = std::min(std::max(x0 + 1, 0), width - 1);
+                GLint ya = std::min(std::max(y0, 0), height - 1), yb = std::min(std::max(y0 + 1, 0), height - 1);
+                for (GLuint c = 0; c < 3; c++)
+                {
+                    GLfloat top = input.row(c, ya)[xa] * (1 - fx) + input.row(c, ya)[xb] * fx;
+                    GLfloat bottom = input.row(c, yb)[xa] * (1 - fx) + input.row(c, yb)[xb] * fx;
+                    sum[c] += (top * (1 - fy) + bottom * fy) * stage.weights[i];
+                }
+            }
+            sum = sum * stage.pre;
+            if (stage.absolute)
+                sum = glm::vec3(fabsf(sum.x), fabsf(sum.y), fabsf(sum.z));
+            sum = sum * stage.post;
+            for (GLuint c = 0; c < 3; c++)
+                output->row(c, y)[x] = sum[c];
+        }
+    output->depth = original.depth;
+}
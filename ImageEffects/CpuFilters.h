@@ -0,0 +1,75 @@
+// ==========================================================================
+// CPU Filters
+//  - runs compiled filter stages on the CPU, for machines without a GPU
+//
+// Author:  Matthew Sembinelli, University of Calgary
+// Date:    October 18, 2026
+// ==========================================================================
+#ifndef CPUFILTERS_H
+#define CPUFILTERS_H
+
+#include <string>
+#include <vector>
+
+#include "Filters.h"
+
+using namespace std;
+
+// Pixels per row segment a thread filters at once, sized so the segment's
+// sums stay in the first level cache
+#define CPU_SEGMENT 512
+
+// Rows a thread takes from the image at a time
+#define CPU_STRIP 16
+
+// Columns a recursive gaussian copies out as rows at a time, so the column
+// pass runs along contiguous memory
+#define CPU_COLUMN_TILE 32
+
+// Column histograms a thread keeps for 16 bit rank filters, about 40MB.
+// Tiles are this wide less the window either side; 8 bit histograms are
+// small enough to take whole rows.
+#define CPU_RANK_COLUMNS 640
+
+// RGB image as three float planes, rows top to bottom, 0 to 1 per channel
+struct ImageBuffer
+{
+    GLuint  width, height;
+    // bits per channel of the file it came from, 8 or 16, which rank
+    // filters count levels in and which it is written back with
+    GLuint  depth;
+    vector<GLfloat> planes[3];
+
+    ImageBuffer() : width(0), height(0), depth(8)
+    {}
+    void resize(GLuint width_, GLuint height_);
+    GLfloat *row(GLuint channel, GLuint y) { return &planes[channel][y * width]; }
+    const GLfloat *row(GLuint channel, GLuint y) const { return &planes[channel][y * width]; }
+};
+
+// decode or encode through Magick++, channels as floats so 16 bit images
+// keep their depth
+bool ReadImage(const string &filename, ImageBuffer *image);
+bool WriteImage(const string &filename, const ImageBuffer &image);
+
+// interleaved RGB, 8 bits or floats per channel
+void ImportPixels(ImageBuffer *image, const unsigned char *rgb, GLuint width, GLuint height);
+void ImportPixels(ImageBuffer *image, const GLfloat *rgb, GLuint width, GLuint height);
+void ExportPixels(const ImageBuffer &image, unsigned char *rgb);
+void ExportPixels(const ImageBuffer &image, GLfloat *rgb);
+
+// Runs a stage the way fragment.glsl does, edges clamped and fractional
+// taps split between their texels as linear filtering would. Strips of rows
+// go to every core, and taps are summed along rows with AVX2 or NEON where
+// the compiler targets them. A recursive stage blurs with Deriche's
+// recursive gaussian first, a box stage averages through a summed
+// area table built with a parallel prefix sum, and a rank stage picks from
+// Perreault and Hebert's column histograms, each at the same cost for any
+// size.
+void RunStage(const ImageBuffer &input, const FilterStage &stage, ImageBuffer *output);
+void RunFilters(const ImageBuffer &input, const vector<FilterStage> &stages, ImageBuffer *output);
+
+// samples every tap of every pixel one at a time, as a check on RunStage
+void RunStageReference(const ImageBuffer &input, const FilterStage &stage, ImageBuffer *output);
+
+#endif
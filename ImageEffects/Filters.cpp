@@ -0,0 +1,293 @@
+// ==========================================================================
+// Filter Chains
+//
+// Author:  Matthew Sembinelli, University of Calgary
+// Date:    October 18, 2026
+// ==========================================================================
+#include "Filters.h"
+
+#include <iostream>
+#include <fstream>
+#include <math.h>
+
+// 3x3 kernels in tap order, row by row from the top left
+static const GLfloat kernels[FILTERTYPE_MAX][9] = {
+		{0, 0, 0, 0, 1, 0, 0, 0, 0},
+		{1, 0, -1, 2, 0, -2, 1, 0, -1},
+		{1, 2, 1, 0, 0, 0, -1, -2, -1},
+		{0, -1, 0, -1, 5, -1, 0, -1, 0}
+};
+
+const glm::vec3 greyscale = glm::vec3(0.222, 0.715, 0.072);
+
+glm::mat3 ColourMatrix(ColourType type)
+{
+    glm::vec3 grey;
+    switch (type)
+    {
+        case GREYSCALE_1:
+            grey = glm::vec3(0.333, 0.333, 0.333);
+            return glm::mat3(grey, grey, grey);
+        case GREYSCALE_2:
+            grey = glm::vec3(0.299, 0.587, 0.114);
+            return glm::mat3(grey, grey, grey);
+        case GREYSCALE_3:
+            grey = glm::vec3(0.222, 0.715, 0.072);
+            return glm::mat3(grey, grey, grey);
+        case SEPIA:
+            return glm::mat3(glm::vec3(0.393, 0.769, 0.189), glm::vec3(0.349, 0.686, 0.168), glm::vec3(0.272, 0.534, 0.131));
+        default:
+            return glm::mat3(1.0);
+    }
+}
+
+FilterStage::FilterStage() : pre(1.0), post(1.0), taps(1), absolute(false), recursive_sigma(0),
+                             box_from(0), box_to(0), box_noise(0), rank_radius(0), rank_percentile(0)
+{
+    offsets[0] = glm::vec2(0);
+    weights[0] = 1;
+}
+
+bool FilterStage::pointwise() const
+{
+    return taps == 1 && offsets[0] == glm::vec2(0) && !absolute && recursive_sigma == 0 && !boxed() &&
+           rank_radius == 0;
+}
+
+bool FilterStage::operator==(const FilterStage &other) const
+{
+    if (pre != other.pre || post != other.post || taps != other.taps || absolute != other.absolute ||
+        recursive_sigma != other.recursive_sigma || box_from != other.box_from || box_to != other.box_to ||
+        box_noise != other.box_noise || rank_radius != other.rank_radius || rank_percentile != other.rank_percentile)
+        return false;
+    for (GLint i = 0; i < taps; i++)
+    {
+        if (offsets[i] != other.offsets[i] || weights[i] != other.weights[i])
+            return false;
+    }
+    return true;
+}
+
+glm::ivec4 SummedAreaTexel(glm::vec3 colour)
+{
+    colour = glm::clamp(colour, -(GLfloat)SUMMED_AREA_LIMIT, (GLfloat)SUMMED_AREA_LIMIT);
+    GLfloat luminance = glm::dot(colour, greyscale);
+    glm::vec4 texel(colour, glm::min(luminance * luminance, (GLfloat)SUMMED_AREA_LIMIT));
+    return glm::ivec4(glm::round(texel * (GLfloat)SUMMED_AREA_SCALE));
+}
+
+GLfloat DefaultSigma(GaussianType type)
+{
+    // the small sizes step sigma up slowly, larger ones reach about two
+    // sigma out
+    switch (type)
+    {
+        case GAUSSIAN_3X3:  return 2.0;
+        case GAUSSIAN_5X5:  return 2.22;
+        case GAUSSIAN_7X7:  return 2.44;
+        default:            return (type - 1) / 4.0;
+    }
+}
+
+GLint GaussianSize(GLfloat sigma)
+{
+    return 2 * (GLint)ceil(3 * sigma) + 1;
+}
+
+// fill kernel with the normalized 1D weights of an n point gaussian. The
+// centre tap stands alone and each following pair of texels i, i + 1 becomes
+// one tap at their weighted mean offset, carrying both weights.
+void BuildGaussianKernel(GaussianKernel *kernel, GLint size, GLfloat sigma)
+{
+    GLint radius = (size - 1) / 2;
+    vector<GLfloat> weights(radius + 1);
+    GLfloat weight_sum = 0;
+    for (GLint i = 0; i <= radius; i++)
+    {
+        weights[i] = exp(-0.5 * (i / sigma) * (i / sigma));
+        weight_sum += i == 0 ? weights[i] : 2 * weights[i];
+    }
+
+    kernel->size = size;
+    kernel->sigma = sigma;
+    kernel->weights[0] = weights[0] / weight_sum;
+    kernel->offsets[0] = 0;
+    kernel->taps = 1;
+    for (GLint i = 1; i <= radius; i += 2)
+    {
+        GLfloat near_weight = weights[i];
+        GLfloat far_weight = i < radius ? weights[i + 1] : 0;
+        kernel->weights[kernel->taps] = (near_weight + far_weight) / weight_sum;
+        kernel->offsets[kernel->taps] = (i * near_weight + (i + 1) * far_weight) / (near_weight + far_weight);
+        kernel->taps++;
+    }
+}
+
+// a size x size kernel centred on the pixel, weights row by row
+static FilterStage KernelStage(const GLfloat *weights, GLint size)
+{
+    FilterStage stage;
+    GLint radius = size / 2;
+    stage.taps = size * size;
+    for (GLint i = 0; i < stage.taps; i++)
+    {
+        stage.offsets[i] = glm::vec2(i % size - radius, i / size - radius);
+        stage.weights[i] = weights[i];
+    }
+    return stage;
+}
+
+// a gaussian pass along direction, its merged taps mirrored either side
+static FilterStage GaussianStage(const GaussianKernel &kernel, glm::vec2 direction)
+{
+    FilterStage stage;
+    stage.taps = 1;
+    stage.weights[0] = kernel.weights[0];
+    for (GLint i = 1; i < kernel.taps; i++)
+    {
+        stage.offsets[stage.taps] = direction * kernel.offsets[i];
+        stage.weights[stage.taps++] = kernel.weights[i];
+        stage.offsets[stage.taps] = -direction * kernel.offsets[i];
+        stage.weights[stage.taps++] = kernel.weights[i];
+    }
+    return stage;
+}
+
+// the stages of one pass before any fusing
+static void ExpandPass(const FilterPass &pass, vector<FilterStage> *stages)
+{
+    if (pass.colour != glm::mat3(1.0))
+    {
+        FilterStage colour;
+        colour.pre = pass.colour;
+        stages->push_back(colour);
+    }
+
+    switch (pass.type)
+    {
+        case VERTICAL_SOBEL:
+        case HORIZONTAL_SOBEL:
+            stages->push_back(KernelStage(kernels[pass.type], 3));
+            stages->back().pre = glm::mat3(greyscale, greyscale, greyscale);
+            stages->back().absolute = true;
+            break;
+        case UNSHARP_MASK:
+            stages->push_back(KernelStage(kernels[pass.type], 3));
+            break;
+        case GAUSSIAN:
+            if (pass.gaussian / 2 > RECURSIVE_GAUSSIAN_RADIUS)
+            {
+                FilterStage stage;
+                stage.recursive_sigma = pass.sigma;
+                stages->push_back(stage);
+            }
+            else if (pass.gaussian > 1)
+            {
+                GaussianKernel kernel;
+                BuildGaussianKernel(&kernel, pass.gaussian, pass.sigma);
+                stages->push_back(GaussianStage(kernel, glm::vec2(1, 0)));
+                stages->push_back(GaussianStage(kernel, glm::vec2(0, 1)));
+            }
+            break;
+        case USER_KERNEL:
+            if (pass.size > 0)
+                stages->push_back(KernelStage(&pass.kernel[0], pass.size));
+            break;
+        case BOX:
+        case ADAPTIVE_MEAN:
+            if (pass.radius > 0)
+            {
+                FilterStage stage;
+                stage.box_from = -pass.radius;
+                stage.box_to = pass.radius;
+                if (pass.type == ADAPTIVE_MEAN)
+                    stage.box_noise = ADAPTIVE_MEAN_NOISE;
+                stages->push_back(stage);
+            }
+            break;
+        case TENT:
+            if (pass.radius > 0)
+            {
+                // Two boxes radius + 1 wide make a tent. An even box reaches
+                // one pixel further after than before, so the second reaches
+                // the other way and the tent stays centred.
+                GLint size = pass.radius + 1;
+                FilterStage stage;
+                stage.box_from = -(size - 1) / 2;
+                stage.box_to = size / 2;
+                stages->push_back(stage);
+                stage.box_from = -size / 2;
+                stage.box_to = (size - 1) / 2;
+                stages->push_back(stage);
+            }
+            break;
+        case MEDIAN:
+            if (pass.radius > 0)
+            {
+                FilterStage stage;
+                stage.rank_radius = pass.radius;
+                stage.rank_percentile = pass.percentile;
+                stages->push_back(stage);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+vector<FilterStage> CompileFilters(const vector<FilterPass> &passes)
+{
+    vector<FilterStage> expanded;
+    for (GLuint i = 0; i < passes.size(); i++)
+        ExpandPass(passes[i], &expanded);
+
+    vector<FilterStage> stages;
+    for (GLuint i = 0; i < expanded.size(); i++)
+    {
+        FilterStage stage = expanded[i];
+        if (!stages.empty() && stage.pointwise())
+        {
+            // map the previous stage's output through this one
+            stages.back().post = stages.back().post * stage.pre * stage.weights[0] * stage.post;
+            continue;
+        }
+        if (!stages.empty() && stages.back().pointwise() && stage.linear())
+        {
+            // read every tap of this stage through the previous one
+            const FilterStage &previous = stages.back();
+            stage.pre = previous.pre * previous.weights[0] * previous.post * stage.pre;
+            stages.back() = stage;
+            continue;
+        }
+        stages.push_back(stage);
+    }
+    return stages;
+}
+
+bool LoadKernel(const string &filename, FilterPass *pass)
+{
+    ifstream input(filename.c_str());
+    if (!input)
+    {
+        cout << "ERROR: Could not open kernel file " << filename << endl;
+        return false;
+    }
+
+    vector<GLfloat> weights;
+    GLfloat weight;
+    while (input >> weight)
+        weights.push_back(weight);
+
+    GLint size = (GLint)(sqrt((double)weights.size()) + 0.5);
+    if (weights.empty() || size * size != (GLint)weights.size() || size % 2 == 0 || size > USER_KERNEL_MAX_SIZE)
+    {
+        cout << "ERROR: Kernel file " << filename << " must hold an odd sized square kernel, at most "
+             << USER_KERNEL_MAX_SIZE << "x" << USER_KERNEL_MAX_SIZE << endl;
+        return false;
+    }
+
+    pass->type = USER_KERNEL;
+    pass->size = size;
+    pass->kernel = weights;
+    return true;
+}
@@ -0,0 +1,192 @@
+// ==========================================================================
+// Filter Chains
+//  - describes filters as an ordered list of passes and compiles them into
+//    the stages the filter shader runs, one draw each
+//
+// Author:  Matthew Sembinelli, University of Calgary
+// Date:    October 18, 2026
+// ==========================================================================
+#ifndef FILTERS_H
+#define FILTERS_H
+
+#include <string>
+#include <vector>
+
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+using namespace std;
+
+// must match the array sizes in fragment.glsl
+#define FILTER_MAX_TAPS 32
+
+// largest user kernel, its taps have to fit in one stage
+#define USER_KERNEL_MAX_SIZE 5
+
+// Gaussians reaching further than this many texels become one recursive
+// stage, whose cost does not grow with sigma. Their taps would not fit a
+// stage, so only the CPU engine runs them.
+#define RECURSIVE_GAUSSIAN_RADIUS 15
+
+// largest sigma a gaussian takes. Past it the recursive gaussian's poles
+// sit so near one that rounding shows, and wider blurs leave little of an
+// image anyway.
+#define GAUSSIAN_MAX_SIGMA 2000
+
+// largest radius of the box, tent and adaptive mean filters. Boxes up to
+// 511 wide keep the GPU's 32 bit summed area tables exact.
+#define SMOOTH_MAX_RADIUS 255
+
+// The window's summed area tables hold texels in steps of 1/4096, colour
+// clamped to +-2 and squared luminance to 2, so a box of SMOOTH_MAX_RADIUS
+// sums to at most 511 * 511 * 2 * 4096 = 2139103232 and fits an int.
+// Must match summed_area.glsl and fragment.glsl.
+#define SUMMED_AREA_SCALE 4096
+#define SUMMED_AREA_LIMIT 2
+
+// deviation of the noise an adaptive mean smooths away, larger differences
+// are kept as edges
+#define ADAPTIVE_MEAN_NOISE 0.05f
+
+// largest radius of the median and rank filters, whose windows' counts then
+// fit in 16 bits. Only the CPU engine runs them.
+#define RANK_MAX_RADIUS 127
+
+enum FilterType
+{
+    NO_FILTER,
+	VERTICAL_SOBEL,
+	HORIZONTAL_SOBEL,
+	UNSHARP_MASK,
+	GAUSSIAN,
+	USER_KERNEL,
+	BOX,
+	TENT,
+	ADAPTIVE_MEAN,
+	MEDIAN,
+	FILTERTYPE_MAX
+};
+
+// the colour matrices behind F1 to F5
+enum ColourType
+{
+    NORMAL_COLOUR,
+	GREYSCALE_1,
+	GREYSCALE_2,
+	GREYSCALE_3,
+	SEPIA,
+	COLOURTYPE_MAX
+};
+
+enum GaussianType
+{
+    NO_GAUSSIAN = 0,
+	GAUSSIAN_3X3 = 3,
+	GAUSSIAN_5X5 = 5,
+	GAUSSIAN_7X7 = 7,
+	GAUSSIAN_15X15 = 15,
+	GAUSSIAN_31X31 = 31,
+	GAUSSIAN_MAX
+};
+
+// One dimension of a separable gaussian, applied once across and once down.
+// Neighbouring texel pairs are merged into a single tap placed between them,
+// so linear filtering fetches their weighted sum at once.
+struct GaussianKernel
+{
+    GLint size;
+    GLfloat sigma;
+    GLint taps;
+    GLfloat weights[FILTER_MAX_TAPS];
+    GLfloat offsets[FILTER_MAX_TAPS];
+
+    GaussianKernel() : size(0), sigma(0), taps(0)
+    {}
+};
+
+// One step of a chain: the colour matrix, then the filter. NO_FILTER passes
+// only apply their colour.
+struct FilterPass
+{
+    FilterType type;
+    glm::mat3 colour;
+    // points across the gaussian, one of GaussianType's sizes in the viewer
+    // but any odd number here
+    GLint gaussian;
+    GLfloat sigma;
+    // size x size weights, row by row, for USER_KERNEL
+    GLint size;
+    vector<GLfloat> kernel;
+    // reach either side of BOX, TENT and ADAPTIVE_MEAN, any size up to
+    // SMOOTH_MAX_RADIUS, or of MEDIAN up to RANK_MAX_RADIUS
+    GLint radius;
+    // of the window MEDIAN picks, 50 for the median itself
+    GLfloat percentile;
+
+    FilterPass() : type(NO_FILTER), colour(1.0), gaussian(NO_GAUSSIAN), sigma(0), size(0), radius(0),
+                   percentile(50)
+    {}
+};
+
+// One draw of the filter shader. Taps are weighted and summed, the sum goes
+// through pre, is made absolute if asked, then goes through post. Colours
+// are row vectors, so a colour c becomes c * pre.
+struct FilterStage
+{
+    glm::mat3 pre;
+    glm::mat3 post;
+    GLint taps;
+    glm::vec2 offsets[FILTER_MAX_TAPS];
+    GLfloat weights[FILTER_MAX_TAPS];
+    bool absolute;
+    // above zero, the taps read the input blurred by a recursive gaussian
+    // of this sigma
+    GLfloat recursive_sigma;
+    // Past box_from, the taps read the mean of the input over the square
+    // from box_from to box_to pixels around them, found from a summed area
+    // table in four fetches whatever its size.
+    GLint box_from, box_to;
+    // above zero, pixels move toward that mean only as far as the box's
+    // luminance varies like noise of this deviation, so edges are kept
+    GLfloat box_noise;
+    // above zero, the taps read each channel's rank_percentile over the
+    // square rank_radius either side, as levels of the image's depth
+    GLint rank_radius;
+    GLfloat rank_percentile;
+
+    FilterStage();
+    // a lone centre tap, which maps each pixel on its own
+    bool pointwise() const;
+    bool boxed() const { return box_to > box_from; }
+    // linear up to pre, so a colour matrix before it can fold into pre
+    bool linear() const { return box_noise == 0 && rank_radius == 0; }
+    bool operator==(const FilterStage &other) const;
+    bool operator!=(const FilterStage &other) const { return !(*this == other); }
+};
+
+// luminance weights, which the sobel filters and adaptive means measure
+// edges by
+extern const glm::vec3 greyscale;
+
+glm::mat3 ColourMatrix(ColourType type);
+
+// a texel of the window's summed area table as summed_area.glsl stores it,
+// colour and squared luminance in fixed point
+glm::ivec4 SummedAreaTexel(glm::vec3 colour);
+
+// the sigma G picks for each size
+GLfloat DefaultSigma(GaussianType type);
+
+void BuildGaussianKernel(GaussianKernel *kernel, GLint size, GLfloat sigma);
+
+// the odd size reaching three sigma either side
+GLint GaussianSize(GLfloat sigma);
+
+// Turns passes into stages, fusing a pointwise stage into its neighbour so
+// a colour matrix costs no draw of its own
+vector<FilterStage> CompileFilters(const vector<FilterPass> &passes);
+
+// reads an odd sized square kernel of whitespace separated weights
+bool LoadKernel(const string &filename, FilterPass *pass);
+
+#endif
@@ -0,0 +1,443 @@
+// ==========================================================================
+// CPU Effects
+//  - the ImageEffects filters without a window or GPU
+//
+// Author:  Matthew Sembinelli, University of Calgary
+// Date:    October 18, 2026
+// ==========================================================================
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include <Magick++.h>
+
+#include "Batch.h"
+#include "CpuFilters.h"
+
+using namespace std;
+
+struct NamedFilter
+{
+    string name;
+    FilterPass pass;
+};
+
+// every filter the viewer offers, as single passes
+vector<NamedFilter> BuiltinFilters()
+{
+    const char *colour_names[COLOURTYPE_MAX] = { "normal", "greyscale1", "greyscale2", "greyscale3", "sepia" };
+    vector<NamedFilter> filters;
+    for (GLuint i = 0; i < COLOURTYPE_MAX; i++)
+    {
+        NamedFilter filter;
+        filter.name = colour_names[i];
+        filter.pass.colour = ColourMatrix((ColourType)i);
+        filters.push_back(filter);
+    }
+
+    const char *kernel_names[] = { "vertical-sobel", "horizontal-sobel", "unsharp" };
+    for (GLuint i = VERTICAL_SOBEL; i <= UNSHARP_MASK; i++)
+    {
+        NamedFilter filter;
+        filter.name = kernel_names[i - VERTICAL_SOBEL];
+        filter.pass.type = (FilterType)i;
+        filters.push_back(filter);
+    }
+
+    const GaussianType sizes[] = { GAUSSIAN_3X3, GAUSSIAN_5X5, GAUSSIAN_7X7, GAUSSIAN_15X15, GAUSSIAN_31X31 };
+    for (GLuint i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        NamedFilter filter;
+        filter.name = "gaussian" + to_string(sizes[i]);
+        filter.pass.type = GAUSSIAN;
+        filter.pass.gaussian = sizes[i];
+        filter.pass.sigma = DefaultSigma(sizes[i]);
+        filters.push_back(filter);
+    }
+    return filters;
+}
+
+// a gaussian of any sigma, with taps while they stay few and the recursive
+// gaussian past that
+FilterPass SigmaGaussian(GLfloat sigma)
+{
+    FilterPass pass;
+    pass.type = GAUSSIAN;
+    pass.sigma = sigma;
+    pass.gaussian = GaussianSize(sigma);
+    return pass;
+}
+
+// a box, tent, adaptive mean or median reaching radius either side
+FilterPass SmoothPass(FilterType type, GLint radius)
+{
+    FilterPass pass;
+    pass.type = type;
+    pass.radius = radius;
+    return pass;
+}
+
+// filters named with their size, gaussian:sigma, box:radius or
+// rank:radius:percentile say, false if name is not one
+bool ParseSized(const string &name, FilterPass *pass, bool *valid)
+{
+    const char *kinds[] = { "box", "tent", "adaptive" };
+    const FilterType types[] = { BOX, TENT, ADAPTIVE_MEAN };
+    size_t colon = name.find(':');
+    if (colon == string::npos)
+        return false;
+    string kind = name.substr(0, colon);
+    const char *value = name.c_str() + colon + 1;
+
+    if (kind == "gaussian")
+    {
+        GLfloat sigma = atof(value);
+        *valid = sigma > 0 && sigma <= GAUSSIAN_MAX_SIGMA;
+        if (!*valid)
+            cout << "ERROR: Bad gaussian sigma \"" << value << "\", choose one above 0 and up to " << GAUSSIAN_MAX_SIGMA << endl;
+        *pass = SigmaGaussian(sigma);
+        return true;
+    }
+    if (kind == "median" || kind == "rank")
+    {
+        GLint radius = atoi(value);
+        const char *percentile = strchr(value, ':');
+        *pass = SmoothPass(MEDIAN, radius);
+        if (kind == "rank")
+            pass->percentile = percentile ? atof(percentile + 1) : -1;
+        *valid = radius > 0 && radius <= RANK_MAX_RADIUS && pass->percentile >= 0 && pass->percentile <= 100;
+        if (!*valid)
+            cout << "ERROR: Bad " << kind << " \"" << value << "\", choose a radius of 1 to " << RANK_MAX_RADIUS
+                 << (kind == "rank" ? " and a percentile of 0 to 100" : "") << endl;
+        return true;
+    }
+    for (GLuint i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++)
+    {
+        if (kind != kinds[i])
+            continue;
+        GLint radius = atoi(value);
+        *valid = radius > 0 && radius <= SMOOTH_MAX_RADIUS;
+        if (!*valid)
+            cout << "ERROR: Bad " << kind << " radius \"" << value << "\", choose 1 to " << SMOOTH_MAX_RADIUS << endl;
+        *pass = SmoothPass(types[i], radius);
+        return true;
+    }
+    return false;
+}
+
+// turns a comma separated list of filter names, kernel:file for a user
+// kernel, gaussian:sigma, box, tent, adaptive or median:radius or
+// rank:radius:percentile, into passes applied in that order
+bool ParseChain(const string &chain, vector<FilterPass> *passes)
+{
+    vector<NamedFilter> filters = BuiltinFilters();
+    size_t start = 0;
+    while (start <= chain.size())
+    {
+        size_t end = chain.find(',', start);
+        if (end == string::npos)
+            end = chain.size();
+        string name = chain.substr(start, end - start);
+        start = end + 1;
+
+        if (name.compare(0, 7, "kernel:") == 0)
+        {
+            FilterPass pass;
+            if (!LoadKernel(name.substr(7), &pass))
+                return false;
+            passes->push_back(pass);
+            continue;
+        }
+        FilterPass pass;
+        bool valid;
+        if (ParseSized(name, &pass, &valid))
+        {
+            if (!valid)
+                return false;
+            passes->push_back(pass);
+            continue;
+        }
+
+        GLuint i = 0;
+        while (i < filters.size() && filters[i].name != name)
+            i++;
+        if (i == filters.size())
+        {
+            cout << "ERROR: Unknown filter \"" << name << "\", choose from";
+            for (i = 0; i < filters.size(); i++)
+                cout << " " << filters[i].name;
+            cout << " or kernel:file, gaussian:sigma, box:radius, tent:radius, adaptive:radius," << endl;
+            cout << "median:radius, rank:radius:percentile" << endl;
+            return false;
+        }
+        passes->push_back(filters[i].pass);
+    }
+    return true;
+}
+
+// largest channel difference between two images of the same size
+GLfloat MaxDifference(const ImageBuffer &a, const ImageBuffer &b)
+{
+    GLfloat difference = 0;
+    for (GLuint c = 0; c < 3; c++)
+        for (GLuint i = 0; i < a.planes[c].size(); i++)
+            difference = max(difference, fabsf(a.planes[c][i] - b.planes[c][i]));
+    return difference;
+}
+
+// the top left corner of an image, at most size pixels square
+ImageBuffer Corner(const ImageBuffer &image, GLuint size)
+{
+    ImageBuffer corner;
+    corner.resize(min(size, image.width), min(size, image.height));
+    corner.depth = image.depth;
+    for (GLuint c = 0; c < 3; c++)
+        for (GLuint y = 0; y < corner.height; y++)
+            for (GLuint x = 0; x < corner.width; x++)
+                corner.planes[c][y * corner.width + x] = image.planes[c][y * image.width + x];
+    return corner;
+}
+
+// prints the best time of a filter on an image and how far it is from
+// sampling every tap one pixel at a time. Rank filters are checked on a
+// corner of the image, as sorting every window of it takes too long.
+void BenchmarkFilter(const string &name, const ImageBuffer &image, const FilterPass &pass, GLuint runs)
+{
+    vector<FilterPass> passes(1, pass);
+    vector<FilterStage> stages = CompileFilters(passes);
+
+    ImageBuffer result;
+    GLdouble best = 1E30;
+    for (GLuint run = 0; run < runs; run++)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        RunFilters(image, stages, &result);
+        best = min(best, chrono::duration<GLdouble>(chrono::steady_clock::now() - start).count());
+    }
+
+    bool ranked = false;
+    for (GLuint j = 0; j < stages.size(); j++)
+        ranked = ranked || stages[j].rank_radius > 0;
+    ImageBuffer reference = ranked ? Corner(image, 64) : image, next;
+    if (ranked)
+        RunFilters(reference, stages, &result);
+    for (GLuint j = 0; j < stages.size(); j++)
+    {
+        RunStageReference(reference, stages[j], &next);
+        reference.planes[0].swap(next.planes[0]);
+        reference.planes[1].swap(next.planes[1]);
+        reference.planes[2].swap(next.planes[2]);
+    }
+
+    GLdouble megapixels = image.width * image.height / 1e6;
+    cout << left << setw(18) << name << right << fixed
+         << setw(9) << setprecision(2) << best * 1000 << " ms "
+         << setw(9) << setprecision(1) << megapixels / best << " MP/s "
+         << " max error " << scientific << setprecision(1) << MaxDifference(result, reference) << endl;
+}
+
+// builds the window's summed area table for the widest box the way
+// summed_area.glsl does, in 32 bit sums that wrap, and checks that four
+// fetches still give every box of the image its true sum
+bool CheckSummedArea(const string &name, const ImageBuffer &image)
+{
+    const GLint size = 2 * SMOOTH_MAX_RADIUS + 1;
+    GLint table_width = image.width + size, table_height = image.height + size;
+    vector<uint32_t> wrapped[4];
+    vector<int64_t> exact[4];
+    for (GLuint c = 0; c < 4; c++)
+    {
+        wrapped[c].assign(table_width * table_height, 0);
+        exact[c].assign(table_width * table_height, 0);
+    }
+    for (GLint y = 1; y < table_height; y++)
+        for (GLint x = 1; x < table_width; x++)
+        {
+            GLint source_x = min(max(x - 1 - SMOOTH_MAX_RADIUS, 0), (GLint)image.width - 1);
+            GLint source_y = min(max(y - 1 - SMOOTH_MAX_RADIUS, 0), (GLint)image.height - 1);
+            glm::ivec4 texel = SummedAreaTexel(glm::vec3(image.row(0, source_y)[source_x],
+                                                         image.row(1, source_y)[source_x],
+                                                         image.row(2, source_y)[source_x]));
+            GLint at = y * table_width + x;
+            for (GLuint c = 0; c < 4; c++)
+            {
+                wrapped[c][at] = (uint32_t)texel[c] + wrapped[c][at - 1] + wrapped[c][at - table_width] -
+                                 wrapped[c][at - table_width - 1];
+                exact[c][at] = texel[c] + exact[c][at - 1] + exact[c][at - table_width] - exact[c][at - table_width - 1];
+            }
+        }
+
+    GLuint bad = 0;
+    for (GLint y = 0; y < (GLint)image.height; y++)
+        for (GLint x = 0; x < (GLint)image.width; x++)
+            for (GLuint c = 0; c < 4; c++)
+            {
+                GLint low = y * table_width + x, high = low + size * table_width + size;
+                uint32_t sum = wrapped[c][high] - wrapped[c][high - size] - wrapped[c][low + size] + wrapped[c][low];
+                int64_t truth = exact[c][high] - exact[c][high - size] - exact[c][low + size] + exact[c][low];
+                bad += (int32_t)sum != truth;
+            }
+
+    cout << left << setw(18) << name << right;
+    if (bad == 0)
+        cout << " window's box:" << SMOOTH_MAX_RADIUS << " sums exact" << endl;
+    else
+        cout << " ERROR: window's box:" << SMOOTH_MAX_RADIUS << " sums wrap in " << bad << " places" << endl;
+    return bad == 0;
+}
+
+// times every built in filter on an image, with wide gaussians that run
+// recursively, small and large summed area and median filters, and medians
+// up to the largest radius at 8 and 16 bits, best of runs. Fails if the
+// window's summed area tables would wrap at the widest box.
+int Benchmark(const string &filename, GLuint runs)
+{
+    ImageBuffer image;
+    if (!ReadImage(filename, &image))
+        return -1;
+    cout << "Benchmarking " << filename << " (" << image.width << "x" << image.height << "), best of " << runs << " runs" << endl;
+#if defined(__AVX2__)
+    cout << "Rows summed with AVX2" << endl;
+#elif defined(__ARM_NEON)
+    cout << "Rows summed with NEON" << endl;
+#else
+    cout << "Rows summed with scalar code" << endl;
+#endif
+
+    vector<NamedFilter> filters = BuiltinFilters();
+    const GLfloat sigmas[] = { 20, 50 };
+    for (GLuint i = 0; i < sizeof(sigmas) / sizeof(sigmas[0]); i++)
+    {
+        NamedFilter filter;
+        filter.name = "gaussian:" + to_string((GLint)sigmas[i]);
+        filter.pass = SigmaGaussian(sigmas[i]);
+        filters.push_back(filter);
+    }
+    const char *smooth_names[] = { "box:", "tent:", "adaptive:", "median:" };
+    const FilterType smooth_types[] = { BOX, TENT, ADAPTIVE_MEAN, MEDIAN };
+    const GLint radii[] = { 2, 64 };
+    for (GLuint i = 0; i < sizeof(smooth_types) / sizeof(smooth_types[0]); i++)
+        for (GLuint j = 0; j < sizeof(radii) / sizeof(radii[0]); j++)
+        {
+            NamedFilter filter;
+            filter.name = smooth_names[i] + to_string(radii[j]);
+            filter.pass = SmoothPass(smooth_types[i], radii[j]);
+            filters.push_back(filter);
+        }
+    for (GLuint i = 0; i < filters.size(); i++)
+        BenchmarkFilter(filters[i].name, image, filters[i].pass, runs);
+
+    // the same image counted at either depth, as medians should take the
+    // same time at any radius
+    const GLint rank_radii[] = { 1, 64, RANK_MAX_RADIUS };
+    const GLuint depths[] = { 8, 16 };
+    for (GLuint i = 0; i < sizeof(depths) / sizeof(depths[0]); i++)
+    {
+        ImageBuffer deep = image;
+        deep.depth = depths[i];
+        for (GLuint j = 0; j < sizeof(rank_radii) / sizeof(rank_radii[0]); j++)
+            BenchmarkFilter("median:" + to_string(rank_radii[j]) + " " + to_string(depths[i]) + " bit", deep,
+                            SmoothPass(MEDIAN, rank_radii[j]), runs);
+    }
+
+    // the window's tables at the widest box, over the image and over the
+    // brightest and darkest texels they hold, where the sums are largest
+    bool exact = CheckSummedArea("summed area", image);
+    const GLfloat extremes[] = { 1E6, -1E6 };
+    for (GLuint i = 0; i < sizeof(extremes) / sizeof(extremes[0]); i++)
+    {
+        ImageBuffer flat;
+        flat.resize(64, 64);
+        for (GLuint c = 0; c < 3; c++)
+            flat.planes[c].assign(flat.planes[c].size(), extremes[i]);
+        exact = CheckSummedArea(i == 0 ? "  brightest" : "  darkest", flat) && exact;
+    }
+    return exact ? 0 : -1;
+}
+
+void Usage()
+{
+    cout << "Usage: CpuEffects [--jobs n] [--queue n] [--format ext] <filters> <output directory> <inputs...>" << endl;
+    cout << "       CpuEffects --benchmark [image] [runs]" << endl;
+    cout << "Filters are comma separated, such as sepia,gaussian7,unsharp. gaussian:sigma" << endl;
+    cout << "blurs by a sigma up to " << GAUSSIAN_MAX_SIGMA << ", box:radius, tent:radius and adaptive:radius" << endl;
+    cout << "average over any radius, and median:radius and rank:radius:percentile pick" << endl;
+    cout << "from it. Inputs are files, directories or quoted glob patterns." << endl;
+}
+
+// filters every input image into the output directory
+int Batch(int argc, char *argv[])
+{
+    BatchOptions options;
+    int arg = 1;
+    for (; arg + 1 < argc && strncmp(argv[arg], "--", 2) == 0; arg += 2)
+    {
+        if (strcmp(argv[arg], "--jobs") == 0)
+            options.decoders = options.encoders = max(1, atoi(argv[arg + 1]));
+        else if (strcmp(argv[arg], "--queue") == 0)
+            options.queue_depth = max(1, atoi(argv[arg + 1]));
+        else if (strcmp(argv[arg], "--format") == 0)
+            options.format = argv[arg + 1];
+        else
+        {
+            Usage();
+            return -1;
+        }
+    }
+    if (argc - arg < 3)
+    {
+        Usage();
+        return -1;
+    }
+
+    vector<FilterPass> passes;
+    if (!ParseChain(argv[arg], &passes))
+        return -1;
+    options.stages = CompileFilters(passes);
+    options.output_directory = argv[arg + 1];
+    if (mkdir(options.output_directory.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        cout << "ERROR: Could not create " << options.output_directory << endl;
+        return -1;
+    }
+
+    vector<string> inputs = ExpandInputs(vector<string>(argv + arg + 2, argv + argc));
+    if (inputs.empty())
+    {
+        cout << "ERROR: No input images" << endl;
+        return -1;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    GLuint written = RunBatch(inputs, options);
+    GLdouble seconds = chrono::duration<GLdouble>(chrono::steady_clock::now() - start).count();
+    cout << "Wrote " << written << " of " << inputs.size() << " images to " << options.output_directory
+         << " in " << fixed << setprecision(2) << seconds << " s" << endl;
+    return written == inputs.size() ? 0 : -1;
+}
+
+// ==========================================================================
+// PROGRAM ENTRY POINT
+
+int main(int argc, char *argv[])
+{
+    Magick::InitializeMagick(NULL);
+
+    if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+    {
+        string filename = argc > 2 ? argv[2] : "image1-mandrill.png";
+        GLuint runs = argc > 3 ? max(1, atoi(argv[3])) : 5;
+        return Benchmark(filename, runs);
+    }
+
+    return Batch(argc, argv);
+}
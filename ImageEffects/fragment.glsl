@@ -6,17 +6,25 @@
 // ==========================================================================
 #version 410
 
-#define M_PI 3.1415926535897932384626433832795
-
 uniform sampler2DRect texture;
-uniform mat3 colour_data;
+uniform usampler2DRect table;
 
-uniform int kernel[9];
-vec2 offsets[9] = vec2[](vec2(-1, -1), vec2(0, -1), vec2(1, -1), vec2(-1, 0), vec2(0, 0), vec2(1, 0), vec2(-1, 1), vec2(0, 1), vec2(1, 1));
-uniform uint filter_type;
+// one filter stage, see FilterStage in Filters.h
+#define FILTER_MAX_TAPS 32
+uniform mat3 pre_colour;
+uniform mat3 post_colour;
+uniform int taps;
+uniform vec2 tap_offsets[FILTER_MAX_TAPS];
+uniform float tap_weights[FILTER_MAX_TAPS];
+uniform bool absolute;
+// A box stage reads box means from table, the summed area table of texture
+// padded by the box's reach. Zero for other stages.
+uniform int box_size;
+uniform float box_noise;
 
-uniform uint gaussian_points;
-uniform float sigma;
+// must match summed_area.glsl and Filters.h
+#define SUMMED_AREA_SCALE 4096.0
+const vec3 greyscale = vec3(0.222, 0.715, 0.072);
 
 // interpolated colour received from vertex stage
 in vec3 Colour;
@@ -25,82 +33,41 @@ in vec2 textureCoords;
 // first output is mapped to the uniform framebuffer's colour index by default
 out vec4 FragmentColour;
 
-void main(void)
-{ 
-    vec4 sum = vec4(0.0);
-    switch(filter_type)
-    {
-        // Gaussian case
-        case 4:
-            float weight_sum = 0.0;
+// the texel at, or the mean of the box over it from four table fetches
+vec3 Fetch(vec2 at)
+{
+    if (box_size == 0)
+        return texture2DRect(texture, at).rgb;
 
-            // Store in flat arrays to make convolution easier
-            float gaussian_kernel[49];
-            vec2 gaussian_offset[49];
-            
-            // Generate nxn gaussian kernel
-            float mean = (gaussian_points - 1)/2;
-            for (int x = 0; x < gaussian_points; x++) 
-            {
-                for (int y = 0; y < gaussian_points; y++) {
-                    uint index = ((x*gaussian_points) + y);
-                    gaussian_kernel[index] = exp( -0.5 * (pow((x - mean)/sigma, 2.0) + pow((y - mean)/sigma,2.0)) ) / (2 * M_PI * sigma * sigma);
-                    weight_sum += gaussian_kernel[index];
-                    gaussian_offset[index] = vec2(-(int(gaussian_points) - 1)/2 + y, -(int(gaussian_points) - 1)/2 + x);
-                }
-            }
-            
-            // normalize kernel
-            for (int x = 0; x < gaussian_points; x++) 
-            {
-                for (int y = 0; y < gaussian_points; y++) {
-                     gaussian_kernel[(x*gaussian_points) + y] /= weight_sum;
-                }
-            }
-            
-            // perform convolution
-            for (int i = 0; i < gaussian_points*gaussian_points; i++) 
-            {
-                vec4 colour = texture2DRect(texture, textureCoords + gaussian_offset[i]);
-                colour = vec4(dot(colour, vec4(vec3(colour_data[0]), 0)), dot(colour, vec4(vec3(colour_data[1]), 0)), dot(colour, vec4(vec3(colour_data[2]), 0)), 0);
-                sum += colour * gaussian_kernel[i];
-            }
-            FragmentColour = sum;
-            break;
+    // the table's corners wrap, but their difference is the box's sum
+    ivec2 low = ivec2(floor(at));
+    ivec2 high = low + box_size;
+    uvec4 sum = texelFetch(table, high) - texelFetch(table, ivec2(low.x, high.y)) -
+                texelFetch(table, ivec2(high.x, low.y)) + texelFetch(table, low);
+    vec4 mean = vec4(ivec4(sum)) / (SUMMED_AREA_SCALE * float(box_size * box_size));
+    if (box_noise == 0.0)
+        return mean.rgb;
 
-        // Case for unsharp
-        case 3:
-            for (int i = 0; i < 9; i++) 
-            {
-                vec4 colour = texture2DRect(texture, textureCoords + offsets[i]);
-                colour = vec4(dot(colour, vec4(vec3(colour_data[0]), 0)), dot(colour, vec4(vec3(colour_data[1]), 0)), dot(colour, vec4(vec3(colour_data[2]), 0)), 0);
-                sum += colour * kernel[i];
-            }
-            FragmentColour = sum;
-            break;
+    // keep as much of the pixel as its box varies beyond noise
+    float luminance = dot(mean.rgb, greyscale);
+    float variance = max(mean.a - luminance * luminance, 0.0);
+    float keep = variance / (variance + box_noise * box_noise);
+    return mix(mean.rgb, texture2DRect(texture, at).rgb, keep);
+}
 
-        // Cases for vertical and horizontal sobel
-        case 2:
-        case 1:
-            vec4 greyscale = vec4(vec3(0.222, 0.715, 0.072), 0);
-            for (int i = 0; i < 9; i++) 
-            {
-                vec4 colour = texture2DRect(texture, textureCoords + offsets[i]);
-                colour = vec4(dot(colour, greyscale), dot(colour, greyscale), dot(colour, greyscale), 0);
-                sum += colour * kernel[i];
-            }
-            FragmentColour = abs(sum);
-            break;
-        
-        // Standard no filter colour effects
-        case 0:
-            vec4 TextureColour = texture2DRect(texture, textureCoords);
+void main(void)
+{ 
+    // the colour matrices are linear, so pre goes on the weighted sum
+    // once rather than on every tap
+    vec3 sum = vec3(0.0);
+    for (int i = 0; i < taps; i++)
+    {
+        sum += Fetch(textureCoords + tap_offsets[i]) * tap_weights[i];
+    }
+    sum = sum * pre_colour;
+    if (absolute)
+        sum = abs(sum);
 
-            // Apply colour effect from input matrix
-            sum = vec4(dot(TextureColour, vec4(vec3(colour_data[0]), 0)), dot(TextureColour, vec4(vec3(colour_data[1]), 0)), dot(TextureColour, vec4(vec3(colour_data[2]), 0)), 0);
-            
-            // write colour output
-            FragmentColour = sum;
-            break;
-    } 
+    // write colour output
+    FragmentColour = vec4(sum * post_colour, 0);
 }
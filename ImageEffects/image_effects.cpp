@@ -10,6 +10,7 @@
 #include <string>
 #include <iterator>
 #include <algorithm>
+#include <vector>
 #include <math.h>
 
 // specify that we want the OpenGL core profile before including GLFW headers
@@ -21,6 +22,8 @@
 #include <Magick++.h>
 #include <glm/glm.hpp>
 
+#include "Filters.h"
+
 using namespace std;
 
 // --------------------------------------------------------------------------
@@ -62,35 +65,15 @@ enum ImageType
 
 ImageType image_type = MANDRILL;
 
-enum FilterType
-{
-    NO_FILTER,
-	VERTICAL_SOBEL,
-	HORIZONTAL_SOBEL,
-	UNSHARP_MASK,
-	GAUSSIAN,
-	FILTERTYPE_MAX
-};
-
+// Passes locked into the chain with ENTER, the live selection runs after them
+vector<FilterPass> filter_chain;
 FilterType filter_type = NO_FILTER;
-
-GLint kernels[4][9] = {
-		{0, 0, 0, 0, 1, 0, 0, 0, 0},
-		{1, 0, -1, 2, 0, -2, 1, 0, -1},
-		{1, 2, 1, 0, 0, 0, -1, -2, -1},
-		{0, -1, 0, -1, 5, -1, 0, -1, 0}
-};
-
-enum GaussianType
-{
-    NO_GAUSSIAN = 0,
-	GAUSSIAN_3X3 = 3,
-	GAUSSIAN_5X5 = 5,
-	GAUSSIAN_7X7 = 7,
-	GAUSSIAN_MAX
-};
-
 GaussianType gaussian_type = NO_GAUSSIAN;
+// reach of the box, tent and adaptive mean filters B rotates through
+GLint smooth_radius = 4;
+
+// loaded from the file named on the command line, if any
+FilterPass user_kernel;
 
 struct Transformation
 {
@@ -177,6 +160,66 @@ bool InitializeTexture(MyTexture *texture, const string &imageFileName)
     return !CheckGLErrors();
 }
 
+// --------------------------------------------------------------------------
+// Functions to set up an offscreen render target
+
+struct MyFramebuffer
+{
+    // OpenGL name for the framebuffer object, texture it renders into
+    GLuint  framebufferName;
+    MyTexture target;
+
+    // initialize object names to zero (OpenGL reserved value)
+    MyFramebuffer() : framebufferName(0)
+    {}
+};
+
+// size the framebuffer's float rectangle texture to width x height,
+// creating it on first use, returning true if it is complete. integer
+// targets hold the unfiltered 32 bit sums of a summed area table instead.
+bool InitializeFramebuffer(MyFramebuffer *framebuffer, GLuint width, GLuint height, bool integer = false)
+{
+    if (framebuffer->framebufferName && framebuffer->target.width == width && framebuffer->target.height == height)
+        return true;
+
+    if (!framebuffer->framebufferName)
+    {
+        glGenFramebuffers(1, &framebuffer->framebufferName);
+        glGenTextures(1, &framebuffer->target.textureName);
+    }
+    framebuffer->target.width = width;
+    framebuffer->target.height = height;
+
+    // half floats keep the intermediate pass from rounding to 8 bits, and
+    // linear filtering is what the merged gaussian taps rely on
+    glBindTexture(GL_TEXTURE_RECTANGLE, framebuffer->target.textureName);
+    if (integer)
+        glTexImage2D(GL_TEXTURE_RECTANGLE, 0, GL_RGBA32UI, width, height, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, 0);
+    else
+        glTexImage2D(GL_TEXTURE_RECTANGLE, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, 0);
+    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MIN_FILTER, integer ? GL_NEAREST : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, integer ? GL_NEAREST : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer->framebufferName);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, framebuffer->target.textureName, 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!complete)
+        cout << "ERROR: Offscreen framebuffer is incomplete" << endl;
+
+    return complete && !CheckGLErrors();
+}
+
+// deallocate framebuffer-related objects
+void DestroyFramebuffer(MyFramebuffer *framebuffer)
+{
+    glDeleteFramebuffers(1, &framebuffer->framebufferName);
+    glDeleteTextures(1, &framebuffer->target.textureName);
+}
+
 // --------------------------------------------------------------------------
 // Functions to set up OpenGL shader programs for rendering
 
@@ -193,11 +236,11 @@ struct MyShader
 };
 
 // load, compile, and link shaders, returning true if successful
-bool InitializeShaders(MyShader *shader)
+bool InitializeShaders(MyShader *shader, const string &fragmentFile = "fragment.glsl")
 {
     // load shader source from files
     string vertexSource = LoadSource("vertex.glsl");
-    string fragmentSource = LoadSource("fragment.glsl");
+    string fragmentSource = LoadSource(fragmentFile);
     if (vertexSource.empty() || fragmentSource.empty()) return false;
 
     // compile shader source into shader objects
@@ -238,22 +281,26 @@ struct MyGeometry
     {}
 };
 
-// create buffers and fill with geometry data, returning true if successful
-bool InitializeGeometry(MyGeometry *geometry, MyTexture *texture)
+// create buffers and fill with geometry data, returning true if successful.
+// fill_frame covers the whole viewport one texel per pixel, unflipped, for
+// rendering the image into an offscreen target of its own size.
+bool InitializeGeometry(MyGeometry *geometry, MyTexture *texture, bool fill_frame = false)
 {
 	GLfloat x_max = 0;
 	GLfloat y_max = 0;
 	GLfloat x_min = 0;
 	GLfloat y_min = 0;
+	GLuint bottom = fill_frame ? 0 : texture->height;
+	GLuint top = fill_frame ? texture->height : 0;
 
-	if(texture->width > texture->height)
+	if(texture->width > texture->height && !fill_frame)
 	{
 		y_max = (texture->height/float(texture->width));
 		y_min = -(texture->height/float(texture->width));
 		x_max = 1.0;
 		x_min = -1.0;
 	}
-	else if(texture->width < texture->height)
+	else if(texture->width < texture->height && !fill_frame)
 	{
 		x_max = (texture->width/float(texture->height));
 		x_min = -(texture->width/float(texture->height));
@@ -287,12 +334,12 @@ bool InitializeGeometry(MyGeometry *geometry, MyTexture *texture)
     };
 
     const GLuint textureCoords[][2] = {
-    		{0, texture->height},
-			{texture->width, texture->height},
-			{0, 0},
-			{0, 0},
-			{texture->width, 0},
-    		{texture->width, texture->height}
+    		{0, bottom},
+			{texture->width, bottom},
+			{0, top},
+			{0, top},
+			{texture->width, top},
+    		{texture->width, bottom}
     };
 
     geometry->elementCount = 6;
@@ -356,26 +403,209 @@ void DestroyGeometry(MyGeometry *geometry)
     glDeleteBuffers(1, &geometry->colourBuffer);
 }
 
+// --------------------------------------------------------------------------
+// Filter graph that runs a chain's stages offscreen
+
+// must match summed_area.glsl
+#define SUMMED_AREA_RADIX 16
+
+struct MyFilterGraph
+{
+    // stages run on the last call, each result held in the matching target
+    vector<FilterStage> rendered;
+    vector<MyFramebuffer> targets;
+    // image those stages ran on
+    GLuint  sourceName;
+    // summed area table passes ping-pong between these, rebuilt for every
+    // box stage drawn
+    MyFramebuffer tables[2];
+
+    // initialize object names to zero (OpenGL reserved value)
+    MyFilterGraph() : sourceName(0)
+    {}
+};
+
+// send one stage's taps and colour matrices to the filter shader
+void UseStage(MyShader *shader, const FilterStage &stage)
+{
+    glUniformMatrix3fv(glGetUniformLocation(shader->program, "pre_colour"), 1, GL_FALSE, &stage.pre[0][0]);
+    glUniformMatrix3fv(glGetUniformLocation(shader->program, "post_colour"), 1, GL_FALSE, &stage.post[0][0]);
+    glUniform1i(glGetUniformLocation(shader->program, "taps"), stage.taps);
+    glUniform2fv(glGetUniformLocation(shader->program, "tap_offsets"), stage.taps, &stage.offsets[0][0]);
+    glUniform1fv(glGetUniformLocation(shader->program, "tap_weights"), stage.taps, stage.weights);
+    glUniform1i(glGetUniformLocation(shader->program, "absolute"), stage.absolute);
+    glUniform1i(glGetUniformLocation(shader->program, "box_size"), stage.boxed() ? stage.box_to - stage.box_from + 1 : 0);
+    glUniform1f(glGetUniformLocation(shader->program, "box_noise"), stage.box_noise);
+    glUniform1i(glGetUniformLocation(shader->program, "table"), 1);
+}
+
+// Builds the summed area table of a box stage's input, returning the table
+// or NULL on failure. The first pass copies the input in padded by the
+// box's reach, the rest each add SUMMED_AREA_RADIX texels a step apart,
+// the step growing by that factor until an axis is summed, across then
+// down. Leaves table_shader bound and the viewport at the table's size.
+MyTexture *BuildSummedArea(MyFilterGraph *graph, const FilterStage &stage, MyTexture *input,
+                           MyGeometry *frame, MyShader *table_shader)
+{
+    GLint size = stage.box_to - stage.box_from + 1;
+    GLuint width = input->width + size, height = input->height + size;
+    for (GLuint i = 0; i < 2; i++)
+    {
+        if (!InitializeFramebuffer(&graph->tables[i], width, height, true))
+            return NULL;
+    }
+
+    glUseProgram(table_shader->program);
+    glViewport(0, 0, width, height);
+    glUniform4f(glGetUniformLocation(table_shader->program, "transformation_data"), 0, 0, 1, 0);
+    glUniform1i(glGetUniformLocation(table_shader->program, "image"), 0);
+    glUniform1i(glGetUniformLocation(table_shader->program, "table"), 1);
+    glUniform1i(glGetUniformLocation(table_shader->program, "pad"), -stage.box_from);
+
+    // the frame quad covers the viewport whatever its size
+    glBindFramebuffer(GL_FRAMEBUFFER, graph->tables[0].framebufferName);
+    glBindTexture(GL_TEXTURE_RECTANGLE, input->textureName);
+    glUniform2i(glGetUniformLocation(table_shader->program, "pass_step"), 0, 0);
+    glDrawArrays(GL_TRIANGLES, 0, frame->elementCount);
+
+    GLuint current = 0;
+    glActiveTexture(GL_TEXTURE1);
+    for (GLuint axis = 0; axis < 2; axis++)
+    {
+        GLuint length = axis == 0 ? width : height;
+        for (GLuint step = 1; step < length; step *= SUMMED_AREA_RADIX)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, graph->tables[1 - current].framebufferName);
+            glBindTexture(GL_TEXTURE_RECTANGLE, graph->tables[current].target.textureName);
+            glUniform2i(glGetUniformLocation(table_shader->program, "pass_step"), axis == 0 ? step : 0, axis == 1 ? step : 0);
+            glDrawArrays(GL_TRIANGLES, 0, frame->elementCount);
+            current = 1 - current;
+        }
+    }
+    glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+    glActiveTexture(GL_TEXTURE0);
+    return &graph->tables[current].target;
+}
+
+// run stages over texture at its own size, each reading the result of the
+// one before, and return the texture holding the last result. Stages that
+// match the previous call on the same image keep their results, so only
+// those from the first change on are drawn again.
+MyTexture *RunFilterGraph(MyFilterGraph *graph, const vector<FilterStage> &stages, MyTexture *texture,
+                          MyGeometry *frame, MyShader *shader, MyShader *table_shader)
+{
+    GLuint first = 0;
+    if (graph->sourceName == texture->textureName)
+    {
+        while (first < stages.size() && first < graph->rendered.size() && stages[first] == graph->rendered[first])
+            first++;
+    }
+    graph->rendered.assign(stages.begin(), stages.begin() + first);
+    graph->sourceName = texture->textureName;
+    if (graph->targets.size() < stages.size())
+        graph->targets.resize(stages.size());
+
+    MyTexture *input = first > 0 ? &graph->targets[first - 1].target : texture;
+    if (first == stages.size())
+        return input;
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glViewport(0, 0, texture->width, texture->height);
+    glBindVertexArray(frame->vertexArray);
+    glUniform4f(glGetUniformLocation(shader->program, "transformation_data"), 0, 0, 1, 0);
+
+    for (GLuint i = first; i < stages.size(); i++)
+    {
+        MyFramebuffer *output = &graph->targets[i];
+        if (!InitializeFramebuffer(output, texture->width, texture->height))
+            break;
+
+        // a box stage reads its input's summed area table beside the input
+        MyTexture *table = NULL;
+        if (stages[i].boxed())
+        {
+            table = BuildSummedArea(graph, stages[i], input, frame, table_shader);
+            if (!table)
+                break;
+            glUseProgram(shader->program);
+            glViewport(0, 0, texture->width, texture->height);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_RECTANGLE, table->textureName);
+            glActiveTexture(GL_TEXTURE0);
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, output->framebufferName);
+        glBindTexture(GL_TEXTURE_RECTANGLE, input->textureName);
+        UseStage(shader, stages[i]);
+        glDrawArrays(GL_TRIANGLES, 0, frame->elementCount);
+        graph->rendered.push_back(stages[i]);
+        input = &output->target;
+
+        if (table)
+        {
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+            glActiveTexture(GL_TEXTURE0);
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    return input;
+}
+
+// deallocate the graph's render targets
+void DestroyFilterGraph(MyFilterGraph *graph)
+{
+    for (GLuint i = 0; i < graph->targets.size(); i++)
+    {
+        if (graph->targets[i].framebufferName)
+            DestroyFramebuffer(&graph->targets[i]);
+    }
+    for (GLuint i = 0; i < 2; i++)
+    {
+        if (graph->tables[i].framebufferName)
+            DestroyFramebuffer(&graph->tables[i]);
+    }
+    graph->targets.clear();
+    graph->rendered.clear();
+}
+
+// the locked in chain followed by the live selection
+vector<FilterPass> CurrentPasses()
+{
+    vector<FilterPass> passes = filter_chain;
+    FilterPass live = filter_type == USER_KERNEL ? user_kernel : FilterPass();
+    live.type = filter_type;
+    live.colour = colour_effects;
+    live.gaussian = gaussian_type;
+    live.sigma = gaussian_sigma;
+    live.radius = smooth_radius;
+    passes.push_back(live);
+    return passes;
+}
+
 // --------------------------------------------------------------------------
 // Rendering function that draws our scene to the frame buffer
 
-void RenderScene(MyGeometry *geometry, MyTexture* texture, MyShader *shader)
+void RenderScene(MyGeometry *geometry, MyGeometry *frame, MyTexture* texture, MyShader *shader,
+                 MyShader *table_shader, MyFilterGraph *graph)
 {
+    // bind our shader program, then filter the image offscreen
+    glUseProgram(shader->program);
+    texture = RunFilterGraph(graph, CompileFilters(CurrentPasses()), texture, frame, shader, table_shader);
+
     // clear screen to a dark grey colour
     glClearColor(0.2, 0.2, 0.2, 1.0);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    // bind our shader program and the vertex array object containing our
-    // scene geometry, then tell OpenGL to draw our geometry
-    glUseProgram(shader->program);
+    // bind the vertex array object containing our scene geometry and the
+    // filtered image, then tell OpenGL to draw our geometry
     glBindVertexArray(geometry->vertexArray);
     glBindTexture(GL_TEXTURE_RECTANGLE, texture->textureName);
     glUniform4f(glGetUniformLocation(shader->program, "transformation_data"), transformation.x, transformation.y, transformation.scale, transformation.rotation);
-    glUniformMatrix3fv(glGetUniformLocation(shader->program, "colour_data"), 1, GL_FALSE, &colour_effects[0][0]);
-    glUniform1iv(glGetUniformLocation(shader->program, "kernel"), 9, kernels[filter_type]);
-    glUniform1ui(glGetUniformLocation(shader->program, "filter_type"), filter_type);
-    glUniform1ui(glGetUniformLocation(shader->program, "gaussian_points"), gaussian_type);
-    glUniform1f(glGetUniformLocation(shader->program, "sigma"), gaussian_sigma);
+    UseStage(shader, FilterStage());
     glDrawArrays(GL_TRIANGLES, 0, geometry->elementCount);
 
     // reset state to default (no shader or geometry bound)
@@ -439,48 +669,70 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 			transformation.scale -= 0.05;
 			break;
 		case GLFW_KEY_F1:
-		    colour_effects = glm::mat3(1.0);
+		    colour_effects = ColourMatrix(NORMAL_COLOUR);
 			break;
 		case GLFW_KEY_F2:
-			for(GLuint i = 0; i < 3; i++) { colour_effects[i] = glm::vec3(0.333, 0.333, 0.333); }
+			colour_effects = ColourMatrix(GREYSCALE_1);
 			break;
 		case GLFW_KEY_F3:
-			for(GLuint i = 0; i < 3; i++) { colour_effects[i] = glm::vec3(0.299, 0.587, 0.114); }
+			colour_effects = ColourMatrix(GREYSCALE_2);
 			break;
 		case GLFW_KEY_F4:
-			for(GLuint i = 0; i < 3; i++) { colour_effects[i] = glm::vec3(0.222, 0.715, 0.072); }
+			colour_effects = ColourMatrix(GREYSCALE_3);
 			break;
         case GLFW_KEY_F5:
-			colour_effects[0] = glm::vec3(0.393, 0.769, 0.189);
-			colour_effects[1] = glm::vec3(0.349, 0.686, 0.168);
-			colour_effects[2] = glm::vec3(0.272, 0.534, 0.131);
+			colour_effects = ColourMatrix(SEPIA);
 		    break;
         case GLFW_KEY_F:
-            if(filter_type < GAUSSIAN - 1)
+            if(filter_type < UNSHARP_MASK)
         		filter_type = (FilterType)((int)filter_type + 1);
+        	else if(filter_type == UNSHARP_MASK && user_kernel.type == USER_KERNEL)
+        	    filter_type = USER_KERNEL;
         	else
         	    filter_type = NO_FILTER;
 		    break;
         case GLFW_KEY_G:
         	filter_type = GAUSSIAN;
         	if(gaussian_type == NO_GAUSSIAN)
-        	{
         	    gaussian_type = GAUSSIAN_3X3;
-        	    gaussian_sigma = 2.0;
-        	}
+        	else if(gaussian_type < GAUSSIAN_7X7)
+        	    gaussian_type = (GaussianType)((int)gaussian_type + 2);
+        	else if(gaussian_type < GAUSSIAN_31X31)
+        	    gaussian_type = gaussian_type == GAUSSIAN_7X7 ? GAUSSIAN_15X15 : GAUSSIAN_31X31;
         	else
         	{
-        		if(gaussian_type < GAUSSIAN_7X7)
-        		{
-        		    gaussian_type = (GaussianType)((int)gaussian_type + 2);
-        		    gaussian_sigma += 0.22;
-        		}
-        		else
-        		{
-        			filter_type = NO_FILTER;
-        		    gaussian_type = NO_GAUSSIAN;
-        		}
+        	    filter_type = NO_FILTER;
+        	    gaussian_type = NO_GAUSSIAN;
         	}
+        	gaussian_sigma = DefaultSigma(gaussian_type);
+        	break;
+        case GLFW_KEY_B:
+        	if(filter_type < BOX)
+        	    filter_type = BOX;
+        	else if(filter_type < ADAPTIVE_MEAN)
+        	    filter_type = (FilterType)((int)filter_type + 1);
+        	else
+        	    filter_type = NO_FILTER;
+        	break;
+        case GLFW_KEY_LEFT_BRACKET:
+        	// one pixel at a time, or halving with shift held
+        	smooth_radius = mods & GLFW_MOD_SHIFT ? smooth_radius / 2 : smooth_radius - 1;
+        	smooth_radius = max(smooth_radius, 1);
+        	break;
+        case GLFW_KEY_RIGHT_BRACKET:
+        	smooth_radius = mods & GLFW_MOD_SHIFT ? smooth_radius * 2 : smooth_radius + 1;
+        	smooth_radius = min(smooth_radius, SMOOTH_MAX_RADIUS);
+        	break;
+        case GLFW_KEY_ENTER:
+        	// lock the live selection into the chain and start a new one
+        	filter_chain.push_back(CurrentPasses().back());
+        	colour_effects = glm::mat3(1.0);
+        	filter_type = NO_FILTER;
+        	gaussian_type = NO_GAUSSIAN;
+        	break;
+        case GLFW_KEY_BACKSPACE:
+        	if(!filter_chain.empty())
+        	    filter_chain.pop_back();
         	break;
         case GLFW_KEY_SPACE:
         	reset_image = true;
@@ -489,6 +741,7 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
         	transformation.scale = 1.0;
         	filter_type = NO_FILTER;
         	gaussian_type = NO_GAUSSIAN;
+        	filter_chain.clear();
 
 		}
 	}
@@ -534,6 +787,10 @@ int main(int argc, char *argv[])
 {
     Magick::InitializeMagick(NULL);
 
+    // an optional kernel file joins the F rotation after unsharp
+    if (argc > 1 && !LoadKernel(argv[1], &user_kernel))
+        return -1;
+
     // initialize the GLFW windowing system
     if (!glfwInit()) {
         cout << "ERROR: GLFW failed to initilize, TERMINATING" << endl;
@@ -567,8 +824,8 @@ int main(int argc, char *argv[])
     QueryGLVersion();
 
     // call function to load and compile shader programs
-    MyShader shader;
-    if (!InitializeShaders(&shader)) {
+    MyShader shader, table_shader;
+    if (!InitializeShaders(&shader) || !InitializeShaders(&table_shader, "summed_area.glsl")) {
         cout << "Program could not initialize shaders, TERMINATING" << endl;
         return -1;
     }
@@ -614,6 +871,16 @@ int main(int argc, char *argv[])
     if (!InitializeGeometry(&geometries[CAPSTONE], &textures[CAPSTONE]))
         cout << "Program failed to intialize geometry!" << endl;
 
+    // full frame geometry for offscreen passes over each image
+    MyGeometry frames[IMAGETYPE_MAX];
+    for(GLuint i = 0; i < IMAGETYPE_MAX; i++)
+    {
+        if (!InitializeGeometry(&frames[i], &textures[i], true))
+            cout << "Program failed to intialize geometry!" << endl;
+    }
+
+    MyFilterGraph filter_graph;
+
     // run an event-triggered main loop
     while (!glfwWindowShouldClose(window))
     {
@@ -624,7 +891,8 @@ int main(int argc, char *argv[])
     	    reset_image = false;
     	}
         // call function to draw our scene
-        RenderScene(&geometries[image_type], &textures[image_type], &shader);
+        RenderScene(&geometries[image_type], &frames[image_type], &textures[image_type], &shader,
+                    &table_shader, &filter_graph);
 
         // scene is rendered to the back buffer, so swap to front for display
         glfwSwapBuffers(window);
@@ -637,8 +905,11 @@ int main(int argc, char *argv[])
     for(GLuint i = 0; i < IMAGETYPE_MAX; i++)
     {
         DestroyGeometry(&geometries[i]);
+        DestroyGeometry(&frames[i]);
     }
+    DestroyFilterGraph(&filter_graph);
     DestroyShaders(&shader);
+    DestroyShaders(&table_shader);
     glfwDestroyWindow(window);
     glfwTerminate();
 
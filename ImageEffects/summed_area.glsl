@@ -0,0 +1,62 @@
+// ==========================================================================
+// Summed area table program for the box filter stages
+//  - copies the image in padded by the box's reach, then each pass adds
+//    SUMMED_AREA_RADIX texels a step apart across or down, so an axis of n
+//    texels is summed in log16(n) passes
+//
+// Author:  Matthew Sembinelli, University of Calgary
+// Date:    October 18, 2026
+// ==========================================================================
+#version 410
+
+// must match image_effects.cpp, fragment.glsl and Filters.h
+#define SUMMED_AREA_RADIX 16
+#define SUMMED_AREA_SCALE 4096.0
+#define SUMMED_AREA_LIMIT 2.0
+
+uniform sampler2DRect image;
+uniform usampler2DRect table;
+
+// zero to copy image in, otherwise the step between the texels a pass adds
+uniform ivec2 pass_step;
+// how far the box reaches before each pixel
+uniform int pad;
+
+// luminance weights, greyscale in Filters.cpp
+const vec3 greyscale = vec3(0.222, 0.715, 0.072);
+
+out uvec4 Sum;
+
+void main(void)
+{
+    ivec2 at = ivec2(gl_FragCoord.xy);
+    if (pass_step == ivec2(0))
+    {
+        // a zero row and column lead the table, and the image's edges
+        // repeat out to the padding as clamped sampling does
+        if (at.x == 0 || at.y == 0)
+        {
+            Sum = uvec4(0);
+            return;
+        }
+        vec3 colour = clamp(texture2DRect(image, vec2(at - 1 - pad) + 0.5).rgb, -SUMMED_AREA_LIMIT, SUMMED_AREA_LIMIT);
+        float luminance = dot(colour, greyscale);
+
+        // Fixed point sums are exact and wrap, so a box's sum comes out
+        // right from four fetches however large the table's corners grow,
+        // as long as the box's own sum fits an int. Squared luminance rides
+        // in alpha for the adaptive mean, held to the same limit as colour.
+        Sum = uvec4(ivec4(round(vec4(colour, min(luminance * luminance, SUMMED_AREA_LIMIT)) * SUMMED_AREA_SCALE)));
+        return;
+    }
+
+    uvec4 sum = uvec4(0);
+    for (int i = 0; i < SUMMED_AREA_RADIX; i++)
+    {
+        ivec2 from = at - i * pass_step;
+        if (from.x < 0 || from.y < 0)
+            break;
+        sum += texelFetch(table, from);
+    }
+    Sum = sum;
+}
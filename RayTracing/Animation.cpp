@@ -0,0 +1,58 @@
+/*
+ * Animation.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#include "Animation.h"
+
+#include <algorithm>
+
+void Animation::add_keyframe(GLuint object_index, GLfloat time, const dvec3 &translation, GLdouble yaw_degrees)
+{
+	Keyframe key = { time, translation, yaw_degrees };
+	vector<Keyframe> &track = tracks[object_index];
+
+	// Keep each track sorted by time
+	GLuint i = track.size();
+	while(i > 0 && track[i - 1].time > time)
+		i--;
+	track.insert(track.begin() + i, key);
+}
+
+GLfloat Animation::duration() const
+{
+	GLfloat end = 0;
+	for(map<GLuint, vector<Keyframe> >::const_iterator it = tracks.begin(); it != tracks.end(); ++it)
+		end = std::max(end, it->second.back().time);
+	return end;
+}
+
+template<typename real>
+void Animation::apply(vector<Object<real>*> &objects, GLfloat time) const
+{
+	for(map<GLuint, vector<Keyframe> >::const_iterator it = tracks.begin(); it != tracks.end(); ++it)
+	{
+		if(it->first >= objects.size())
+			continue;
+		const vector<Keyframe> &track = it->second;
+
+		// Find the keys either side of time
+		GLuint next = 0;
+		while(next < track.size() && track[next].time <= time)
+			next++;
+		const Keyframe &a = track[next == 0 ? 0 : next - 1];
+		const Keyframe &b = track[next == track.size() ? next - 1 : next];
+		GLfloat s = (b.time > a.time) ? (time - a.time) / (b.time - a.time) : 0.0f;
+		s = clamp(s, 0.0f, 1.0f);
+
+		rvec3<real> translation(mix(a.translation, b.translation, (GLdouble)s));
+		GLdouble yaw = radians(mix(a.yaw, b.yaw, (GLdouble)s));
+		real c = (real)cos(yaw), sn = (real)sin(yaw);
+		rmat3<real> rotation(rvec3<real>(c, 0, -sn), rvec3<real>(0, 1, 0), rvec3<real>(sn, 0, c));
+		objects[it->first]->transform(rotation, translation);
+	}
+}
+
+template void Animation::apply(vector<Object<GLfloat>*> &objects, GLfloat time) const;
+template void Animation::apply(vector<Object<GLdouble>*> &objects, GLfloat time) const;
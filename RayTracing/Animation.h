@@ -0,0 +1,46 @@
+/*
+ * Animation.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <glm/glm.hpp>
+#include <GLFW/glfw3.h>
+#include <map>
+#include <vector>
+
+#include "Precision.h"
+#include "Primitives.h"
+
+using namespace std;
+using namespace glm;
+
+// Keyframed rigid motion for the objects of a scene. Each animated object
+// has its own track of translations and turns about the vertical axis,
+// interpolated linearly between keys and held before the first and after
+// the last one.
+class Animation
+{
+	public:
+	    void add_keyframe(GLuint object_index, GLfloat time, const dvec3 &translation, GLdouble yaw_degrees);
+	    bool empty() const { return tracks.empty(); }
+	    // Time of the last keyframe in seconds
+	    GLfloat duration() const;
+	    // Moves every animated object, of either precision, to where it is at
+	    // time
+	    template<typename real>
+	    void apply(vector<Object<real>*> &objects, GLfloat time) const;
+	private:
+	    struct Keyframe
+	    {
+	        GLfloat time;
+	        dvec3 translation;
+	        GLdouble yaw;
+	    };
+	    map<GLuint, vector<Keyframe> > tracks;
+};
+
+#endif
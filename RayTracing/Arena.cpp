@@ -0,0 +1,71 @@
+/*
+ * Arena.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#include "Arena.h"
+
+#include <stdint.h>
+
+static uintptr_t align_up(uintptr_t address, size_t alignment)
+{
+	return (address + alignment - 1) & ~(uintptr_t)(alignment - 1);
+}
+
+Arena::Arena(size_t block_bytes_)
+: block_bytes(block_bytes_), block_used(0), used(0)
+{
+}
+
+Arena::~Arena()
+{
+	release();
+	for(size_t i = 0; i < blocks.size(); i++)
+		delete[] blocks[i];
+}
+
+void *Arena::allocate(size_t bytes, size_t alignment)
+{
+	// Oversized objects get a block of their own beside the bump blocks
+	if(bytes + alignment > block_bytes)
+	{
+		char *block = new char[bytes + alignment];
+		large_blocks.push_back(block);
+		used += bytes;
+		return (void *)align_up((uintptr_t)block, alignment);
+	}
+
+	uintptr_t start = 0;
+	if(!blocks.empty())
+		start = align_up((uintptr_t)blocks.back() + block_used, alignment);
+	if(blocks.empty() || start + bytes > (uintptr_t)blocks.back() + block_bytes)
+	{
+		blocks.push_back(new char[block_bytes]);
+		block_used = 0;
+		start = align_up((uintptr_t)blocks.back(), alignment);
+	}
+
+	size_t end = start + bytes - (uintptr_t)blocks.back();
+	used += end - block_used;
+	block_used = end;
+	return (void *)start;
+}
+
+void Arena::release()
+{
+	for(size_t i = destructors.size(); i > 0; i--)
+		destructors[i - 1].second(destructors[i - 1].first);
+	destructors.clear();
+
+	// The first block is kept for the next scene, the rest are freed
+	for(size_t i = 1; i < blocks.size(); i++)
+		delete[] blocks[i];
+	if(blocks.size() > 1)
+		blocks.resize(1);
+	for(size_t i = 0; i < large_blocks.size(); i++)
+		delete[] large_blocks[i];
+	large_blocks.clear();
+	block_used = 0;
+	used = 0;
+}
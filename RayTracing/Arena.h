@@ -0,0 +1,52 @@
+/*
+ * Arena.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Bump allocator that owns everything a scene parses. Objects are placed one
+// after another in large blocks, so objects created together sit together in
+// memory, and all of them are destroyed and freed at once by release() or
+// when the arena goes away. Nothing is freed individually.
+class Arena
+{
+	public:
+	    explicit Arena(size_t block_bytes_ = 64 * 1024);
+	    ~Arena();
+	    // Constructs a T in the arena, destroyed on release()
+	    template<typename T, typename... Args>
+	    T *create(Args&&... args)
+	    {
+	        T *object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	        destructors.push_back(make_pair((void *)object, &destroy<T>));
+	        return object;
+	    }
+	    // Destroys every object, newest first, and frees all but the first block
+	    void release();
+	    size_t used_bytes() const { return used; }
+	private:
+	    Arena(const Arena &);
+	    Arena &operator=(const Arena &);
+	    void *allocate(size_t bytes, size_t alignment);
+	    template<typename T>
+	    static void destroy(void *object) { static_cast<T *>(object)->~T(); }
+
+	    size_t block_bytes;
+	    vector<char *> blocks;
+	    vector<char *> large_blocks;
+	    size_t block_used;
+	    size_t used;
+	    vector<pair<void *, void (*)(void *)> > destructors;
+};
+
+#endif
@@ -0,0 +1,238 @@
+/*
+ * BVH.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#include "BVH.h"
+#include "Parallel.h"
+
+#include <algorithm>
+
+// Objects per block of work when building in parallel
+#define BUILD_BLOCK 1024
+
+// Spreads the low 10 bits of v out to every third bit
+static uint32_t expand_bits(uint32_t v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+// 30 bit Morton code of a point in the unit cube
+static uint32_t morton_code(const vec3 &p)
+{
+	vec3 q = clamp(p * 1024.0f, 0.0f, 1023.0f);
+	return expand_bits((uint32_t)q.x) * 4 + expand_bits((uint32_t)q.y) * 2 + expand_bits((uint32_t)q.z);
+}
+
+static GLint leading_zeros(uint32_t v)
+{
+	return v == 0 ? 32 : __builtin_clz(v);
+}
+
+// Length of the common prefix of the codes at i and j, with the index
+// breaking ties between equal codes; -1 outside the array
+static GLint prefix(const vector<pair<uint32_t, GLuint> > &codes, GLint i, GLint j)
+{
+	if(j < 0 || j >= (GLint)codes.size())
+		return -1;
+	if(codes[i].first == codes[j].first)
+		return 32 + leading_zeros((uint32_t)i ^ (uint32_t)j);
+	return leading_zeros(codes[i].first ^ codes[j].first);
+}
+
+// Equal distances go to the lowest index, as a linear scan over the objects
+// would pick, e.g. where two triangles share an edge
+template<typename real>
+static bool nearer(real t_val, GLint index, real t_max, GLint hit)
+{
+	return t_val < t_max || (t_val == t_max && hit >= 0 && index < hit);
+}
+
+template<typename real>
+BVH<real>::BVH()
+: leaf_offset(0), build_cost(0)
+{
+}
+
+template<typename real>
+void BVH<real>::build(const vector<Object<real>*> &objects)
+{
+	nodes.clear();
+	leaf_objects.clear();
+	unbounded_objects.clear();
+	leaf_offset = 0;
+	build_cost = 0;
+
+	// Planes have no box and are always tested
+	vector<pair<uint32_t, GLuint> > codes;
+	vector<Bounds<real> > boxes(objects.size());
+	Bounds<real> centroids;
+	for(GLuint i = 0; i < objects.size(); i++)
+	{
+		if(!objects[i]->bounded())
+		{
+			unbounded_objects.push_back(i);
+			continue;
+		}
+		boxes[i] = objects[i]->bounds();
+		centroids.expand(boxes[i].center());
+		codes.push_back(make_pair(0u, i));
+	}
+	GLint n = codes.size();
+	if(n == 0)
+		return;
+
+	rvec3<real> extent = max(centroids.max_point - centroids.min_point, rvec3<real>((real)1E-6));
+	run_workers((n + BUILD_BLOCK - 1) / BUILD_BLOCK, [&](GLuint block)
+	{
+		for(GLint i = block * BUILD_BLOCK; i < std::min(n, (GLint)(block + 1) * BUILD_BLOCK); i++)
+			codes[i].first = morton_code(vec3((boxes[codes[i].second].center() - centroids.min_point) / extent));
+		return true;
+	});
+	sort(codes.begin(), codes.end());
+
+	leaf_offset = n - 1;
+	nodes.resize(2 * n - 1);
+	leaf_objects.resize(n);
+	for(GLint k = 0; k < n; k++)
+	{
+		leaf_objects[k] = codes[k].second;
+		nodes[leaf_offset + k].left = nodes[leaf_offset + k].right = -1;
+	}
+
+	// Karras' construction: each internal node finds the range of codes it
+	// covers and where that range splits, independently of the others
+	run_workers((n - 1 + BUILD_BLOCK - 1) / BUILD_BLOCK, [&](GLuint block)
+	{
+		for(GLint i = block * BUILD_BLOCK; i < std::min(n - 1, (GLint)(block + 1) * BUILD_BLOCK); i++)
+		{
+			GLint d = (prefix(codes, i, i + 1) - prefix(codes, i, i - 1)) >= 0 ? 1 : -1;
+			GLint min_prefix = prefix(codes, i, i - d);
+
+			GLint length_max = 2;
+			while(prefix(codes, i, i + length_max * d) > min_prefix)
+				length_max *= 2;
+			GLint length = 0;
+			for(GLint t = length_max / 2; t >= 1; t /= 2)
+			{
+				if(prefix(codes, i, i + (length + t) * d) > min_prefix)
+					length += t;
+			}
+			GLint j = i + length * d;
+
+			GLint node_prefix = prefix(codes, i, j);
+			GLint split = 0;
+			GLint t = length;
+			do
+			{
+				t = (t + 1) / 2;
+				if(prefix(codes, i, i + (split + t) * d) > node_prefix)
+					split += t;
+			} while(t > 1);
+			GLint gamma = i + split * d + std::min(d, 0);
+
+			nodes[i].left = (std::min(i, j) == gamma) ? leaf_offset + gamma : gamma;
+			nodes[i].right = (std::max(i, j) == gamma + 1) ? leaf_offset + gamma + 1 : gamma + 1;
+		}
+		return true;
+	});
+
+	fit(objects, 0);
+	build_cost = cost();
+}
+
+template<typename real>
+Bounds<real> BVH<real>::fit(const vector<Object<real>*> &objects, GLint node)
+{
+	Node &current = nodes[node];
+	if(node >= leaf_offset)
+	{
+		current.bounds = objects[leaf_objects[node - leaf_offset]]->bounds();
+	}
+	else
+	{
+		current.bounds = fit(objects, current.left);
+		current.bounds.expand(fit(objects, current.right));
+	}
+	return current.bounds;
+}
+
+template<typename real>
+void BVH<real>::refit(const vector<Object<real>*> &objects)
+{
+	if(!nodes.empty())
+		fit(objects, 0);
+}
+
+template<typename real>
+real BVH<real>::cost() const
+{
+	real area = 0;
+	for(GLint i = 0; i < leaf_offset; i++)
+	{
+		rvec3<real> e = nodes[i].bounds.max_point - nodes[i].bounds.min_point;
+		area += 2 * (e.x*e.y + e.y*e.z + e.z*e.x);
+	}
+	return area;
+}
+
+template<typename real>
+GLint BVH<real>::closest_hit(const vector<Object<real>*> &objects, const Ray<real> &ray, GLint exclude, real t_min, real *t_max, rvec3<real> *point, rvec3<real> *normal) const
+{
+	GLint hit = -1;
+	real t_val, t_near;
+	rvec3<real> tmp_point, tmp_normal;
+	rvec3<real> *hit_normal = normal ? &tmp_normal : NULL;
+
+	for(GLuint i = 0; i < unbounded_objects.size(); i++)
+	{
+		GLint index = unbounded_objects[i];
+		if(index != exclude && objects[index]->intersect(ray, &tmp_point, &t_val, hit_normal) && nearer(t_val, index, *t_max, hit) && t_val > t_min)
+		{
+			*t_max = t_val;
+			*point = tmp_point;
+			if(normal)
+				*normal = tmp_normal;
+			hit = index;
+		}
+	}
+	if(nodes.empty())
+		return hit;
+
+	// The tree is at most ~64 levels deep, one code bit or tie bit each
+	GLint stack[128];
+	GLint top = 0;
+	stack[top++] = 0;
+	while(top > 0)
+	{
+		const Node &node = nodes[stack[--top]];
+		// A box can round to just behind a hit on its own face, so allow a
+		// little slack or a tied object there would be skipped
+		if(!node.bounds.intersect(ray, *t_max * (real)1.0001, &t_near))
+			continue;
+		if(node.left < 0)
+		{
+			GLint index = leaf_objects[(&node - &nodes[0]) - leaf_offset];
+			if(index != exclude && objects[index]->intersect(ray, &tmp_point, &t_val, hit_normal) && nearer(t_val, index, *t_max, hit) && t_val > t_min)
+			{
+				*t_max = t_val;
+				*point = tmp_point;
+				if(normal)
+					*normal = tmp_normal;
+				hit = index;
+			}
+			continue;
+		}
+		stack[top++] = node.right;
+		stack[top++] = node.left;
+	}
+	return hit;
+}
+
+template class BVH<GLfloat>;
+template class BVH<GLdouble>;
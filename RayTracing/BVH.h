@@ -0,0 +1,57 @@
+/*
+ * BVH.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+#include <GLFW/glfw3.h>
+#include <stdint.h>
+#include <vector>
+
+#include "Bounds.h"
+#include "Primitives.h"
+#include "Ray.h"
+
+using namespace std;
+using namespace glm;
+
+// Bounding volume hierarchy over the tracer's objects, built as a linear BVH:
+// objects are sorted along a Morton curve and every internal node is worked
+// out independently from the sorted codes, so the build runs in parallel.
+// When objects move, refit() only recomputes the boxes; the tree keeps its
+// shape until it has degraded enough to be worth building again.
+template<typename real>
+class BVH
+{
+	public:
+	    BVH();
+	    void build(const vector<Object<real>*> &objects);
+	    void refit(const vector<Object<real>*> &objects);
+	    // Total surface area of the boxes, a stand-in for traversal cost
+	    real cost() const;
+	    // Cost right after the last build, to judge how far refits drifted
+	    real built_cost() const { return build_cost; }
+	    // Nearest object hit with t_min < t < *t_max, skipping exclude. Returns
+	    // its index or -1, narrowing *t_max to the hit. The normal there is
+	    // written unless normal is NULL.
+	    GLint closest_hit(const vector<Object<real>*> &objects, const Ray<real> &ray, GLint exclude, real t_min, real *t_max, rvec3<real> *point, rvec3<real> *normal) const;
+	private:
+	    // Internal nodes come first, leaf k is at leaf_offset + k
+	    struct Node
+	    {
+	        Bounds<real> bounds;
+	        GLint left, right;
+	    };
+	    vector<Node> nodes;
+	    vector<GLuint> leaf_objects;
+	    vector<GLuint> unbounded_objects;
+	    GLint leaf_offset;
+	    real build_cost;
+	    Bounds<real> fit(const vector<Object<real>*> &objects, GLint node);
+};
+
+#endif
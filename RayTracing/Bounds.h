@@ -0,0 +1,61 @@
+/*
+ * Bounds.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+#include <GLFW/glfw3.h>
+#include <limits>
+#include <algorithm>
+#include "Ray.h"
+
+using namespace glm;
+
+// Axis aligned bounding box, shared by the acceleration structures
+template<typename real>
+class Bounds
+{
+	public:
+	    Bounds() : min_point(rvec3<real>(std::numeric_limits<real>::max())), max_point(rvec3<real>(-std::numeric_limits<real>::max())) {}
+	    Bounds(rvec3<real> min_point_, rvec3<real> max_point_) : min_point(min_point_), max_point(max_point_) {}
+	    rvec3<real> min_point;
+	    rvec3<real> max_point;
+
+	    void expand(const rvec3<real> &point)
+	    {
+	        min_point = min(min_point, point);
+	        max_point = max(max_point, point);
+	    }
+	    void expand(const Bounds &other)
+	    {
+	        min_point = min(min_point, other.min_point);
+	        max_point = max(max_point, other.max_point);
+	    }
+	    rvec3<real> center() const { return (min_point + max_point) * (real)0.5; }
+	    bool empty() const { return min_point.x > max_point.x; }
+
+	    // Slab test, returns the distance along the ray the box is entered at
+	    bool intersect(const Ray<real> &ray, real t_max, real *t_near) const
+	    {
+	        real t0 = 0.0, t1 = t_max;
+	        for(GLint axis = 0; axis < 3; axis++)
+	        {
+	            real inv = 1 / ray.direction[axis];
+	            real near = (min_point[axis] - ray.origin[axis]) * inv;
+	            real far = (max_point[axis] - ray.origin[axis]) * inv;
+	            if(near > far) std::swap(near, far);
+	            t0 = near > t0 ? near : t0;
+	            t1 = far < t1 ? far : t1;
+	            if(t0 > t1)
+	                return false;
+	        }
+	        *t_near = t0;
+	        return true;
+	    }
+};
+
+#endif
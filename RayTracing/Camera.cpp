@@ -7,23 +7,135 @@
 #include "Camera.h"
 #include "Window.h"
 
-Camera::Camera(GLfloat fov_)
+#include <algorithm>
+
+Camera::Camera(GLdouble fov_, GLint frame_width_, GLint frame_height_)
 {
+	position = dvec3(0.0);
+	orientation = dmat3(1.0);
 	fov = radians(fov_);
+	frame_width = frame_width_;
+	frame_height = frame_height_;
+	set_crop(0, 0, frame_width, frame_height);
+}
+
+void Camera::set_crop(GLint x, GLint y, GLint width, GLint height)
+{
+	// Clipped to the frame, an empty window means the whole frame
+	crop_x = glm::clamp(x, 0, frame_width);
+	crop_y = glm::clamp(y, 0, frame_height);
+	crop_width = std::min(width, frame_width - crop_x);
+	crop_height = std::min(height, frame_height - crop_y);
+	if(crop_width <= 0 || crop_height <= 0)
+	{
+		crop_x = crop_y = 0;
+		crop_width = frame_width;
+		crop_height = frame_height;
+	}
 }
 
-vec2 Camera::normalize_pixel(GLint x, GLint y)
+// Distance in pixels to the image plane, from the horizontal field of view
+GLdouble Camera::focal_length() const
 {
-	return vec2((GLint)(x - (WINDOW_WIDTH/2)), (GLint)(y - (WINDOW_HEIGHT/2)));
+	return (frame_width/2)/tan(fov/2);
 }
 
-void Camera::generate_ray(GLuint x, GLuint y, Ray *ray)
+dvec2 Camera::normalize_pixel(GLint x, GLint y) const
 {
-	vec2 normalized_coords = normalize_pixel(x, y);
-	// Create ray, origin is always 0 for now
-	Ray r(vec3(0.0), normalize(vec3(normalized_coords, -1*((WINDOW_WIDTH/2)/tan(fov/2)))));
+	return dvec2((GLint)(crop_x + x - (frame_width/2)), (GLint)(crop_y + y - (frame_height/2)));
+}
+
+template<typename real>
+void Camera::generate_ray(GLuint x, GLuint y, Ray<real> *ray) const
+{
+	// In the scene's precision from the pose on, so a float scene's rays are
+	// what a float camera would make
+	rvec2<real> normalized_coords(normalize_pixel(x, y));
+	real focal = (real)(frame_width/2)/tan((real)fov/2);
+	Ray<real> r(rvec3<real>(position), rmat3<real>(orientation) * normalize(rvec3<real>(normalized_coords, -1*focal)));
+	// One pixel subtends about 1/focal radians
+	r.cone_spread = 1 / focal;
 	*ray = r;
 }
 
+template<typename real>
+void Camera::pixel_directions(rvec3<real> *corner, rvec3<real> *right, rvec3<real> *up) const
+{
+	rmat3<real> rotation(orientation);
+	real focal = (real)(frame_width/2)/tan((real)fov/2);
+	*corner = rotation * rvec3<real>(rvec2<real>(normalize_pixel(0, 0)), -1*focal);
+	*right = rotation[0];
+	*up = rotation[1];
+}
+
+bool Camera::project(const dvec3 &point, dvec2 *pixel) const
+{
+	// Into the camera's frame, the transpose undoes a rotation
+	dvec3 local = transpose(orientation) * (point - position);
+	if(local.z >= 0)
+		return false;
+	GLdouble focal = focal_length();
+	*pixel = dvec2(frame_width/2 - crop_x + focal * local.x / -local.z, frame_height/2 - crop_y + focal * local.y / -local.z);
+	return true;
+}
+
+bool Camera::same_view(const Camera &other) const
+{
+	return position == other.position && orientation[0] == other.orientation[0] && orientation[1] == other.orientation[1] &&
+	       orientation[2] == other.orientation[2] && fov == other.fov && frame_width == other.frame_width &&
+	       frame_height == other.frame_height && crop_x == other.crop_x && crop_y == other.crop_y &&
+	       crop_width == other.crop_width && crop_height == other.crop_height;
+}
+
+// Rotation by angle about a unit axis
+static dmat3 rotation(const dvec3 &axis, GLdouble angle)
+{
+	GLdouble c = cos(angle), s = sin(angle), t = 1 - c;
+	return dmat3(dvec3(t*axis.x*axis.x + c, t*axis.x*axis.y + s*axis.z, t*axis.x*axis.z - s*axis.y),
+	             dvec3(t*axis.x*axis.y - s*axis.z, t*axis.y*axis.y + c, t*axis.y*axis.z + s*axis.x),
+	             dvec3(t*axis.x*axis.z + s*axis.y, t*axis.y*axis.z - s*axis.x, t*axis.z*axis.z + c));
+}
+
+bool Camera::face(const dvec3 &direction)
+{
+	dvec3 back = -normalize(direction);
+	dvec3 right = cross(dvec3(0.0, 1.0, 0.0), back);
+	if(length(right) < 0.01)
+		return false;
+	right = normalize(right);
+	orientation = dmat3(right, cross(back, right), back);
+	return true;
+}
+
+void Camera::look_at(const dvec3 &eye, const dvec3 &target)
+{
+	position = eye;
+	face(target - eye);
+}
 
+void Camera::move(const dvec3 &offset)
+{
+	position += orientation * offset;
+}
+
+void Camera::turn(GLdouble yaw, GLdouble pitch)
+{
+	// Pitch stops short of the poles rather than flipping over them
+	dvec3 turned = rotation(dvec3(0.0, 1.0, 0.0), yaw) * rotation(orientation[0], pitch) * forward();
+	if(!face(turned))
+		face(rotation(dvec3(0.0, 1.0, 0.0), yaw) * forward());
+}
+
+void Camera::orbit(const dvec3 &target, GLdouble yaw, GLdouble pitch)
+{
+	dvec3 offset = position - target;
+	dvec3 swung = rotation(dvec3(0.0, 1.0, 0.0), yaw) * rotation(orientation[0], pitch) * offset;
+	if(length(cross(dvec3(0.0, 1.0, 0.0), normalize(swung))) < 0.01)
+		swung = rotation(dvec3(0.0, 1.0, 0.0), yaw) * offset;
+	look_at(target + swung, target);
+}
 
+template void Camera::generate_ray(GLuint x, GLuint y, Ray<GLfloat> *ray) const;
+template void Camera::generate_ray(GLuint x, GLuint y, Ray<GLdouble> *ray) const;
+template void Camera::pixel_directions<GLfloat>(vec3 *corner, vec3 *right, vec3 *up) const;
+template void Camera::pixel_directions<GLdouble>(dvec3 *corner, dvec3 *right, dvec3 *up) const;
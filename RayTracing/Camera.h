@@ -9,18 +9,60 @@
 
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
+#include "Precision.h"
 #include "Ray.h"
+#include "Window.h"
 
 using namespace glm;
 
 class Camera
 {
 	public:
-	    Camera(GLfloat fov_);
-	    void generate_ray(GLuint x, GLuint y, Ray *ray);
-	    GLfloat fov;
+	    // Horizontal field of view in degrees, frame size in pixels
+	    Camera(GLdouble fov_, GLint frame_width_ = WINDOW_WIDTH, GLint frame_height_ = WINDOW_HEIGHT);
+	    // Render only a window of the frame. Pixels passed to and from the
+	    // camera are then relative to the window's corner.
+	    void set_crop(GLint x, GLint y, GLint width, GLint height);
+	    // Size of the image rendered, the crop window if one is set
+	    GLint width() const { return crop_width; }
+	    GLint height() const { return crop_height; }
+	    bool cropped() const { return crop_width != frame_width || crop_height != frame_height; }
+	    // Rays come out in the precision of the scene they are traced in
+	    template<typename real>
+	    void generate_ray(GLuint x, GLuint y, Ray<real> *ray) const;
+	    // The ray through pixel (x, y) points along corner + x*right + y*up
+	    template<typename real>
+	    void pixel_directions(rvec3<real> *corner, rvec3<real> *right, rvec3<real> *up) const;
+	    // Pixel a point in front of the camera lands on, false if it is not
+	    // in front
+	    bool project(const dvec3 &point, dvec2 *pixel) const;
+	    // Whether both see the same pixels: pose, field of view and window
+	    bool same_view(const Camera &other) const;
+
+	    // Points the camera from eye towards target, keeping y up
+	    void look_at(const dvec3 &eye, const dvec3 &target);
+	    // Flying: move along the camera's own right, up and backward axes,
+	    // turn about the world's up and the camera's right axis, in radians
+	    void move(const dvec3 &offset);
+	    void turn(GLdouble yaw, GLdouble pitch);
+	    // Swings the camera around target, still facing it
+	    void orbit(const dvec3 &target, GLdouble yaw, GLdouble pitch);
+	    dvec3 forward() const { return -orientation[2]; }
+
+	    // Columns are the camera's right, up and backward axes in the world.
+	    // The default camera is at the origin looking down -z. Kept in double
+	    // whatever the scene's precision.
+	    dvec3 position;
+	    dmat3 orientation;
+	    GLdouble fov;
+	    GLint frame_width, frame_height;
+	    GLint crop_x, crop_y, crop_width, crop_height;
 	private:
-	    vec2 normalize_pixel(GLint x, GLint y);
+	    dvec2 normalize_pixel(GLint x, GLint y) const;
+	    GLdouble focal_length() const;
+	    // Orientation looking along direction, false if that is too close to
+	    // straight up or down to keep y up
+	    bool face(const dvec3 &direction);
 };
 
 #endif
@@ -0,0 +1,167 @@
+/*
+ * Checkpoint.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#include "Checkpoint.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CHECKPOINT_MAGIC "MJSCKPT1"
+// Framebuffer starts on its own page so it can be synced separately
+#define CHECKPOINT_DATA_OFFSET(tiles) (((sizeof(CheckpointHeader) + (tiles)) + 4095) / 4096 * 4096)
+
+struct CheckpointHeader
+{
+	char magic[8];
+	uint32_t width;
+	uint32_t height;
+	uint32_t tile_size;
+	uint32_t tile_count;
+	uint64_t scene_hash;
+};
+
+static GLdouble seconds_now()
+{
+	return chrono::duration<GLdouble>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Checkpoint::Checkpoint()
+: fd(-1), mapping(NULL), mapping_bytes(0), tile_count(0), flags(NULL), framebuffer(NULL), interval(0), last_sync(0)
+{
+}
+
+Checkpoint::~Checkpoint()
+{
+	close();
+}
+
+bool Checkpoint::open(const string &file, GLuint width_, GLuint height_, GLuint tile_size_, uint64_t scene_hash, GLdouble interval_)
+{
+	close();
+	filename = file;
+	interval = interval_;
+	GLuint tiles_x = (width_ + tile_size_ - 1) / tile_size_;
+	GLuint tiles_y = (height_ + tile_size_ - 1) / tile_size_;
+	tile_count = tiles_x * tiles_y;
+	size_t data_offset = CHECKPOINT_DATA_OFFSET(tile_count);
+	mapping_bytes = data_offset + (size_t)width_ * height_ * sizeof(vec3);
+
+	fd = ::open(file.c_str(), O_RDWR | O_CREAT, 0644);
+	if(fd < 0)
+	{
+		cout << "Checkpoint ERROR: Could not open " << file << endl;
+		return false;
+	}
+
+	// A journal for a different image or scene is started over
+	CheckpointHeader expected;
+	memcpy(expected.magic, CHECKPOINT_MAGIC, 8);
+	expected.width = width_;
+	expected.height = height_;
+	expected.tile_size = tile_size_;
+	expected.tile_count = tile_count;
+	expected.scene_hash = scene_hash;
+
+	CheckpointHeader found;
+	struct stat info;
+	bool resume = fstat(fd, &info) == 0 && (size_t)info.st_size == mapping_bytes &&
+	              pread(fd, &found, sizeof(found), 0) == sizeof(found) &&
+	              memcmp(&found, &expected, sizeof(found)) == 0;
+	if(!resume && (ftruncate(fd, 0) != 0 || ftruncate(fd, mapping_bytes) != 0))
+	{
+		cout << "Checkpoint ERROR: Could not size " << file << endl;
+		close();
+		return false;
+	}
+
+	void *map = mmap(NULL, mapping_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(map == MAP_FAILED)
+	{
+		cout << "Checkpoint ERROR: Could not map " << file << endl;
+		close();
+		return false;
+	}
+	mapping = (char *)map;
+	flags = (volatile uint8_t *)(mapping + sizeof(CheckpointHeader));
+	framebuffer = (vec3 *)(mapping + data_offset);
+	if(!resume)
+	{
+		memcpy(mapping, &expected, sizeof(expected));
+		msync(mapping, data_offset, MS_SYNC);
+	}
+	else
+	{
+		cout << "Checkpoint resuming " << file << " with " << tiles_done() << " of " << tile_count << " tiles done" << endl;
+	}
+	last_sync = seconds_now();
+	return true;
+}
+
+void Checkpoint::close()
+{
+	if(mapping)
+	{
+		flush();
+		munmap(mapping, mapping_bytes);
+	}
+	if(fd >= 0)
+		::close(fd);
+	fd = -1;
+	mapping = NULL;
+	flags = NULL;
+	framebuffer = NULL;
+	pending.clear();
+}
+
+void Checkpoint::discard()
+{
+	close();
+	if(!filename.empty())
+		unlink(filename.c_str());
+}
+
+GLuint Checkpoint::tiles_done() const
+{
+	GLuint count = 0;
+	for(GLuint i = 0; i < tile_count; i++)
+		count += flags[i] ? 1 : 0;
+	return count;
+}
+
+void Checkpoint::complete(GLuint tile)
+{
+	lock_guard<mutex> guard(journal_lock);
+	pending.push_back(tile);
+	if(seconds_now() - last_sync >= interval)
+		flush();
+}
+
+void Checkpoint::sync()
+{
+	lock_guard<mutex> guard(journal_lock);
+	flush();
+}
+
+// Pixels are written back before the flags that vouch for them, so a crash
+// between the two only loses tiles, never marks a half written one done
+void Checkpoint::flush()
+{
+	if(!mapping || pending.empty())
+		return;
+	size_t data_offset = (char *)framebuffer - mapping;
+	msync(mapping + data_offset, mapping_bytes - data_offset, MS_SYNC);
+	for(GLuint i = 0; i < pending.size(); i++)
+		flags[pending[i]] = 1;
+	msync(mapping, data_offset, MS_SYNC);
+	pending.clear();
+	last_sync = seconds_now();
+}
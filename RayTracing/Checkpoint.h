@@ -0,0 +1,55 @@
+/*
+ * Checkpoint.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <glm/glm.hpp>
+#include <GLFW/glfw3.h>
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+// Journal of a tiled render kept in a memory mapped file. The file holds a
+// header, a done flag per tile and the float framebuffer itself, so the
+// image buffer renders straight into the mapping and checkpointing is just
+// flushing it. A tile only counts as done once its pixels have been synced.
+class Checkpoint
+{
+	public:
+	    Checkpoint();
+	    ~Checkpoint();
+	    // Maps the journal, reusing it if it was written for the same render
+	    bool open(const string &file, GLuint width_, GLuint height_, GLuint tile_size_, uint64_t scene_hash, GLdouble interval_);
+	    void close();
+	    // Removes the journal once the finished image has been saved elsewhere
+	    void discard();
+	    vec3 *pixels() const { return framebuffer; }
+	    bool done(GLuint tile) const { return flags[tile] != 0; }
+	    GLuint tiles_done() const;
+	    // Records a finished tile, syncing if the interval has passed
+	    void complete(GLuint tile);
+	    void sync();
+	private:
+	    string filename;
+	    int fd;
+	    char *mapping;
+	    size_t mapping_bytes;
+	    GLuint tile_count;
+	    volatile uint8_t *flags;
+	    vec3 *framebuffer;
+	    GLdouble interval;
+	    GLdouble last_sync;
+	    vector<GLuint> pending;
+	    mutex journal_lock;
+	    void flush();
+};
+
+#endif
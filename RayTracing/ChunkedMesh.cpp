@@ -0,0 +1,475 @@
+/*
+ * ChunkedMesh.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#include "ChunkedMesh.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// On disk layout: header, chunk table, then one payload per chunk holding
+// its cluster table followed by its triangles. Payloads start on 64KB
+// boundaries so they can be mapped on any page size we are likely to meet.
+#define MESH_MAGIC "MJSMESH1"
+#define MESH_ALIGNMENT 65536
+#define CLUSTER_TRIANGLES 64
+
+struct MeshHeader
+{
+	char magic[8];
+	uint32_t chunk_count;
+	uint32_t cluster_triangles;
+	uint64_t triangle_count;
+};
+
+struct ChunkRecord
+{
+	float min_point[3];
+	float max_point[3];
+	uint64_t offset;
+	uint64_t bytes;
+	uint32_t triangle_count;
+	uint32_t cluster_count;
+};
+
+struct ClusterRecord
+{
+	float min_point[3];
+	float max_point[3];
+	uint32_t first;
+	uint32_t count;
+};
+
+struct PackedTriangle
+{
+	float p[9];
+	template<typename real>
+	rvec3<real> vertex(GLuint i) const { return rvec3<real>(p[i*3], p[i*3 + 1], p[i*3 + 2]); }
+};
+
+template<typename real>
+ChunkedMesh<real>::ChunkedMesh(const string &mesh_file, size_t budget_bytes_, vec3 diffuse_colour_, vec3 specular_colour_, GLfloat phong_exponent_, GLfloat reflectance_)
+: Object<real>(diffuse_colour_, specular_colour_, phong_exponent_, reflectance_)
+{
+	budget_bytes = budget_bytes_;
+	resident = 0;
+	transformed = false;
+	rotation = rmat3<real>(1.0);
+
+	fd = open(mesh_file.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		cout << "ChunkedMesh ERROR: Could not open " << mesh_file << endl;
+		return;
+	}
+
+	MeshHeader header;
+	if(pread(fd, &header, sizeof(header), 0) != sizeof(header) || memcmp(header.magic, MESH_MAGIC, 8) != 0)
+	{
+		cout << "ChunkedMesh ERROR: " << mesh_file << " is not a packed mesh" << endl;
+		close(fd);
+		fd = -1;
+		return;
+	}
+
+	vector<ChunkRecord> records(header.chunk_count);
+	size_t table_bytes = records.size() * sizeof(ChunkRecord);
+	if(table_bytes > 0 && pread(fd, &records[0], table_bytes, sizeof(header)) != (ssize_t)table_bytes)
+	{
+		cout << "ChunkedMesh ERROR: Truncated chunk table in " << mesh_file << endl;
+		close(fd);
+		fd = -1;
+		return;
+	}
+
+	chunks.resize(records.size());
+	for(GLuint i = 0; i < records.size(); i++)
+	{
+		chunks[i].bounds = Bounds<real>(rvec3<real>(records[i].min_point[0], records[i].min_point[1], records[i].min_point[2]),
+		                          rvec3<real>(records[i].max_point[0], records[i].max_point[1], records[i].max_point[2]));
+		chunks[i].offset = records[i].offset;
+		chunks[i].bytes = records[i].bytes;
+		chunks[i].triangle_count = records[i].triangle_count;
+		chunks[i].cluster_count = records[i].cluster_count;
+		chunks[i].mapping = NULL;
+		chunks[i].pins = 0;
+		rest_bounds.expand(chunks[i].bounds);
+	}
+}
+
+template<typename real>
+Bounds<real> ChunkedMesh<real>::bounds()
+{
+	if(!transformed)
+		return rest_bounds;
+
+	// Box around the moved corners of the rest box
+	Bounds<real> moved;
+	rvec3<real> pivot = rest_bounds.center();
+	for(GLuint corner = 0; corner < 8; corner++)
+	{
+		rvec3<real> p((corner & 1) ? rest_bounds.max_point.x : rest_bounds.min_point.x,
+		       (corner & 2) ? rest_bounds.max_point.y : rest_bounds.min_point.y,
+		       (corner & 4) ? rest_bounds.max_point.z : rest_bounds.min_point.z);
+		moved.expand(rotation * (p - pivot) + pivot + translation);
+	}
+	return moved;
+}
+
+template<typename real>
+void ChunkedMesh<real>::transform(const rmat3<real> &rotation_, const rvec3<real> &translation_)
+{
+	rotation = rotation_;
+	translation = translation_;
+	transformed = true;
+}
+
+template<typename real>
+ChunkedMesh<real>::~ChunkedMesh()
+{
+	for(GLuint i = 0; i < chunks.size(); i++)
+	{
+		if(chunks[i].mapping)
+			munmap((void *)chunks[i].mapping, chunks[i].bytes);
+	}
+	if(fd >= 0)
+		close(fd);
+}
+
+template<typename real>
+size_t ChunkedMesh<real>::resident_bytes()
+{
+	lock_guard<mutex> guard(cache_lock);
+	return resident;
+}
+
+// Pins a chunk in memory, paging it in if it is cold. Without page_in a
+// cold chunk is left alone and NULL returned; whether it is resident is
+// only known under the lock, as another thread may be evicting it.
+template<typename real>
+const char *ChunkedMesh<real>::acquire(GLuint chunk_index, bool page_in)
+{
+	lock_guard<mutex> guard(cache_lock);
+	Chunk &chunk = chunks[chunk_index];
+	if(chunk.mapping)
+	{
+		lru.splice(lru.begin(), lru, chunk.lru_position);
+	}
+	else if(!page_in)
+	{
+		return NULL;
+	}
+	else
+	{
+		evict(chunk.bytes);
+		void *mapping = mmap(NULL, chunk.bytes, PROT_READ, MAP_PRIVATE, fd, chunk.offset);
+		if(mapping == MAP_FAILED)
+			return NULL;
+		madvise(mapping, chunk.bytes, MADV_WILLNEED);
+		chunk.mapping = (const char *)mapping;
+		resident += chunk.bytes;
+		lru.push_front(chunk_index);
+		chunk.lru_position = lru.begin();
+	}
+	chunk.pins++;
+	return chunk.mapping;
+}
+
+template<typename real>
+void ChunkedMesh<real>::release(GLuint chunk_index)
+{
+	lock_guard<mutex> guard(cache_lock);
+	chunks[chunk_index].pins--;
+}
+
+// Unmaps least recently used chunks until the incoming one fits the budget.
+// Chunks pinned by an in-flight ray are skipped, so the budget is soft while
+// every resident chunk is in use.
+template<typename real>
+void ChunkedMesh<real>::evict(size_t incoming_bytes)
+{
+	list<GLuint>::iterator it = lru.end();
+	while(resident + incoming_bytes > budget_bytes && it != lru.begin())
+	{
+		--it;
+		Chunk &victim = chunks[*it];
+		if(victim.pins > 0)
+			continue;
+		munmap((void *)victim.mapping, victim.bytes);
+		victim.mapping = NULL;
+		resident -= victim.bytes;
+		it = lru.erase(it);
+	}
+}
+
+template<typename real>
+bool ChunkedMesh<real>::intersect_chunk(const char *mapping, const Chunk &chunk, const Ray<real> &ray, real *min_t_val, rvec3<real> *hit_normal)
+{
+	const ClusterRecord *clusters = (const ClusterRecord *)mapping;
+	const PackedTriangle *triangles = (const PackedTriangle *)(mapping + chunk.cluster_count * sizeof(ClusterRecord));
+	bool hit = false;
+	real t_near, t_val;
+
+	for(GLuint c = 0; c < chunk.cluster_count; c++)
+	{
+		Bounds<real> bounds(rvec3<real>(clusters[c].min_point[0], clusters[c].min_point[1], clusters[c].min_point[2]),
+		              rvec3<real>(clusters[c].max_point[0], clusters[c].max_point[1], clusters[c].max_point[2]));
+		if(!bounds.intersect(ray, *min_t_val, &t_near))
+			continue;
+
+		for(GLuint i = clusters[c].first; i < clusters[c].first + clusters[c].count; i++)
+		{
+			const PackedTriangle &tri = triangles[i];
+			if(intersect_triangle(tri.vertex<real>(0), tri.vertex<real>(1), tri.vertex<real>(2), ray, &t_val))
+			{
+				if(t_val < *min_t_val && t_val > std::numeric_limits<real>::epsilon())
+				{
+					*min_t_val = t_val;
+					*hit_normal = normalize(cross(tri.vertex<real>(0) - tri.vertex<real>(1), tri.vertex<real>(1) - tri.vertex<real>(2)));
+					hit = true;
+				}
+			}
+		}
+	}
+	return hit;
+}
+
+template<typename real>
+bool ChunkedMesh<real>::intersect(const Ray<real> &world_ray, rvec3<real> *point, real *t_val, rvec3<real> *normal)
+{
+	if(fd < 0)
+		return false;
+
+	// A rigid transform keeps distances, so t is the same in both frames
+	Ray<real> ray = world_ray;
+	rvec3<real> pivot = rest_bounds.center();
+	if(transformed)
+	{
+		rmat3<real> inverse = transpose(rotation);
+		ray.origin = inverse * (world_ray.origin - pivot - translation) + pivot;
+		ray.direction = inverse * world_ray.direction;
+	}
+
+	// Collect the chunks the ray passes through, nearest first
+	vector<pair<real, GLuint> > candidates;
+	real t_near;
+	for(GLuint i = 0; i < chunks.size(); i++)
+	{
+		if(chunks[i].bounds.intersect(ray, 1E6, &t_near))
+			candidates.push_back(make_pair(t_near, i));
+	}
+	sort(candidates.begin(), candidates.end());
+
+	// Test chunks that are already resident first. The hit they give bounds
+	// the search, so cold chunks further away than it never get paged in.
+	real min_t_val = 1E6;
+	rvec3<real> hit_normal;
+	bool hit = false;
+	vector<bool> tested(candidates.size(), false);
+	for(GLuint pass = 0; pass < 2; pass++)
+	{
+		for(GLuint i = 0; i < candidates.size(); i++)
+		{
+			if(candidates[i].first >= min_t_val)
+				break;
+			GLuint index = candidates[i].second;
+			if(tested[i])
+				continue;
+			const char *mapping = acquire(index, pass == 1);
+			if(!mapping && pass == 0)
+				continue;
+			tested[i] = true;
+			if(!mapping)
+				continue;
+			if(intersect_chunk(mapping, chunks[index], ray, &min_t_val, &hit_normal))
+				hit = true;
+			release(index);
+		}
+	}
+
+	if(!hit)
+		return false;
+
+	*t_val = min_t_val;
+	*point = (*t_val * world_ray.direction) + world_ray.origin;
+	if(normal)
+		*normal = transformed ? rotation * hit_normal : hit_normal;
+	return true;
+}
+
+// --------------------------------------------------------------------------
+// Packing
+
+// Orders triangles[begin, end) by recursive median splits along the longest
+// axis of their centroids, recording each leaf range of at most leaf_size.
+// An empty range has no leaves, so no chunk or cluster is ever empty.
+static void cluster_triangles(vector<PackedTriangle> &triangles, size_t begin, size_t end, size_t leaf_size, vector<pair<size_t, size_t> > *leaves)
+{
+	if(end == begin)
+		return;
+	if(end - begin <= leaf_size)
+	{
+		leaves->push_back(make_pair(begin, end));
+		return;
+	}
+
+	Bounds<GLfloat> centroids;
+	for(size_t i = begin; i < end; i++)
+		centroids.expand((triangles[i].vertex<GLfloat>(0) + triangles[i].vertex<GLfloat>(1) + triangles[i].vertex<GLfloat>(2)) / (GLfloat)3);
+	vec3 extent = centroids.max_point - centroids.min_point;
+	GLint axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+
+	size_t middle = begin + (end - begin) / 2;
+	nth_element(triangles.begin() + begin, triangles.begin() + middle, triangles.begin() + end,
+	            [axis](const PackedTriangle &a, const PackedTriangle &b)
+	            {
+	                return (a.p[axis] + a.p[axis + 3] + a.p[axis + 6]) < (b.p[axis] + b.p[axis + 3] + b.p[axis + 6]);
+	            });
+	cluster_triangles(triangles, begin, middle, leaf_size, leaves);
+	cluster_triangles(triangles, middle, end, leaf_size, leaves);
+}
+
+static Bounds<GLfloat> triangle_bounds(const vector<PackedTriangle> &triangles, size_t begin, size_t end)
+{
+	Bounds<GLfloat> bounds;
+	for(size_t i = begin; i < end; i++)
+		for(GLuint v = 0; v < 3; v++)
+			bounds.expand(triangles[i].vertex<GLfloat>(v));
+	return bounds;
+}
+
+// Reads "v" and "f" records of an OBJ file, polygons are fanned into triangles
+static bool read_obj(const string &obj_file, vector<PackedTriangle> *triangles)
+{
+	ifstream input(obj_file.c_str());
+	if(!input)
+		return false;
+
+	vector<vec3> vertices;
+	string line;
+	while(getline(input, line))
+	{
+		istringstream tokens(line);
+		string type;
+		tokens >> type;
+		if(type == "v")
+		{
+			vec3 v;
+			tokens >> v.x >> v.y >> v.z;
+			vertices.push_back(v);
+		}
+		else if(type == "f")
+		{
+			vector<GLint> face;
+			string corner;
+			while(tokens >> corner)
+			{
+				GLint index = atoi(corner.c_str());
+				face.push_back(index < 0 ? (GLint)vertices.size() + index : index - 1);
+			}
+			for(GLuint i = 2; i < face.size(); i++)
+			{
+				GLint corners[3] = { face[0], face[i - 1], face[i] };
+				PackedTriangle tri;
+				for(GLuint c = 0; c < 3; c++)
+				{
+					if(corners[c] < 0 || corners[c] >= (GLint)vertices.size())
+						return false;
+					tri.p[c*3] = vertices[corners[c]].x;
+					tri.p[c*3 + 1] = vertices[corners[c]].y;
+					tri.p[c*3 + 2] = vertices[corners[c]].z;
+				}
+				triangles->push_back(tri);
+			}
+		}
+	}
+	return true;
+}
+
+bool pack_chunked_mesh(const string &obj_file, const string &mesh_file, GLuint chunk_triangles)
+{
+	vector<PackedTriangle> triangles;
+	if(!read_obj(obj_file, &triangles))
+	{
+		cout << "ChunkedMesh ERROR: Could not read " << obj_file << endl;
+		return false;
+	}
+
+	vector<pair<size_t, size_t> > chunk_ranges;
+	cluster_triangles(triangles, 0, triangles.size(), std::max(chunk_triangles, (GLuint)CLUSTER_TRIANGLES), &chunk_ranges);
+
+	MeshHeader header;
+	memcpy(header.magic, MESH_MAGIC, 8);
+	header.chunk_count = chunk_ranges.size();
+	header.cluster_triangles = CLUSTER_TRIANGLES;
+	header.triangle_count = triangles.size();
+
+	vector<ChunkRecord> records(chunk_ranges.size());
+	vector<vector<ClusterRecord> > clusters(chunk_ranges.size());
+	uint64_t offset = sizeof(MeshHeader) + records.size() * sizeof(ChunkRecord);
+	for(GLuint i = 0; i < chunk_ranges.size(); i++)
+	{
+		size_t begin = chunk_ranges[i].first, end = chunk_ranges[i].second;
+		vector<pair<size_t, size_t> > cluster_ranges;
+		cluster_triangles(triangles, begin, end, CLUSTER_TRIANGLES, &cluster_ranges);
+
+		for(GLuint c = 0; c < cluster_ranges.size(); c++)
+		{
+			Bounds<GLfloat> bounds = triangle_bounds(triangles, cluster_ranges[c].first, cluster_ranges[c].second);
+			ClusterRecord cluster;
+			for(GLuint a = 0; a < 3; a++)
+			{
+				cluster.min_point[a] = bounds.min_point[a];
+				cluster.max_point[a] = bounds.max_point[a];
+			}
+			cluster.first = cluster_ranges[c].first - begin;
+			cluster.count = cluster_ranges[c].second - cluster_ranges[c].first;
+			clusters[i].push_back(cluster);
+		}
+
+		Bounds<GLfloat> bounds = triangle_bounds(triangles, begin, end);
+		for(GLuint a = 0; a < 3; a++)
+		{
+			records[i].min_point[a] = bounds.min_point[a];
+			records[i].max_point[a] = bounds.max_point[a];
+		}
+		offset = (offset + MESH_ALIGNMENT - 1) / MESH_ALIGNMENT * MESH_ALIGNMENT;
+		records[i].offset = offset;
+		records[i].bytes = clusters[i].size() * sizeof(ClusterRecord) + (end - begin) * sizeof(PackedTriangle);
+		records[i].triangle_count = end - begin;
+		records[i].cluster_count = clusters[i].size();
+		offset += records[i].bytes;
+	}
+
+	ofstream output(mesh_file.c_str(), ios::binary | ios::trunc);
+	if(!output)
+	{
+		cout << "ChunkedMesh ERROR: Could not write " << mesh_file << endl;
+		return false;
+	}
+	output.write((const char *)&header, sizeof(header));
+	if(!records.empty())
+		output.write((const char *)&records[0], records.size() * sizeof(ChunkRecord));
+	for(GLuint i = 0; i < records.size(); i++)
+	{
+		output.seekp(records[i].offset);
+		output.write((const char *)clusters[i].data(), clusters[i].size() * sizeof(ClusterRecord));
+		output.write((const char *)(triangles.data() + chunk_ranges[i].first), records[i].triangle_count * sizeof(PackedTriangle));
+	}
+
+	cout << "ChunkedMesh packed " << triangles.size() << " triangles into " << records.size() << " chunks" << endl;
+	return output.good();
+}
+
+template class ChunkedMesh<GLfloat>;
+template class ChunkedMesh<GLdouble>;
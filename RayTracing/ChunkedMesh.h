@@ -0,0 +1,76 @@
+/*
+ * ChunkedMesh.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#ifndef CHUNKEDMESH_H
+#define CHUNKEDMESH_H
+
+#include <glm/glm.hpp>
+#include <GLFW/glfw3.h>
+#include <stdint.h>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Bounds.h"
+#include "Precision.h"
+#include "Primitives.h"
+#include "Ray.h"
+
+using namespace std;
+using namespace glm;
+
+// Triangle mesh that lives in a packed file on disk instead of in memory.
+// The file is split into spatially clustered chunks which are memory mapped
+// on demand and unmapped least-recently-used first once the resident size
+// goes over the memory budget. Only the chunk table is always resident.
+template<typename real>
+class ChunkedMesh : public Object<real>
+{
+	public:
+	    ChunkedMesh(const string &mesh_file, size_t budget_bytes_, vec3 diffuse_colour_, vec3 specular_colour_, GLfloat phong_exponent_, GLfloat reflectance_);
+	    ~ChunkedMesh();
+	    bool intersect(const Ray<real> &ray, rvec3<real> *point, real *t_val, rvec3<real> *normal);
+	    Bounds<real> bounds();
+	    // The packed triangles never move, rays are taken into their frame
+	    void transform(const rmat3<real> &rotation_, const rvec3<real> &translation_);
+	    bool loaded() const { return fd >= 0; }
+	    size_t resident_bytes();
+
+	private:
+	    struct Chunk
+	    {
+	        Bounds<real> bounds;
+	        uint64_t offset;
+	        uint64_t bytes;
+	        uint32_t triangle_count;
+	        uint32_t cluster_count;
+	        const char *mapping;
+	        GLuint pins;
+	        list<GLuint>::iterator lru_position;
+	    };
+	    const char *acquire(GLuint chunk_index, bool page_in);
+	    void release(GLuint chunk_index);
+	    void evict(size_t incoming_bytes);
+	    bool intersect_chunk(const char *mapping, const Chunk &chunk, const Ray<real> &ray, real *min_t_val, rvec3<real> *hit_normal);
+
+	    int fd;
+	    size_t budget_bytes;
+	    size_t resident;
+	    vector<Chunk> chunks;
+	    list<GLuint> lru;
+	    mutex cache_lock;
+	    Bounds<real> rest_bounds;
+	    bool transformed;
+	    rmat3<real> rotation;
+	    rvec3<real> translation;
+};
+
+// Converts the triangles of an OBJ file into a packed chunk file, which
+// meshes of either precision read
+bool pack_chunked_mesh(const string &obj_file, const string &mesh_file, GLuint chunk_triangles);
+
+#endif
@@ -0,0 +1,326 @@
+/*
+ * Coordinator.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#include "Coordinator.h"
+#include "Scene.h"
+
+#include <stdint.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// How many tiles each worker holds at once, so it never sits idle waiting
+// for its next tile to arrive
+#define TILES_IN_FLIGHT 2
+
+enum MessageType
+{
+	MSG_SCENE = 1,
+	MSG_TILE,
+	MSG_RESULT,
+	MSG_QUIT,
+	MSG_TIME
+};
+
+// Every message is a header followed by length bytes of payload
+struct MessageHeader
+{
+	uint32_t type;
+	uint32_t tile;
+	uint32_t length;
+};
+
+// Flags of a scene message
+#define SCENE_CLAMP 1
+#define SCENE_DOUBLE 2
+
+// Camera as sent to workers, which may differ from the scene text's
+struct CameraRecord
+{
+	float fov;
+	int32_t frame_width, frame_height;
+	int32_t crop_x, crop_y, crop_width, crop_height;
+	double position[3];
+	double orientation[9];
+};
+
+static bool write_all(int fd, const void *data, size_t bytes)
+{
+	const char *p = (const char *)data;
+	while(bytes > 0)
+	{
+		// A dead reader must show up as an error here, not kill us with SIGPIPE
+		ssize_t n = send(fd, p, bytes, MSG_NOSIGNAL);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return false;
+		p += n;
+		bytes -= n;
+	}
+	return true;
+}
+
+static bool read_all(int fd, void *data, size_t bytes)
+{
+	char *p = (char *)data;
+	while(bytes > 0)
+	{
+		ssize_t n = read(fd, p, bytes);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return false;
+		p += n;
+		bytes -= n;
+	}
+	return true;
+}
+
+static bool send_message(int fd, uint32_t type, uint32_t tile, const void *payload, uint32_t length)
+{
+	MessageHeader header = { type, tile, length };
+	return write_all(fd, &header, sizeof(header)) && (length == 0 || write_all(fd, payload, length));
+}
+
+Coordinator::Coordinator()
+: camera(50)
+{
+}
+
+Coordinator::~Coordinator()
+{
+	stop();
+}
+
+bool Coordinator::start(GLuint worker_count, const string &scene_text, bool clamp_colours, bool double_precision, const Camera &camera_)
+{
+	stop();
+	camera = camera_;
+
+	// Scene message payload is a flags byte, the camera, then the scene text.
+	// Workers trace in the coordinator's precision, so their tiles match its.
+	CameraRecord record = { (float)degrees(camera.fov), camera.frame_width, camera.frame_height,
+	                        camera.crop_x, camera.crop_y, camera.crop_width, camera.crop_height, {}, {} };
+	for(GLuint i = 0; i < 3; i++)
+		record.position[i] = camera.position[i];
+	for(GLuint i = 0; i < 9; i++)
+		record.orientation[i] = camera.orientation[i / 3][i % 3];
+	string payload(1, (clamp_colours ? SCENE_CLAMP : 0) | (double_precision ? SCENE_DOUBLE : 0));
+	payload.append((const char *)&record, sizeof(record));
+	payload += scene_text;
+
+	for(GLuint i = 0; i < worker_count; i++)
+	{
+		int fds[2];
+		if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0)
+		{
+			cout << "Coordinator ERROR: Could not create worker socket" << endl;
+			break;
+		}
+
+		// Only async-signal-safe calls between fork and exec
+		string fd_arg = to_string(fds[1]);
+		pid_t pid = fork();
+		if(pid == 0)
+		{
+			fcntl(fds[1], F_SETFD, 0);
+			execl("/proc/self/exe", "ray_tracer", "--worker", fd_arg.c_str(), (char *)NULL);
+			_exit(127);
+		}
+		close(fds[1]);
+		if(pid < 0)
+		{
+			cout << "Coordinator ERROR: Could not start worker" << endl;
+			close(fds[0]);
+			break;
+		}
+
+		Worker worker;
+		worker.pid = pid;
+		worker.fd = fds[0];
+		workers.push_back(worker);
+		if(!send_message(worker.fd, MSG_SCENE, 0, payload.data(), payload.size()))
+			lose_worker(workers.back(), NULL);
+	}
+
+	cout << "Coordinator started " << live_workers() << " workers" << endl;
+	return live_workers() > 0;
+}
+
+void Coordinator::stop()
+{
+	for(GLuint i = 0; i < workers.size(); i++)
+	{
+		if(workers[i].fd < 0)
+			continue;
+		send_message(workers[i].fd, MSG_QUIT, 0, NULL, 0);
+		close(workers[i].fd);
+		waitpid(workers[i].pid, NULL, 0);
+	}
+	workers.clear();
+}
+
+void Coordinator::set_time(GLfloat time)
+{
+	// Between frames no tiles are out, so a lost worker has none to give back
+	for(GLuint i = 0; i < workers.size(); i++)
+	{
+		if(workers[i].fd >= 0 && !send_message(workers[i].fd, MSG_TIME, 0, &time, sizeof(time)))
+			lose_worker(workers[i], NULL);
+	}
+}
+
+GLuint Coordinator::live_workers() const
+{
+	GLuint count = 0;
+	for(GLuint i = 0; i < workers.size(); i++)
+		count += (workers[i].fd >= 0) ? 1 : 0;
+	return count;
+}
+
+// Gives a dead or misbehaving worker's tiles back to the queue
+void Coordinator::lose_worker(Worker &worker, deque<GLuint> *queue)
+{
+	cout << "Coordinator lost worker " << worker.pid << ", reassigning " << worker.in_flight.size() << " tiles" << endl;
+	close(worker.fd);
+	kill(worker.pid, SIGKILL);
+	waitpid(worker.pid, NULL, 0);
+	worker.fd = -1;
+	if(queue)
+		queue->insert(queue->begin(), worker.in_flight.begin(), worker.in_flight.end());
+	worker.in_flight.clear();
+}
+
+vector<GLuint> Coordinator::render(const vector<GLuint> &tiles, const function<void(GLuint, const vec3 *)> &done)
+{
+	deque<GLuint> queue(tiles.begin(), tiles.end());
+	size_t remaining = tiles.size();
+	vector<vec3> colours(TILE_SIZE * TILE_SIZE);
+	vector<pollfd> fds;
+	vector<GLuint> owners;
+
+	while(remaining > 0)
+	{
+		// Top every live worker up to its share of tiles
+		fds.clear();
+		owners.clear();
+		for(GLuint i = 0; i < workers.size(); i++)
+		{
+			Worker &worker = workers[i];
+			while(worker.fd >= 0 && worker.in_flight.size() < TILES_IN_FLIGHT && !queue.empty())
+			{
+				GLuint tile = queue.front();
+				queue.pop_front();
+				worker.in_flight.push_back(tile);
+				if(!send_message(worker.fd, MSG_TILE, tile, NULL, 0))
+					lose_worker(worker, &queue);
+			}
+			if(worker.fd >= 0 && !worker.in_flight.empty())
+			{
+				pollfd entry = { worker.fd, POLLIN, 0 };
+				fds.push_back(entry);
+				owners.push_back(i);
+			}
+		}
+		if(fds.empty())
+			break;
+
+		if(poll(&fds[0], fds.size(), -1) < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+
+		for(GLuint i = 0; i < fds.size(); i++)
+		{
+			if(!fds[i].revents)
+				continue;
+			Worker &worker = workers[owners[i]];
+
+			// Results come back in the order the tiles were sent
+			MessageHeader header;
+			GLint x0, y0, w, h;
+			bool ok = read_all(worker.fd, &header, sizeof(header)) && header.type == MSG_RESULT &&
+			          header.tile == worker.in_flight.front();
+			if(ok)
+			{
+				Scene::tile_rect(camera, header.tile, &x0, &y0, &w, &h);
+				ok = header.length == w * h * sizeof(vec3) && read_all(worker.fd, &colours[0], header.length);
+			}
+			if(!ok)
+			{
+				lose_worker(worker, &queue);
+				continue;
+			}
+
+			worker.in_flight.pop_front();
+			done(header.tile, &colours[0]);
+			remaining--;
+		}
+	}
+
+	return vector<GLuint>(queue.begin(), queue.end());
+}
+
+int Coordinator::run_worker(int fd)
+{
+	Scene scene(true);
+	vector<vec3> colours(TILE_SIZE * TILE_SIZE);
+	MessageHeader header;
+
+	while(read_all(fd, &header, sizeof(header)))
+	{
+		if(header.type == MSG_SCENE)
+		{
+			string payload(header.length, '\0');
+			CameraRecord record;
+			if(header.length < 1 + sizeof(record) || !read_all(fd, &payload[0], header.length))
+				return -1;
+			if(!(payload[0] & SCENE_CLAMP))
+				scene.enable_hdr_output(false);
+			scene.set_precision(payload[0] & SCENE_DOUBLE ? PRECISION_DOUBLE : PRECISION_FLOAT);
+			memcpy(&record, &payload[1], sizeof(record));
+			scene.parse_text(payload.substr(1 + sizeof(record)));
+			scene.set_resolution(record.frame_width, record.frame_height);
+			scene.set_fov(record.fov);
+			scene.set_crop(record.crop_x, record.crop_y, record.crop_width, record.crop_height);
+			dmat3 orientation(1.0);
+			for(GLuint i = 0; i < 9; i++)
+				orientation[i / 3][i % 3] = record.orientation[i];
+			scene.set_pose(dvec3(record.position[0], record.position[1], record.position[2]), orientation);
+		}
+		else if(header.type == MSG_TIME)
+		{
+			GLfloat time;
+			if(header.length != sizeof(time) || !read_all(fd, &time, sizeof(time)))
+				return -1;
+			scene.set_time(time);
+		}
+		else if(header.type == MSG_TILE)
+		{
+			GLint x0, y0, w, h;
+			scene.tile_rect(header.tile, &x0, &y0, &w, &h);
+			scene.trace_tile(header.tile, &colours[0]);
+			if(!send_message(fd, MSG_RESULT, header.tile, &colours[0], w * h * sizeof(vec3)))
+				return -1;
+		}
+		else
+		{
+			break;
+		}
+	}
+	close(fd);
+	return 0;
+}
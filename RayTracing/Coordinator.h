@@ -0,0 +1,59 @@
+/*
+ * Coordinator.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#ifndef COORDINATOR_H
+#define COORDINATOR_H
+
+#include <glm/glm.hpp>
+#include <GLFW/glfw3.h>
+#include <sys/types.h>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Camera.h"
+
+using namespace std;
+using namespace glm;
+
+// Farms the tiles of a frame out to local worker processes. Workers are
+// this same executable started with --worker, each talking to us over its
+// own socket. The scene text and camera are shipped once when the workers start; after
+// that only tile numbers and frame times go out and finished pixels come back.
+class Coordinator
+{
+	public:
+	    Coordinator();
+	    ~Coordinator();
+	    bool start(GLuint worker_count, const string &scene_text, bool clamp_colours, bool double_precision, const Camera &camera_);
+	    void stop();
+	    // Moves every worker's scene to a new animation time
+	    void set_time(GLfloat time);
+	    GLuint live_workers() const;
+	    // Renders tiles on the workers, calling done for each one as it comes
+	    // back. Tiles held by a worker that dies are handed to another one.
+	    // Returns the tiles that could not be rendered because every worker
+	    // was lost.
+	    vector<GLuint> render(const vector<GLuint> &tiles, const function<void(GLuint, const vec3 *)> &done);
+
+	    // Entry point of a worker process, serves requests on fd until told
+	    // to quit or the coordinator goes away
+	    static int run_worker(int fd);
+	private:
+	    struct Worker
+	    {
+	        pid_t pid;
+	        int fd;
+	        deque<GLuint> in_flight;
+	    };
+	    vector<Worker> workers;
+	    // What the workers render through, tiles are cut from its image
+	    Camera camera;
+	    void lose_worker(Worker &worker, deque<GLuint> *queue);
+};
+
+#endif
@@ -0,0 +1,352 @@
+/*
+ * Denoiser.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#include "Denoiser.h"
+#include "Parallel.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define DENOISE_PASSES 5
+
+// Zeroed columns either side of every row, as far as the widest pass reaches,
+// so a vector of taps can be loaded anywhere along a row
+#define DENOISE_BORDER (2 << (DENOISE_PASSES - 1))
+
+// Edge stopping strengths, larger is stricter. Depth is relative to the
+// centre pixel's depth; the colour strength is tightened every pass since
+// what noise is left keeps getting smaller.
+#define COLOUR_WEIGHT 4.0f
+#define ALBEDO_WEIGHT 50.0f
+#define NORMAL_WEIGHT 10.0f
+#define DEPTH_WEIGHT 400.0f
+
+static const GLfloat kernel[5] = { 1.0f/16, 1.0f/4, 3.0f/8, 1.0f/4, 1.0f/16 };
+
+// exp(-x) for x >= 0 as (1 - x/256)^256, only multiplies so it vectorizes.
+// Past FALLOFF_CUTOFF it is taken as 0, before the squares turn denormal,
+// which multiply many times slower.
+#define FALLOFF_CUTOFF 64.0f
+
+static inline GLfloat falloff(GLfloat x)
+{
+	GLfloat y = (x < FALLOFF_CUTOFF) ? 1.0f - x * (1.0f/256) : 0.0f;
+	y *= y; y *= y; y *= y; y *= y;
+	y *= y; y *= y; y *= y; y *= y;
+	return y;
+}
+
+Denoiser::Denoiser()
+: width(0), height(0), stride(0)
+{
+}
+
+inline GLint Denoiser::index(GLint x, GLint y) const
+{
+	return y*stride + DENOISE_BORDER + x;
+}
+
+void Denoiser::resize(GLint width_, GLint height_)
+{
+	width = width_;
+	height = height_;
+	stride = width + 2*DENOISE_BORDER;
+	size_t count = (size_t)stride * height;
+	for(GLuint c = 0; c < 3; c++)
+	{
+		albedo[c].assign(count, 0.0f);
+		normal[c].assign(count, 0.0f);
+		colour[c].assign(count, 0.0f);
+		filtered[c].assign(count, 0.0f);
+	}
+	depth.assign(count, 0.0f);
+}
+
+void Denoiser::set_features(GLint x, GLint y, const vec3 &albedo_, const vec3 &normal_, GLfloat depth_)
+{
+	GLint p = index(x, y);
+	for(GLuint c = 0; c < 3; c++)
+	{
+		albedo[c][p] = albedo_[c];
+		normal[c][p] = normal_[c];
+	}
+	depth[p] = depth_;
+}
+
+// Taps falling off the image are left out, the weights are normalized by
+// what is left. The centre tap always has full weight, so this never
+// divides by zero.
+void Denoiser::filter_pixel(GLint x, GLint y, GLint step, GLfloat colour_weight)
+{
+	const GLint p = index(x, y);
+	const GLfloat inverse_depth = (depth[p] > 0) ? 1.0f / (depth[p] * depth[p]) : 0.0f;
+	GLfloat sum[3] = { 0.0f, 0.0f, 0.0f }, weights = 0.0f;
+	for(GLint j = -2; j <= 2; j++)
+	{
+		GLint yy = y + j*step;
+		if(yy < 0 || yy >= height)
+			continue;
+		for(GLint i = -2; i <= 2; i++)
+		{
+			GLint xx = x + i*step;
+			if(xx < 0 || xx >= width)
+				continue;
+			GLint q = index(xx, yy);
+			GLfloat dr = colour[0][p] - colour[0][q], dg = colour[1][p] - colour[1][q], db = colour[2][p] - colour[2][q];
+			GLfloat ar = albedo[0][p] - albedo[0][q], ag = albedo[1][p] - albedo[1][q], ab = albedo[2][p] - albedo[2][q];
+			GLfloat nx = normal[0][p] - normal[0][q], ny = normal[1][p] - normal[1][q], nz = normal[2][p] - normal[2][q];
+			GLfloat dz = depth[p] - depth[q];
+			GLfloat w = kernel[j + 2] * kernel[i + 2] *
+			            falloff(colour_weight * (dr*dr + dg*dg + db*db) +
+			                    ALBEDO_WEIGHT * (ar*ar + ag*ag + ab*ab) +
+			                    NORMAL_WEIGHT * (nx*nx + ny*ny + nz*nz) +
+			                    DEPTH_WEIGHT * dz*dz * inverse_depth);
+			sum[0] += w * colour[0][q];
+			sum[1] += w * colour[1][q];
+			sum[2] += w * colour[2][q];
+			weights += w;
+		}
+	}
+	for(GLuint c = 0; c < 3; c++)
+		filtered[c][p] = sum[c] / weights;
+}
+
+// Rows of taps inside the image, as offsets from the centre row, with the
+// kernel weights of the row
+GLuint Denoiser::tap_rows(GLint y, GLint step, GLint *offsets, GLfloat *weights) const
+{
+	GLuint count = 0;
+	for(GLint j = -2; j <= 2; j++)
+	{
+		if(y + j*step >= 0 && y + j*step < height)
+		{
+			offsets[count] = j*step*stride;
+			weights[count++] = kernel[j + 2];
+		}
+	}
+	return count;
+}
+
+// Pixels are filtered a vector at a time: the centre pixels' features and
+// the sums stay in registers while every tap is weighed, so each tap costs
+// only the loads of its features. Near the left and right edges the lanes
+// whose tap falls off the image are masked out, their loads landing in the
+// border. Pixels left over at the end of the row are done one by one.
+void Denoiser::filter_row(GLint y, GLint step, GLfloat colour_weight)
+{
+	GLint x = 0;
+#if defined(__x86_64__) || defined(__i386__)
+	// The build targets any x86-64, AVX2 is only used where the CPU has it
+	static const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	if(avx2)
+		x = filter_row_avx2(y, step, colour_weight);
+#elif defined(__ARM_NEON)
+	GLint tap_offsets[5];
+	GLfloat row_weights[5];
+	GLuint tap_row_count = tap_rows(y, step, tap_offsets, row_weights);
+	const GLfloat *colours[3] = { &colour[0][0], &colour[1][0], &colour[2][0] };
+	const GLfloat *albedos[3] = { &albedo[0][0], &albedo[1][0], &albedo[2][0] };
+	const GLfloat *normals[3] = { &normal[0][0], &normal[1][0], &normal[2][0] };
+	const GLfloat *depths = &depth[0];
+	const float32x4_t zero = vdupq_n_f32(0.0f), one = vdupq_n_f32(1.0f), cutoff = vdupq_n_f32(FALLOFF_CUTOFF);
+	const GLfloat lane_offsets[4] = { 0, 1, 2, 3 };
+	const float32x4_t lanes = vld1q_f32(lane_offsets), right_edge = vdupq_n_f32(width);
+	for(; x + 4 <= width; x += 4)
+	{
+		const GLint p = index(x, y);
+		float32x4_t centre[10], sum[3] = { zero, zero, zero }, weights = zero;
+		for(GLuint c = 0; c < 3; c++)
+		{
+			centre[c] = vld1q_f32(colours[c] + p);
+			centre[3 + c] = vld1q_f32(albedos[c] + p);
+			centre[6 + c] = vld1q_f32(normals[c] + p);
+		}
+		centre[9] = vld1q_f32(depths + p);
+		GLfloat inverse_depths[4];
+		for(GLuint k = 0; k < 4; k++)
+			inverse_depths[k] = (depths[p + k] > 0) ? DEPTH_WEIGHT / (depths[p + k] * depths[p + k]) : 0.0f;
+		float32x4_t inverse_depth = vld1q_f32(inverse_depths);
+
+		for(GLuint r = 0; r < tap_row_count; r++)
+		{
+			for(GLint i = -2; i <= 2; i++)
+			{
+				const GLint q = p + tap_offsets[r] + i*step;
+				float32x4_t tap_colour[3], d, colour_distance = zero, albedo_distance = zero, normal_distance = zero;
+				for(GLuint c = 0; c < 3; c++)
+				{
+					tap_colour[c] = vld1q_f32(colours[c] + q);
+					d = vsubq_f32(centre[c], tap_colour[c]);
+					colour_distance = vmlaq_f32(colour_distance, d, d);
+					d = vsubq_f32(centre[3 + c], vld1q_f32(albedos[c] + q));
+					albedo_distance = vmlaq_f32(albedo_distance, d, d);
+					d = vsubq_f32(centre[6 + c], vld1q_f32(normals[c] + q));
+					normal_distance = vmlaq_f32(normal_distance, d, d);
+				}
+				d = vsubq_f32(centre[9], vld1q_f32(depths + q));
+
+				float32x4_t distance = vmulq_n_f32(colour_distance, colour_weight);
+				distance = vmlaq_n_f32(distance, albedo_distance, ALBEDO_WEIGHT);
+				distance = vmlaq_n_f32(distance, normal_distance, NORMAL_WEIGHT);
+				distance = vmlaq_f32(distance, vmulq_f32(d, d), inverse_depth);
+				float32x4_t w = vbslq_f32(vcltq_f32(distance, cutoff), vmlsq_n_f32(one, distance, 1.0f/256), zero);
+				for(GLuint k = 0; k < 8; k++)
+					w = vmulq_f32(w, w);
+				w = vmulq_n_f32(w, row_weights[r] * kernel[i + 2]);
+				if(x + i*step < 0 || x + i*step + 4 > width)
+				{
+					float32x4_t tap_x = vaddq_f32(vdupq_n_f32(x + i*step), lanes);
+					uint32x4_t inside = vandq_u32(vcgeq_f32(tap_x, zero), vcltq_f32(tap_x, right_edge));
+					w = vbslq_f32(inside, w, zero);
+				}
+				for(GLuint c = 0; c < 3; c++)
+					sum[c] = vmlaq_f32(sum[c], w, tap_colour[c]);
+				weights = vaddq_f32(weights, w);
+			}
+		}
+		float32x4_t inverse_weights = vrecpeq_f32(weights);
+		inverse_weights = vmulq_f32(inverse_weights, vrecpsq_f32(weights, inverse_weights));
+		inverse_weights = vmulq_f32(inverse_weights, vrecpsq_f32(weights, inverse_weights));
+		for(GLuint c = 0; c < 3; c++)
+			vst1q_f32(&filtered[c][p], vmulq_f32(sum[c], inverse_weights));
+	}
+#endif
+	for(; x < width; x++)
+		filter_pixel(x, y, step, colour_weight);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Only this function is built for AVX2, so nothing it shares with the rest
+// of the program, such as inline or template code, is emitted with
+// instructions an older CPU lacks. Returns the first pixel it left.
+__attribute__((target("avx2,fma")))
+GLint Denoiser::filter_row_avx2(GLint y, GLint step, GLfloat colour_weight)
+{
+	GLint x = 0;
+	GLint tap_offsets[5];
+	GLfloat row_weights[5];
+	GLuint tap_row_count = tap_rows(y, step, tap_offsets, row_weights);
+	const GLfloat *colours[3] = { &colour[0][0], &colour[1][0], &colour[2][0] };
+	const GLfloat *albedos[3] = { &albedo[0][0], &albedo[1][0], &albedo[2][0] };
+	const GLfloat *normals[3] = { &normal[0][0], &normal[1][0], &normal[2][0] };
+	const GLfloat *depths = &depth[0];
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), scale = _mm256_set1_ps(-1.0f/256), cutoff = _mm256_set1_ps(FALLOFF_CUTOFF);
+	const __m256 colour_strength = _mm256_set1_ps(colour_weight), albedo_strength = _mm256_set1_ps(ALBEDO_WEIGHT);
+	const __m256 normal_strength = _mm256_set1_ps(NORMAL_WEIGHT), depth_strength = _mm256_set1_ps(DEPTH_WEIGHT);
+	const __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7), right_edge = _mm256_set1_ps(width);
+	for(; x + 8 <= width; x += 8)
+	{
+		const GLint p = index(x, y);
+		__m256 centre[10], sum[3] = { zero, zero, zero }, weights = zero;
+		for(GLuint c = 0; c < 3; c++)
+		{
+			centre[c] = _mm256_loadu_ps(colours[c] + p);
+			centre[3 + c] = _mm256_loadu_ps(albedos[c] + p);
+			centre[6 + c] = _mm256_loadu_ps(normals[c] + p);
+		}
+		centre[9] = _mm256_loadu_ps(depths + p);
+		__m256 inverse_depth = _mm256_div_ps(one, _mm256_mul_ps(centre[9], centre[9]));
+		inverse_depth = _mm256_and_ps(inverse_depth, _mm256_cmp_ps(centre[9], zero, _CMP_GT_OQ));
+		inverse_depth = _mm256_mul_ps(inverse_depth, depth_strength);
+
+		for(GLuint r = 0; r < tap_row_count; r++)
+		{
+			for(GLint i = -2; i <= 2; i++)
+			{
+				const GLint q = p + tap_offsets[r] + i*step;
+				__m256 tap_colour[3], d, colour_distance, albedo_distance, normal_distance;
+				for(GLuint c = 0; c < 3; c++)
+					tap_colour[c] = _mm256_loadu_ps(colours[c] + q);
+				d = _mm256_sub_ps(centre[0], tap_colour[0]);
+				colour_distance = _mm256_mul_ps(d, d);
+				d = _mm256_sub_ps(centre[1], tap_colour[1]);
+				colour_distance = _mm256_add_ps(colour_distance, _mm256_mul_ps(d, d));
+				d = _mm256_sub_ps(centre[2], tap_colour[2]);
+				colour_distance = _mm256_add_ps(colour_distance, _mm256_mul_ps(d, d));
+				d = _mm256_sub_ps(centre[3], _mm256_loadu_ps(albedos[0] + q));
+				albedo_distance = _mm256_mul_ps(d, d);
+				d = _mm256_sub_ps(centre[4], _mm256_loadu_ps(albedos[1] + q));
+				albedo_distance = _mm256_add_ps(albedo_distance, _mm256_mul_ps(d, d));
+				d = _mm256_sub_ps(centre[5], _mm256_loadu_ps(albedos[2] + q));
+				albedo_distance = _mm256_add_ps(albedo_distance, _mm256_mul_ps(d, d));
+				d = _mm256_sub_ps(centre[6], _mm256_loadu_ps(normals[0] + q));
+				normal_distance = _mm256_mul_ps(d, d);
+				d = _mm256_sub_ps(centre[7], _mm256_loadu_ps(normals[1] + q));
+				normal_distance = _mm256_add_ps(normal_distance, _mm256_mul_ps(d, d));
+				d = _mm256_sub_ps(centre[8], _mm256_loadu_ps(normals[2] + q));
+				normal_distance = _mm256_add_ps(normal_distance, _mm256_mul_ps(d, d));
+				d = _mm256_sub_ps(centre[9], _mm256_loadu_ps(depths + q));
+
+				__m256 distance = _mm256_mul_ps(colour_strength, colour_distance);
+				distance = _mm256_add_ps(distance, _mm256_mul_ps(albedo_strength, albedo_distance));
+				distance = _mm256_add_ps(distance, _mm256_mul_ps(normal_strength, normal_distance));
+				distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_mul_ps(d, d), inverse_depth));
+				__m256 w = _mm256_and_ps(_mm256_add_ps(one, _mm256_mul_ps(distance, scale)), _mm256_cmp_ps(distance, cutoff, _CMP_LT_OQ));
+				for(GLuint k = 0; k < 8; k++)
+					w = _mm256_mul_ps(w, w);
+				w = _mm256_mul_ps(w, _mm256_set1_ps(row_weights[r] * kernel[i + 2]));
+				if(x + i*step < 0 || x + i*step + 8 > width)
+				{
+					__m256 tap_x = _mm256_add_ps(_mm256_set1_ps(x + i*step), lanes);
+					w = _mm256_and_ps(w, _mm256_and_ps(_mm256_cmp_ps(tap_x, zero, _CMP_GE_OQ), _mm256_cmp_ps(tap_x, right_edge, _CMP_LT_OQ)));
+				}
+				for(GLuint c = 0; c < 3; c++)
+					sum[c] = _mm256_add_ps(sum[c], _mm256_mul_ps(w, tap_colour[c]));
+				weights = _mm256_add_ps(weights, w);
+			}
+		}
+		for(GLuint c = 0; c < 3; c++)
+			_mm256_storeu_ps(&filtered[c][p], _mm256_div_ps(sum[c], weights));
+	}
+	return x;
+}
+#endif
+
+void Denoiser::apply(ImageBuffer &image)
+{
+	if(width == 0 || width != image.Width() || height != image.Height())
+		return;
+
+	for(GLint y = 0; y < height; y++)
+	{
+		for(GLint x = 0; x < width; x++)
+		{
+			vec3 pixel = image.GetPixel(x, y);
+			for(GLuint c = 0; c < 3; c++)
+				colour[c][index(x, y)] = pixel[c];
+		}
+	}
+
+	GLfloat colour_weight = COLOUR_WEIGHT;
+	for(GLint pass = 0; pass < DENOISE_PASSES; pass++)
+	{
+		GLint step = 1 << pass;
+		run_workers(height, [&](GLuint y)
+		{
+			filter_row(y, step, colour_weight);
+			return true;
+		});
+		for(GLuint c = 0; c < 3; c++)
+			colour[c].swap(filtered[c]);
+		colour_weight *= 4.0f;
+	}
+
+	vector<vec3> result((size_t)width * height);
+	for(GLint y = 0; y < height; y++)
+	{
+		for(GLint x = 0; x < width; x++)
+		{
+			GLint p = index(x, y);
+			result[y*width + x] = vec3(colour[0][p], colour[1][p], colour[2][p]);
+		}
+	}
+	image.SetTile(0, 0, width, height, &result[0]);
+}
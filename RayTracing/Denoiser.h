@@ -0,0 +1,52 @@
+/*
+ * Denoiser.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include <glm/glm.hpp>
+#include <GLFW/glfw3.h>
+#include <vector>
+
+#include "ImageBuffer.h"
+
+using namespace std;
+using namespace glm;
+
+// Edge-avoiding a-trous wavelet filter. Five passes of a 5x5 B-spline
+// kernel with the taps spread twice as far each pass, every tap weighted
+// down by how much its colour, albedo, normal and depth differ from the
+// centre pixel, so noise is smoothed without blurring across edges.
+// Buffers are stored one channel per array, so eight pixels of a row (four
+// with NEON) are filtered at once with AVX2, which is used when the CPU
+// running the program has it. Nothing is allocated per row.
+class Denoiser
+{
+	public:
+	    Denoiser();
+	    void resize(GLint width_, GLint height_);
+	    // Features of the primary hit at a pixel, all zero where nothing was
+	    // hit. Safe to call from several threads for different pixels.
+	    void set_features(GLint x, GLint y, const vec3 &albedo, const vec3 &normal, GLfloat depth);
+	    void apply(ImageBuffer &image);
+	private:
+	    // Rows are stride floats apart, with a zeroed border either side
+	    GLint width, height, stride;
+	    vector<GLfloat> albedo[3];
+	    vector<GLfloat> normal[3];
+	    vector<GLfloat> depth;
+	    vector<GLfloat> colour[3];
+	    vector<GLfloat> filtered[3];
+	    GLint index(GLint x, GLint y) const;
+	    GLuint tap_rows(GLint y, GLint step, GLint *offsets, GLfloat *weights) const;
+	    void filter_row(GLint y, GLint step, GLfloat colour_weight);
+#if defined(__x86_64__) || defined(__i386__)
+	    GLint filter_row_avx2(GLint y, GLint step, GLfloat colour_weight);
+#endif
+	    void filter_pixel(GLint x, GLint y, GLint step, GLfloat colour_weight);
+};
+
+#endif
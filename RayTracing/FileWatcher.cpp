@@ -0,0 +1,118 @@
+/*
+ * FileWatcher.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#include "FileWatcher.h"
+
+#include <iostream>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+FileWatcher::FileWatcher()
+{
+	inotify_fd = inotify_init1(IN_CLOEXEC);
+	stop_pipe[0] = stop_pipe[1] = -1;
+	if(inotify_fd < 0)
+		cout << "FileWatcher ERROR: Could not start inotify" << endl;
+}
+
+FileWatcher::~FileWatcher()
+{
+	if(waiter.joinable())
+	{
+		char stop = 0;
+		if(write(stop_pipe[1], &stop, 1) == 1)
+			waiter.join();
+		else
+			waiter.detach();
+	}
+	for(int i = 0; i < 2; i++)
+	{
+		if(stop_pipe[i] >= 0)
+			close(stop_pipe[i]);
+	}
+	if(inotify_fd >= 0)
+		close(inotify_fd);
+}
+
+bool FileWatcher::watch(const string &file)
+{
+	if(inotify_fd < 0)
+		return false;
+	size_t slash = file.rfind('/');
+	string directory = slash == string::npos ? "." : (slash == 0 ? "/" : file.substr(0, slash));
+	string name = slash == string::npos ? file : file.substr(slash + 1);
+
+	// Watching a directory twice gives back the same descriptor
+	int wd = inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if(wd < 0)
+	{
+		cout << "FileWatcher ERROR: Could not watch " << directory << endl;
+		return false;
+	}
+	files[make_pair(wd, name)] = file;
+	return true;
+}
+
+bool FileWatcher::start(const function<void()> &notify_)
+{
+	if(inotify_fd < 0 || waiter.joinable())
+		return false;
+	if(pipe2(stop_pipe, O_CLOEXEC) != 0)
+	{
+		cout << "FileWatcher ERROR: Could not create stop pipe" << endl;
+		return false;
+	}
+	notify = notify_;
+	waiter = thread(&FileWatcher::wait_for_changes, this);
+	return true;
+}
+
+vector<string> FileWatcher::changed()
+{
+	lock_guard<mutex> guard(changed_lock);
+	vector<string> files_changed(pending.begin(), pending.end());
+	pending.clear();
+	return files_changed;
+}
+
+void FileWatcher::wait_for_changes()
+{
+	// Large enough for many events with names up to NAME_MAX
+	vector<char> buffer(64 * 1024);
+	struct pollfd fds[2] = { { inotify_fd, POLLIN, 0 }, { stop_pipe[0], POLLIN, 0 } };
+	while(true)
+	{
+		if(poll(fds, 2, -1) < 0)
+			continue;
+		if(fds[1].revents)
+			return;
+		ssize_t length = read(inotify_fd, &buffer[0], buffer.size());
+		if(length <= 0)
+			continue;
+
+		// Saving a file usually shows up as several events, they are
+		// reported together
+		bool any = false;
+		for(ssize_t offset = 0; offset < length;)
+		{
+			const struct inotify_event *event = (const struct inotify_event *)&buffer[offset];
+			offset += sizeof(struct inotify_event) + event->len;
+			if(event->len == 0)
+				continue;
+			map<pair<int, string>, string>::const_iterator found = files.find(make_pair(event->wd, string(event->name)));
+			if(found == files.end())
+				continue;
+			lock_guard<mutex> guard(changed_lock);
+			pending.insert(found->second);
+			any = true;
+		}
+		if(any && notify)
+			notify();
+	}
+}
@@ -0,0 +1,51 @@
+/*
+ * FileWatcher.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#ifndef FILEWATCHER_H
+#define FILEWATCHER_H
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Reports files that were written, through inotify on their directories so
+// editors that save by renaming a new file into place are seen too. A
+// thread waits for changes and calls notify on each, e.g. to wake a window's
+// event loop.
+class FileWatcher
+{
+	public:
+	    FileWatcher();
+	    ~FileWatcher();
+	    bool watch(const string &file);
+	    // Starts waiting for changes, call after the files are watched
+	    bool start(const function<void()> &notify);
+	    // Watched files written since the last call, as they were given
+	    vector<string> changed();
+	private:
+	    FileWatcher(const FileWatcher &);
+	    FileWatcher &operator=(const FileWatcher &);
+	    void wait_for_changes();
+
+	    int inotify_fd;
+	    // Written to when the watcher is destroyed, to end the thread
+	    int stop_pipe[2];
+	    // Watched files by directory watch and name within the directory
+	    map<pair<int, string>, string> files;
+	    mutex changed_lock;
+	    set<string> pending;
+	    function<void()> notify;
+	    thread waiter;
+};
+
+#endif
@@ -18,8 +18,13 @@
 #include "ImageBuffer.h"
 
 #include <iostream>
+#include <algorithm>
+#include <cstdio>
 #include <glm/common.hpp>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 // --------------------------------------------------------------------------
 // Set these defines to choose which image library to use for saving image
 // files to disk. Obviously, you shouldn't set both!
@@ -41,12 +46,14 @@ using namespace glm;
 
 ImageBuffer::ImageBuffer()
     : m_textureName(0), m_framebufferObject(0),
-      m_width(0), m_height(0), m_modified(false)
+      m_width(0), m_height(0), m_pixels(0), m_modified(false),
+      m_streamFile(-1), m_streamFailed(false)
 {
 }
 
 ImageBuffer::~ImageBuffer()
 {
+    EndStream();
     if (m_framebufferObject)    glDeleteFramebuffers(1, &m_framebufferObject);
     if (m_textureName)          glDeleteTextures(1, &m_textureName);
 }
@@ -77,6 +84,7 @@ bool ImageBuffer::Initialize()
             float c = 0.2 + ((p & 1) ? 0.1 : 0.0);
             m_imageData[k] = vec3(c);
         }
+    m_pixels = &m_imageData[0];
 
     // allocate texture object
     if (!m_textureName)
@@ -105,10 +113,31 @@ bool ImageBuffer::Initialize()
 
 // --------------------------------------------------------------------------
 
+void ImageBuffer::Resize(int width, int height)
+{
+    EndStream();
+    m_width = width;
+    m_height = height;
+    m_imageData.assign(m_width * m_height, vec3(0.f));
+    m_pixels = &m_imageData[0];
+
+    // the texture keeps its name, only its storage changes
+    if (m_textureName)
+    {
+        glBindTexture(GL_TEXTURE_RECTANGLE, m_textureName);
+        glTexImage2D(GL_TEXTURE_RECTANGLE, 0, GL_RGB, m_width, m_height, 0, GL_RGB,
+                     GL_FLOAT, &m_imageData[0]);
+        glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+    }
+    ResetModified();
+}
+
+// --------------------------------------------------------------------------
+
 void ImageBuffer::SetPixel(int x, int y, vec3 colour)
 {
     int index = y * m_width + x;
-    m_imageData[index] = colour;
+    m_pixels[index] = colour;
 
     // mark that something was changed
     m_modified = true;
@@ -118,6 +147,49 @@ void ImageBuffer::SetPixel(int x, int y, vec3 colour)
 
 // --------------------------------------------------------------------------
 
+void ImageBuffer::SetTile(int x, int y, int w, int h, const vec3 *colours)
+{
+    for (int i = 0; i < h; ++i)
+        std::copy(colours + i * w, colours + (i + 1) * w,
+                  m_pixels + (y + i) * m_width + x);
+
+    // write the tile's rows straight to their place in the stream file
+    bool streamed = true;
+    if (m_streamFile >= 0)
+    {
+        for (int i = 0; i < h && streamed; ++i)
+        {
+            off_t offset = m_streamOffset + off_t((y + i) * m_width + x) * sizeof(vec3);
+            streamed = pwrite(m_streamFile, colours + i * w, w * sizeof(vec3), offset) == ssize_t(w * sizeof(vec3));
+        }
+        if (!streamed)
+            cout << "ImageBuffer ERROR: Failed streaming a tile!" << endl;
+    }
+
+    // mark that something was changed
+    std::lock_guard<std::mutex> guard(m_modifiedLock);
+    if (!streamed)
+        m_streamFailed = true;
+    m_modified = true;
+    m_modifiedLower = std::min(m_modifiedLower, y);
+    m_modifiedUpper = std::max(m_modifiedUpper, y+h);
+}
+
+void ImageBuffer::AttachStorage(vec3 *pixels)
+{
+    // detaching keeps the current contents in our own storage
+    if (!pixels && m_pixels && m_pixels != &m_imageData[0])
+        std::copy(m_pixels, m_pixels + m_width * m_height, m_imageData.begin());
+    m_pixels = pixels ? pixels : &m_imageData[0];
+
+    // the new contents are unknown, so everything needs uploading
+    m_modified = true;
+    m_modifiedLower = 0;
+    m_modifiedUpper = m_height;
+}
+
+// --------------------------------------------------------------------------
+
 void ImageBuffer::Render()
 {
     if (!m_framebufferObject) return;
@@ -131,18 +203,25 @@ void ImageBuffer::Render()
         // bind texture and copy only the rows that have been changed
         glBindTexture(GL_TEXTURE_RECTANGLE, m_textureName);
         glTexSubImage2D(GL_TEXTURE_RECTANGLE, 0, 0, m_modifiedLower, m_width,
-                        sizeY, GL_RGB, GL_FLOAT, &m_imageData[index]);
+                        sizeY, GL_RGB, GL_FLOAT, &m_pixels[index]);
         glBindTexture(GL_TEXTURE_RECTANGLE, 0);
 
         // mark that we've updated the texture
         ResetModified();
     }
 
+    // fit the image in the viewport, keeping its aspect ratio
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    float scale = std::min(float(viewport[2]) / m_width, float(viewport[3]) / m_height);
+    int w = int(m_width * scale), h = int(m_height * scale);
+    int x = (viewport[2] - w) / 2, y = (viewport[3] - h) / 2;
+
     // bind the framebuffer object with our texture in it and copy to screen
     glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebufferObject);
     glBlitFramebuffer(0, 0, m_width, m_height,
-                      0, 0, m_width, m_height,
-                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+                      x, y, x + w, y + h,
+                      GL_COLOR_BUFFER_BIT, scale < 1 ? GL_LINEAR : GL_NEAREST);
     glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
 }
 
@@ -155,20 +234,25 @@ bool ImageBuffer::SaveToFile(const string &imageFileName)
         cout << "ImageBuffer ERROR: Trying to save uninitialized image!" << endl;
         return false;
     }
+    return SavePixels(imageFileName, m_width, m_height, m_pixels);
+}
+
+bool ImageBuffer::SavePixels(const string &imageFileName, int width, int height, const vec3 *pixels)
+{
     cout << "ImageBuffer saving image to " << imageFileName << "..." << endl;
 
 #ifdef USE_IMAGEMAGICK
     using namespace Magick;
 
     // allocate an image object the same size as our buffer
-    Image myImage(Geometry(m_width, m_height), "black");
+    Image myImage(Geometry(width, height), "black");
 
     // copy the image data from our memory buffer into the Magick++ one.
     int index = 0;
-    for (int i = m_height-1; i >= 0; --i)
-        for (int j = 0; j < m_width; ++j)
+    for (int i = height-1; i >= 0; --i)
+        for (int j = 0; j < width; ++j)
         {
-            vec3 v = m_imageData[index++];
+            vec3 v = pixels[index++];
             vec3 c = clamp(v, 0.f, 1.f) * float(MaxRGB);
             Color colour(c.r, c.g, c.b);
             myImage.pixelColor(j, i, colour);
@@ -190,3 +274,124 @@ bool ImageBuffer::SaveToFile(const string &imageFileName)
 }
 
 // --------------------------------------------------------------------------
+
+// PFM header; a negative scale marks little-endian floats
+static string PFMHeader(int width, int height)
+{
+    const unsigned short probe = 1;
+    bool littleEndian = *(const unsigned char *)&probe == 1;
+    char header[64];
+    snprintf(header, sizeof(header), "PF\n%d %d\n%s\n", width, height,
+             littleEndian ? "-1.0" : "1.0");
+    return header;
+}
+
+bool ImageBuffer::SaveToPFM(const string &imageFileName)
+{
+    if (m_width == 0 || m_height == 0)
+    {
+        cout << "ImageBuffer ERROR: Trying to save uninitialized image!" << endl;
+        return false;
+    }
+    return SavePixelsPFM(imageFileName, m_width, m_height, m_pixels);
+}
+
+bool ImageBuffer::SavePixelsPFM(const string &imageFileName, int width, int height, const vec3 *pixels)
+{
+    cout << "ImageBuffer saving image to " << imageFileName << "..." << endl;
+
+    FILE *file = fopen(imageFileName.c_str(), "wb");
+    if (!file)
+    {
+        cout << "ImageBuffer ERROR: Could not open " << imageFileName << endl;
+        return false;
+    }
+
+    // the pixel array is written as is, one call for the whole image
+    string header = PFMHeader(width, height);
+    size_t count = size_t(width) * height;
+    bool ok = fwrite(header.data(), 1, header.size(), file) == header.size() &&
+              fwrite(pixels, sizeof(vec3), count, file) == count;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok)
+        cout << "ImageBuffer ERROR: Failed writing " << imageFileName << endl;
+    return ok;
+}
+
+bool ImageBuffer::LoadPixelsPFM(const string &imageFileName, int *width, int *height, vector<vec3> *pixels)
+{
+    FILE *file = fopen(imageFileName.c_str(), "rb");
+    if (!file)
+        return false;
+
+    // a negative scale means little endian samples
+    char type[3] = { 0 };
+    float scale = 0;
+    bool ok = fscanf(file, "%2s %d %d %f", type, width, height, &scale) == 4 &&
+              string(type) == "PF" && *width > 0 && *height > 0 && fgetc(file) != EOF;
+    if (ok)
+    {
+        size_t count = size_t(*width) * *height;
+        pixels->resize(count);
+        ok = fread(&(*pixels)[0], sizeof(vec3), count, file) == count;
+
+        const unsigned short probe = 1;
+        bool littleEndian = *(const unsigned char *)&probe == 1;
+        if (ok && (scale < 0) != littleEndian)
+        {
+            unsigned char *bytes = (unsigned char *)&(*pixels)[0];
+            for (size_t i = 0; i < count * 3; ++i)
+            {
+                std::swap(bytes[i*4], bytes[i*4 + 3]);
+                std::swap(bytes[i*4 + 1], bytes[i*4 + 2]);
+            }
+        }
+    }
+    fclose(file);
+    if (!ok)
+        cout << "ImageBuffer ERROR: " << imageFileName << " is not a colour PFM file" << endl;
+    return ok;
+}
+
+bool ImageBuffer::BeginStream(const string &imageFileName, bool writeCurrent)
+{
+    EndStream();
+    if (m_width == 0 || m_height == 0)
+    {
+        cout << "ImageBuffer ERROR: Trying to stream uninitialized image!" << endl;
+        return false;
+    }
+
+    m_streamFailed = false;
+    m_streamFile = open(imageFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m_streamFile < 0)
+    {
+        cout << "ImageBuffer ERROR: Could not open " << imageFileName << endl;
+        return false;
+    }
+
+    // size the file up front so tiles can land anywhere in it
+    string header = PFMHeader(m_width, m_height);
+    m_streamOffset = header.size();
+    off_t bytes = m_streamOffset + off_t(m_width) * m_height * sizeof(vec3);
+    bool ok = write(m_streamFile, header.data(), header.size()) == ssize_t(header.size()) &&
+              ftruncate(m_streamFile, bytes) == 0;
+    if (ok && writeCurrent)
+        ok = pwrite(m_streamFile, m_pixels, bytes - m_streamOffset, m_streamOffset) == bytes - m_streamOffset;
+    if (!ok)
+    {
+        cout << "ImageBuffer ERROR: Failed writing " << imageFileName << endl;
+        EndStream();
+    }
+    return ok;
+}
+
+bool ImageBuffer::EndStream()
+{
+    if (m_streamFile < 0) return false;
+    bool ok = close(m_streamFile) == 0 && !m_streamFailed;
+    m_streamFile = -1;
+    return ok;
+}
+
+// --------------------------------------------------------------------------
@@ -16,6 +16,7 @@
 #include <vector>
 #include <glm/vec3.hpp>
 #include <string>
+#include <mutex>
 
 #ifndef GLFW_VERSION_MAJOR
 #define GLFW_INCLUDE_GLCOREARB
@@ -34,13 +35,22 @@ class ImageBuffer
     GLuint  m_textureName;
     GLuint  m_framebufferObject;
 
-    // dimensions of our image, and the pixel colour data array
+    // dimensions of our image, and the pixel colour data array. m_pixels
+    // points at m_imageData unless external storage has been attached
     int     m_width, m_height;
     std::vector<glm::vec3> m_imageData;
+    glm::vec3 *m_pixels;
 
     // state variables to keep track of modified region
     bool    m_modified;
     int     m_modifiedLower, m_modifiedUpper;
+    std::mutex m_modifiedLock;
+
+    // file that finished tiles are streamed to, or -1, and where its
+    // pixel data starts; failed is set once any tile could not be written
+    int     m_streamFile;
+    long    m_streamOffset;
+    bool    m_streamFailed;
 
     void ResetModified();
 
@@ -56,16 +66,49 @@ public:
     // buffer that matches the size of your viewport
     bool Initialize();
 
+    // reallocate the image at a different size, e.g. a resolution that
+    // differs from the viewport; the contents are cleared to black
+    void Resize(int width, int height);
+
     // set a pixel in this image buffer to a specified colour:
     //  - (0,0) is the bottom-left pixel of the image
     //  - colour is RGB given as floating point numbers in the range [0,1]
     void SetPixel(int x, int y, glm::vec3 colour);
+    glm::vec3 GetPixel(int x, int y) const { return m_pixels[y * m_width + x]; }
+
+    // copy a w x h tile of colours (rows packed, bottom row first) into the
+    // image at (x,y); safe to call from several threads for disjoint tiles
+    void SetTile(int x, int y, int w, int h, const glm::vec3 *colours);
+
+    // use caller owned memory of Width() x Height() pixels as the image
+    // data, e.g. a memory mapped file; its contents are shown as they are.
+    // Passing null copies the image back into our own storage and detaches
+    void AttachStorage(glm::vec3 *pixels);
 
-    // call this in your render function to copy this image onto your screen
+    // call this in your render function to copy this image onto your screen,
+    // scaled to fit the viewport if the sizes differ
     void Render();
 
     // call this at the end of your render to save the image to file
     bool SaveToFile(const std::string &imageFileName);
+
+    // save the raw floating point image as a PFM file, without clamping;
+    // rows are already stored bottom-up in PFM order, so no conversion
+    bool SaveToPFM(const std::string &imageFileName);
+
+    // the same two writers for a copy of the pixels, so a finished frame
+    // can be encoded on another thread while the next one renders
+    static bool SavePixels(const std::string &imageFileName, int width, int height, const glm::vec3 *pixels);
+    static bool SavePixelsPFM(const std::string &imageFileName, int width, int height, const glm::vec3 *pixels);
+
+    // read back a colour PFM file, e.g. a reference image to compare with
+    static bool LoadPixelsPFM(const std::string &imageFileName, int *width, int *height, std::vector<glm::vec3> *pixels);
+
+    // start streaming tiles to a PFM file as SetTile receives them, first
+    // writing out the whole current image if writeCurrent is set
+    bool BeginStream(const std::string &imageFileName, bool writeCurrent);
+    // close the stream; true only if it opened and every tile was written
+    bool EndStream();
 };
 
 // --------------------------------------------------------------------------
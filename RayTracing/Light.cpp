@@ -6,17 +6,83 @@
  */
 #include "Light.h"
 
-Light::Light(vec3 point_, vec3 intensity_)
+#include <cmath>
+
+template<typename real>
+Light<real>::Light(rvec3<real> point_, vec3 intensity_)
 {
+	shape = POINT;
 	point = point_;
 	intensity = intensity_;
+	radius = 0;
+	samples = 1;
 }
-void Light::generate_light_ray(const vec3 &scene_intersection, Ray *lray, vec3 *lcolour)
+
+template<typename real>
+Light<real>::Light(rvec3<real> corner, rvec3<real> edge_u_, rvec3<real> edge_v_, vec3 intensity_, GLuint samples_)
+{
+	shape = RECTANGLE;
+	edge_u = edge_u_;
+	edge_v = edge_v_;
+	point = corner + (edge_u + edge_v) / (real)2;
+	intensity = intensity_;
+	radius = 0;
+	samples = samples_ > 0 ? samples_ : 1;
+}
+
+template<typename real>
+Light<real>::Light(rvec3<real> center, real radius_, vec3 intensity_, GLuint samples_)
+{
+	shape = SPHERE;
+	point = center;
+	radius = radius_;
+	intensity = intensity_;
+	samples = samples_ > 0 ? samples_ : 1;
+}
+
+template<typename real>
+void Light<real>::generate_light_ray(const rvec3<real> &scene_intersection, Ray<real> *lray, vec3 *lcolour)
 {
     lray->direction = point - scene_intersection;
 	lray->origin = scene_intersection;
     *lcolour = intensity;
 }
 
+template<typename real>
+rvec3<real> Light<real>::sample_point(GLuint i, const rvec2<real> &offset, const rvec3<real> &scene_intersection) const
+{
+	// R2 sequence, the 2D analogue of the golden ratio sequence
+	const real a1 = (real)0.7548776662466927, a2 = (real)0.5698402909980532;
+	real u = (real)0.5 + a1 * i + offset.x;
+	real v = (real)0.5 + a2 * i + offset.y;
+	u -= floor(u);
+	v -= floor(v);
+
+	if(shape == RECTANGLE)
+		return point + (u - (real)0.5) * edge_u + (v - (real)0.5) * edge_v;
+	if(shape == POINT)
+		return point;
 
+	// Concentric map of the unit square onto the disc facing the point
+	real a = 2 * u - 1, b = 2 * v - 1;
+	real r, phi;
+	if(a == 0 && b == 0)
+		return point;
+	if(fabs(a) > fabs(b))
+	{
+		r = a;
+		phi = (real)(M_PI / 4) * (b / a);
+	}
+	else
+	{
+		r = b;
+		phi = (real)(M_PI / 2) - (real)(M_PI / 4) * (a / b);
+	}
+	rvec3<real> w = normalize(scene_intersection - point);
+	rvec3<real> t = normalize(cross(w, fabs(w.y) < 0.9 ? rvec3<real>(0, 1, 0) : rvec3<real>(1, 0, 0)));
+	rvec3<real> s = cross(w, t);
+	return point + radius * r * ((real)cos(phi) * t + (real)sin(phi) * s);
+}
 
+template class Light<GLfloat>;
+template class Light<GLdouble>;
@@ -8,20 +8,38 @@
 #define LIGHT_H
 
 #include <glm/glm.hpp>
+#include <GLFW/glfw3.h>
+#include "Precision.h"
 #include "Ray.h"
 
 using namespace glm;
 
+// Shadow rays an area light always gets before a point may stop early
+#define SHADOW_MIN_SAMPLES 4
+
+template<typename real>
 class Light
 {
 	public:
-	    Light(vec3 point_, vec3 intensity_);
-	    void generate_light_ray(const vec3 &scene_intersection, Ray *lray, vec3 *lcolour);
-        vec3 point;
+	    enum Shape { POINT, RECTANGLE, SPHERE };
+	    Light(rvec3<real> point_, vec3 intensity_);
+	    // Rectangle from a corner along two edges, lit from both sides
+	    Light(rvec3<real> corner, rvec3<real> edge_u_, rvec3<real> edge_v_, vec3 intensity_, GLuint samples_);
+	    Light(rvec3<real> center, real radius_, vec3 intensity_, GLuint samples_);
+	    // Ray towards the centre of the light, for shading
+	    void generate_light_ray(const rvec3<real> &scene_intersection, Ray<real> *lray, vec3 *lcolour);
+	    // The i'th point of a progressive low discrepancy pattern over the
+	    // light, so any first few samples already cover it evenly. Offset
+	    // shifts the whole pattern, varying it from one shaded point to the
+	    // next. A sphere is sampled over the disc it shows the shaded point.
+	    rvec3<real> sample_point(GLuint i, const rvec2<real> &offset, const rvec3<real> &scene_intersection) const;
+	    Shape shape;
+        rvec3<real> point;
 		vec3 intensity;
+		rvec3<real> edge_u, edge_v;
+		real radius;
+		// Most shadow rays a point lit by this light can take
+		GLuint samples;
 };
 
 #endif
-
-
-
@@ -0,0 +1,40 @@
+/*
+ * Parallel.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Runs work on every index below count across one thread per core. Threads
+// stop taking new indices once work returns false.
+inline void run_workers(GLuint count, const std::function<bool(GLuint)> &work)
+{
+	std::atomic<GLuint> next(0);
+	std::atomic<bool> stop(false);
+	auto worker = [&]()
+	{
+		GLuint i;
+		while(!stop && (i = next++) < count)
+		{
+			if(!work(i))
+				stop = true;
+		}
+	};
+	std::vector<std::thread> threads;
+	GLuint thread_count = std::min(count, std::max(1u, std::thread::hardware_concurrency()));
+	for(GLuint i = 0; i < thread_count; i++)
+		threads.push_back(std::thread(worker));
+	for(GLuint i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+#endif
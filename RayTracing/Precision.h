@@ -0,0 +1,40 @@
+/*
+ * Precision.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#ifndef PRECISION_H
+#define PRECISION_H
+
+#include <glm/glm.hpp>
+#include <GLFW/glfw3.h>
+
+using namespace glm;
+
+// The ray tracing geometry (rays, objects, hits and lights) is templated on
+// its scalar type real, GLfloat or GLdouble, and both are built. A scene
+// picks double when its coordinates are large enough that float hits land
+// far enough off the surface to shadow themselves. Colours stay single
+// precision either way, and the camera keeps its pose in double.
+template<typename real> struct Precision;
+
+template<> struct Precision<GLfloat>
+{
+	typedef vec2 vec2_type;
+	typedef vec3 vec3_type;
+	typedef mat3 mat3_type;
+};
+
+template<> struct Precision<GLdouble>
+{
+	typedef dvec2 vec2_type;
+	typedef dvec3 vec3_type;
+	typedef dmat3 mat3_type;
+};
+
+template<typename real> using rvec2 = typename Precision<real>::vec2_type;
+template<typename real> using rvec3 = typename Precision<real>::vec3_type;
+template<typename real> using rmat3 = typename Precision<real>::mat3_type;
+
+#endif
@@ -2,35 +2,54 @@
 #include "Primitives.h"
 using namespace std;
 
-Object::Object(vec3 diffuse_colour_, vec3 specular_colour_, GLfloat phong_exponent_, GLfloat reflectance_)
+template<typename real>
+Object<real>::Object(vec3 diffuse_colour_, vec3 specular_colour_, GLfloat phong_exponent_, GLfloat reflectance_)
 {
     diffuse_colour = diffuse_colour_;
     specular_colour = specular_colour_;
     phong_exponent = phong_exponent_;
     reflectance = reflectance_;
+    texture = NULL;
+    texture_repeat = 1;
 }
 
-Sphere::Sphere(vec3 center_, GLfloat radius_, vec3 diffuse_colour_, vec3 specular_colour_, GLfloat phong_exponent_, GLfloat reflectance_)
-: Object(diffuse_colour_, specular_colour_, phong_exponent_, reflectance_)
+template<typename real>
+Sphere<real>::Sphere(rvec3<real> center_, real radius_, vec3 diffuse_colour_, vec3 specular_colour_, GLfloat phong_exponent_, GLfloat reflectance_)
+: Object<real>(diffuse_colour_, specular_colour_, phong_exponent_, reflectance_)
 {
     center = center_;
+    rest_center = center_;
     radius = radius_;
 }
 
-bool Sphere::intersect(const Ray &ray, vec3 *point, GLfloat *t_val)
+template<typename real>
+Bounds<real> Sphere<real>::bounds()
 {
-	GLfloat a = dot(ray.direction, ray.direction);
-	GLfloat b = 2*dot(ray.direction, -center) + 2*dot(ray.origin, ray.direction);
-	GLfloat c = 2*dot(ray.origin, -center) + dot(-center, -center) + dot(ray.origin, ray.origin) - (radius*radius);
+	return Bounds<real>(center - rvec3<real>(radius), center + rvec3<real>(radius));
+}
+
+// Turning a sphere about its own centre leaves it as it was
+template<typename real>
+void Sphere<real>::transform(const rmat3<real> &, const rvec3<real> &translation)
+{
+	center = rest_center + translation;
+}
+
+template<typename real>
+bool Sphere<real>::intersect(const Ray<real> &ray, rvec3<real> *point, real *t_val, rvec3<real> *normal)
+{
+	real a = dot(ray.direction, ray.direction);
+	real b = 2*dot(ray.direction, -center) + 2*dot(ray.origin, ray.direction);
+	real c = 2*dot(ray.origin, -center) + dot(-center, -center) + dot(ray.origin, ray.origin) - (radius*radius);
 
 	// if discriminant is positive, intersection exists
-	GLfloat discriminant = (b*b) - (4*a*c);
+	real discriminant = (b*b) - (4*a*c);
 	if(discriminant < 0)
 	{
 		return false;
 	}
-	GLfloat t1 = (((-1*b) + sqrt(discriminant))/(2*a));
-	GLfloat t2 = (((-1*b) - sqrt(discriminant))/(2*a));
+	real t1 = (((-1*b) + sqrt(discriminant))/(2*a));
+	real t2 = (((-1*b) - sqrt(discriminant))/(2*a));
 	if(t1 < t2)
 	{
 		*t_val = t1;
@@ -40,77 +59,160 @@ bool Sphere::intersect(const Ray &ray, vec3 *point, GLfloat *t_val)
 		*t_val = t2;
 	}
 	*point = (*t_val * ray.direction) + ray.origin;
+	if(normal)
+		*normal = normalize(*point - center);
 
     return true;
 }
 
-vec3 Sphere::normal(const vec3 &intersection_point)
+template<typename real>
+bool Sphere<real>::uv(const rvec3<real> &intersection_point, rvec2<real> *coords, real *span)
+{
+	// The seam faces -x
+	rvec3<real> p = (intersection_point - center) / radius;
+	*coords = rvec2<real>((real)0.5 + atan2(p.z, p.x) / (real)(2 * M_PI), (real)0.5 - asin(glm::clamp(p.y, (real)-1, (real)1)) / (real)M_PI);
+	*span = (real)(2 * M_PI) * radius;
+	return true;
+}
+
+template<typename real>
+Triangle<real>::Triangle(rvec3<real> p0_, rvec3<real> p1_, rvec3<real> p2_, vec3 diffuse_colour_, vec3 specular_colour_, GLfloat phong_exponent_,  GLfloat reflectance_)
+: Object<real>(diffuse_colour_, specular_colour_, phong_exponent_, reflectance_)
+{
+	p0 = rest_p0 = p0_;
+	p1 = rest_p1 = p1_;
+	p2 = rest_p2 = p2_;
+}
+
+template<typename real>
+Bounds<real> Triangle<real>::bounds()
+{
+	Bounds<real> b;
+	b.expand(p0);
+	b.expand(p1);
+	b.expand(p2);
+	return b;
+}
+
+template<typename real>
+void Triangle<real>::transform(const rmat3<real> &rotation, const rvec3<real> &translation)
 {
-	return normalize(intersection_point - center);
+	rvec3<real> pivot = (rest_p0 + rest_p1 + rest_p2) / (real)3;
+	p0 = rotation * (rest_p0 - pivot) + pivot + translation;
+	p1 = rotation * (rest_p1 - pivot) + pivot + translation;
+	p2 = rotation * (rest_p2 - pivot) + pivot + translation;
 }
 
-Triangle::Triangle(vec3 p0_, vec3 p1_, vec3 p2_, vec3 diffuse_colour_, vec3 specular_colour_, GLfloat phong_exponent_,  GLfloat reflectance_)
-: Object(diffuse_colour_, specular_colour_, phong_exponent_, reflectance_)
+template<typename real>
+bool Triangle<real>::intersect(const Ray<real> &ray, rvec3<real> *point, real *t_val, rvec3<real> *normal)
 {
-	p0 = p0_;
-	p1 = p1_;
-	p2 = p2_;
+	if(!intersect_triangle(p0, p1, p2, ray, t_val))
+		return false;
+	*point = (*t_val * ray.direction) + ray.origin;
+	if(normal)
+		*normal = normalize(cross((p0 - p1), (p1 - p2)));
+
+    return true;
 }
 
-bool Triangle::intersect(const Ray &ray, vec3 *point, GLfloat *t_val)
+template<typename real>
+bool intersect_triangle(const rvec3<real> &p0, const rvec3<real> &p1, const rvec3<real> &p2, const Ray<real> &ray, real *t_val)
 {
-	vec3 p0_p1 = (p1 - p0);
-	vec3 p0_p2 = (p2 - p0);
-	vec3 pvec = cross(ray.direction, p0_p2);
-	GLfloat det = dot(p0_p1, pvec);
+	rvec3<real> p0_p1 = (p1 - p0);
+	rvec3<real> p0_p2 = (p2 - p0);
+	rvec3<real> pvec = cross(ray.direction, p0_p2);
+	real det = dot(p0_p1, pvec);
 
-	if(fabs(det) < numeric_limits<float>::epsilon())
+	if(fabs(det) < numeric_limits<real>::epsilon())
 		return false;
 
-	vec3 tvec = ray.origin - p0;
+	rvec3<real> tvec = ray.origin - p0;
 
-	GLfloat gamma = dot(tvec, pvec) / det;
+	real gamma = dot(tvec, pvec) / det;
 	if(gamma < 0 || gamma > 1)
 		return false;
 
-	vec3 qvec = cross(tvec, p0_p1);
-	GLfloat beta = dot(ray.direction, qvec) / det;
+	rvec3<real> qvec = cross(tvec, p0_p1);
+	real beta = dot(ray.direction, qvec) / det;
 	if(beta < 0 || beta > (1 - gamma))
 		return false;
 
 	*t_val = dot(p0_p2, qvec) / det;
-	*point = (*t_val * ray.direction) + ray.origin;
 
     return true;
 }
 
-vec3 Triangle::normal(const vec3 &intersection_point)
+template<typename real>
+bool Triangle<real>::uv(const rvec3<real> &intersection_point, rvec2<real> *coords, real *span)
+{
+	rvec3<real> e1 = p1 - p0, e2 = p2 - p0, d = intersection_point - p0;
+	real d11 = dot(e1, e1), d12 = dot(e1, e2), d22 = dot(e2, e2);
+	real denom = d11 * d22 - d12 * d12;
+	if(fabs(denom) < numeric_limits<real>::epsilon())
+		return false;
+	real d1 = dot(d, e1), d2 = dot(d, e2);
+	*coords = rvec2<real>((d22 * d1 - d12 * d2) / denom, (d11 * d2 - d12 * d1) / denom);
+	*span = sqrt(sqrt(d11 * d22));
+	return true;
+}
+
+template<typename real>
+Plane<real>::Plane(rvec3<real> normal_, rvec3<real> point_, vec3 diffuse_colour_, vec3 specular_colour_, GLfloat phong_exponent_,  GLfloat reflectance_)
+: Object<real>(diffuse_colour_, specular_colour_, phong_exponent_, reflectance_)
 {
-	return normalize(cross((p0 - p1), (p1 - p2)));
+	p_normal = rest_normal = normal_;
+	point = rest_point = point_;
 }
 
-Plane::Plane(vec3 normal_, vec3 point_, vec3 diffuse_colour_, vec3 specular_colour_, GLfloat phong_exponent_,  GLfloat reflectance_)
-: Object(diffuse_colour_, specular_colour_, phong_exponent_, reflectance_)
+template<typename real>
+Bounds<real> Plane<real>::bounds()
 {
-	p_normal = normal_;
-	point = point_;
+	return Bounds<real>();
 }
 
-bool Plane::intersect(const Ray &ray, vec3 *point, GLfloat *t_val)
+template<typename real>
+void Plane<real>::transform(const rmat3<real> &rotation, const rvec3<real> &translation)
 {
-    GLfloat w = dot(this->point - ray.origin, p_normal);
-    GLfloat a = dot(ray.direction, p_normal);
-	if(fabs(a) < numeric_limits<float>::epsilon())
+	p_normal = rotation * rest_normal;
+	point = rest_point + translation;
+}
+
+template<typename real>
+bool Plane<real>::intersect(const Ray<real> &ray, rvec3<real> *point, real *t_val, rvec3<real> *normal)
+{
+    real w = dot(this->point - ray.origin, p_normal);
+    real a = dot(ray.direction, p_normal);
+	if(fabs(a) < numeric_limits<real>::epsilon())
 		return false;
     *t_val = w/a;
     if(*t_val < 0)
        return false;
     *point = (*t_val * ray.direction) + ray.origin;
+    if(normal)
+        *normal = normalize(p_normal);
 
     return true;
 }
 
-vec3 Plane::normal(const vec3 &intersection_point)
+template<typename real>
+bool Plane<real>::uv(const rvec3<real> &intersection_point, rvec2<real> *coords, real *span)
 {
-	return normalize(p_normal);
+	rvec3<real> n = normalize(p_normal);
+	rvec3<real> tangent = normalize(cross(n, fabs(n.y) < 0.9 ? rvec3<real>(0, 1, 0) : rvec3<real>(1, 0, 0)));
+	rvec3<real> bitangent = cross(n, tangent);
+	rvec3<real> d = intersection_point - point;
+	*coords = rvec2<real>(dot(d, tangent), dot(d, bitangent));
+	*span = 1;
+	return true;
 }
+
+template class Object<GLfloat>;
+template class Object<GLdouble>;
+template class Sphere<GLfloat>;
+template class Sphere<GLdouble>;
+template class Triangle<GLfloat>;
+template class Triangle<GLdouble>;
+template class Plane<GLfloat>;
+template class Plane<GLdouble>;
+template bool intersect_triangle(const vec3 &p0, const vec3 &p1, const vec3 &p2, const Ray<GLfloat> &ray, GLfloat *t_val);
+template bool intersect_triangle(const dvec3 &p0, const dvec3 &p1, const dvec3 &p2, const Ray<GLdouble> &ray, GLdouble *t_val);
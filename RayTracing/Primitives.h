@@ -3,51 +3,94 @@
 
 #include <glm/glm.hpp>
 #include <GLFW/glfw3.h>
+#include "Precision.h"
 #include "Ray.h"
+#include "Bounds.h"
 using namespace glm;
 
+class Texture;
+
+template<typename real>
 class Object
 {
     public:
 	    Object(vec3 diffuse_colour_, vec3 specular_colour_, GLfloat phong_exponent_, GLfloat reflectance_);
+	    virtual ~Object() {}
 	    vec3 diffuse_colour;
 		vec3 specular_colour;
 		GLfloat reflectance;
 		GLfloat phong_exponent;
-	    virtual bool intersect(const Ray &ray, vec3 *point, GLfloat *t_val) = 0;
-	    virtual vec3 normal(const vec3 &intersection_point) = 0;
+		// Image the diffuse colour is multiplied by, NULL for a flat colour,
+		// repeated this many times per unit of surface coordinates
+		Texture *texture;
+		real texture_repeat;
+	    // Nearest point along the ray and its distance. The unit surface
+	    // normal there is written too unless normal is NULL.
+	    virtual bool intersect(const Ray<real> &ray, rvec3<real> *point, real *t_val, rvec3<real> *normal) = 0;
+	    // Box around the object as currently placed, planes have none
+	    virtual bool bounded() { return true; }
+	    virtual Bounds<real> bounds() = 0;
+	    // Places the object at its rest pose rotated about its rest centre,
+	    // then translated
+	    virtual void transform(const rmat3<real> &rotation, const rvec3<real> &translation) = 0;
+	    // Surface coordinates of a point on the object and the world length
+	    // one unit of them spans. False for objects that can't be textured.
+	    virtual bool uv(const rvec3<real> &, rvec2<real> *, real *) { return false; }
 };
 
-class Sphere : public Object
+template<typename real>
+class Sphere : public Object<real>
 {
 	public:
-	    Sphere(vec3 center_, GLfloat radius_, vec3 diffuse_colour_, vec3 specular_colour_, GLfloat phong_exponent_, GLfloat reflectance_);
-	    bool intersect(const Ray &ray, vec3 *point, GLfloat *t_val);
-	    vec3 normal(const vec3 &intersection_point);
+	    Sphere(rvec3<real> center_, real radius_, vec3 diffuse_colour_, vec3 specular_colour_, GLfloat phong_exponent_, GLfloat reflectance_);
+	    bool intersect(const Ray<real> &ray, rvec3<real> *point, real *t_val, rvec3<real> *normal);
+	    Bounds<real> bounds();
+	    void transform(const rmat3<real> &rotation, const rvec3<real> &translation);
+	    // Longitude and latitude
+	    bool uv(const rvec3<real> &intersection_point, rvec2<real> *coords, real *span);
+	    const rvec3<real> &get_center() const { return center; }
+	    real get_radius() const { return radius; }
 	private:
-		vec3 center;
-	    GLfloat radius;
+		rvec3<real> center, rest_center;
+	    real radius;
 };
 
-class Plane : public Object
+template<typename real>
+class Plane : public Object<real>
 {
 	public:
-	    Plane(vec3 normal_, vec3 point_, vec3 diffuse_colour_, vec3 specular_colour_, GLfloat phong_exponent_, GLfloat reflectance_);
-	    bool intersect(const Ray &ray, vec3 *point, GLfloat *t_val);
-	    vec3 normal(const vec3 &intersection_point);
+	    Plane(rvec3<real> normal_, rvec3<real> point_, vec3 diffuse_colour_, vec3 specular_colour_, GLfloat phong_exponent_, GLfloat reflectance_);
+	    bool intersect(const Ray<real> &ray, rvec3<real> *point, real *t_val, rvec3<real> *normal);
+	    bool bounded() { return false; }
+	    Bounds<real> bounds();
+	    void transform(const rmat3<real> &rotation, const rvec3<real> &translation);
+	    // World units along two axes in the plane
+	    bool uv(const rvec3<real> &intersection_point, rvec2<real> *coords, real *span);
+	    const rvec3<real> &get_normal() const { return p_normal; }
+	    const rvec3<real> &get_point() const { return point; }
 	private:
-		vec3 p_normal;
-	    vec3 point;
+		rvec3<real> p_normal, rest_normal;
+	    rvec3<real> point, rest_point;
 };
 
-class Triangle : public Object
+template<typename real>
+class Triangle : public Object<real>
 {
 	public:
-	    Triangle(vec3 p0_, vec3 p1_, vec3 p2_, vec3 diffuse_colour_, vec3 specular_colour_, GLfloat phong_exponent_, GLfloat reflectance_);
-	    bool intersect(const Ray &ray, vec3 *point, GLfloat *t_val);
-	    vec3 normal(const vec3 &intersection_point);
+	    Triangle(rvec3<real> p0_, rvec3<real> p1_, rvec3<real> p2_, vec3 diffuse_colour_, vec3 specular_colour_, GLfloat phong_exponent_, GLfloat reflectance_);
+	    bool intersect(const Ray<real> &ray, rvec3<real> *point, real *t_val, rvec3<real> *normal);
+	    Bounds<real> bounds();
+	    void transform(const rmat3<real> &rotation, const rvec3<real> &translation);
+	    // Barycentric, with p1 at (1, 0) and p2 at (0, 1)
+	    bool uv(const rvec3<real> &intersection_point, rvec2<real> *coords, real *span);
+	    const rvec3<real> &vertex(GLuint i) const { return i == 0 ? p0 : (i == 1 ? p1 : p2); }
 	private:
-		vec3 p0, p1, p2;
+		rvec3<real> p0, p1, p2;
+		rvec3<real> rest_p0, rest_p1, rest_p2;
 };
 
+// Shared by Triangle and the packed triangles of a ChunkedMesh
+template<typename real>
+bool intersect_triangle(const rvec3<real> &p0, const rvec3<real> &p1, const rvec3<real> &p2, const Ray<real> &ray, real *t_val);
+
 #endif
@@ -0,0 +1,281 @@
+/*
+ * Rasterizer.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#include "Rasterizer.h"
+#include "Parallel.h"
+
+#include <cmath>
+#include <limits>
+
+// Rows per job when rasterizing in parallel, each job owns its rows
+#define RASTER_BAND 32
+
+// Farthest hit a primary ray finds, as for traced rays
+#define RASTER_FAR 1E6
+
+template<typename real>
+Rasterizer<real>::Rasterizer()
+: width(0), height(0)
+{
+}
+
+template<typename real>
+void Rasterizer<real>::footprint(Object<real> *object, Camera &camera, Footprint *print)
+{
+	print->hidden = false;
+	print->shape = OTHER;
+	print->edge_count = 0;
+	print->x_min = 0;
+	print->x_max = width - 1;
+	print->y_min = 0;
+	print->y_max = height - 1;
+
+	// Inverse distance to the plane through point with normal n, along
+	// each pixel's direction. Zero when the eye is in the plane, which
+	// then shows only its edge.
+	auto flat = [&](const rvec3<real> &n, const rvec3<real> &point)
+	{
+		real w = dot(n, point - eye);
+		if(w == 0)
+		{
+			print->hidden = true;
+			return;
+		}
+		print->shape = FLAT;
+		Linear inverse_depth = { dot(n, corner) / w, dot(n, right) / w, dot(n, up) / w };
+		print->inverse_depth = inverse_depth;
+	};
+
+	Triangle<real> *triangle = dynamic_cast<Triangle<real> *>(object);
+	Plane<real> *plane = dynamic_cast<Plane<real> *>(object);
+	Sphere<real> *sphere = dynamic_cast<Sphere<real> *>(object);
+	if(triangle)
+	{
+		const rvec3<real> &p0 = triangle->vertex(0), &p1 = triangle->vertex(1), &p2 = triangle->vertex(2);
+		flat(cross(p1 - p0, p2 - p0), p0);
+		// A direction is inside when it is on the inner side of the plane
+		// through the eye and each edge
+		rvec3<real> to[3] = { p0 - eye, p1 - eye, p2 - eye };
+		real winding = dot(cross(to[0], to[1]), to[2]);
+		if(print->hidden || winding == 0)
+		{
+			print->hidden = true;
+			return;
+		}
+		for(GLuint i = 0; i < 3; i++)
+		{
+			rvec3<real> e = cross(to[i], to[(i + 1) % 3]) * (winding > 0 ? (real)1 : (real)-1);
+			Linear edge = { dot(e, corner), dot(e, right), dot(e, up) };
+			print->edges[i] = edge;
+		}
+		print->edge_count = 3;
+		print->flat_normal = normalize(cross((p0 - p1), (p1 - p2)));
+	}
+	else if(plane)
+	{
+		flat(plane->get_normal(), plane->get_point());
+		print->flat_normal = normalize(plane->get_normal());
+		return;
+	}
+	else if(sphere)
+	{
+		// |D|^2 t^2 + 2 (D.oc) t + oc.oc - r^2 = 0 along direction D
+		print->shape = ROUND;
+		print->center = sphere->get_center();
+		rvec3<real> oc = eye - print->center;
+		Linear half_b = { dot(corner, oc), dot(right, oc), dot(up, oc) };
+		print->half_b = half_b;
+		print->c = dot(oc, oc) - sphere->get_radius() * sphere->get_radius();
+	}
+	if(print->hidden || !object->bounded())
+		return;
+
+	// The rectangle around the projected box, the whole screen if the box
+	// reaches behind the camera
+	Bounds<real> box = object->bounds();
+	GLdouble x_min = std::numeric_limits<GLdouble>::max(), y_min = x_min;
+	GLdouble x_max = -x_min, y_max = -y_min;
+	for(GLuint corner_index = 0; corner_index < 8; corner_index++)
+	{
+		rvec3<real> p((corner_index & 1) ? box.max_point.x : box.min_point.x,
+		        (corner_index & 2) ? box.max_point.y : box.min_point.y,
+		        (corner_index & 4) ? box.max_point.z : box.min_point.z);
+		dvec2 pixel;
+		if(!camera.project(dvec3(p), &pixel))
+			return;
+		x_min = std::min(x_min, pixel.x);
+		x_max = std::max(x_max, pixel.x);
+		y_min = std::min(y_min, pixel.y);
+		y_max = std::max(y_max, pixel.y);
+	}
+	// One pixel of margin so rounding never loses a covered pixel
+	if(x_max < -1 || y_max < -1 || x_min > width || y_min > height)
+	{
+		print->hidden = true;
+		return;
+	}
+	print->x_min = std::max(print->x_min, (GLint)floor(x_min) - 1);
+	print->x_max = std::min(print->x_max, (GLint)ceil(x_max) + 1);
+	print->y_min = std::max(print->y_min, (GLint)floor(y_min) - 1);
+	print->y_max = std::min(print->y_max, (GLint)ceil(y_max) + 1);
+}
+
+// Narrows [x0, x1] to where f is positive along row y, with a pixel of
+// margin for the per pixel test to settle. False if no pixel is left.
+template<typename real>
+static bool clip_span(real c, real dx, GLint *x0, GLint *x1)
+{
+	if(dx == 0)
+		return c >= 0;
+	real root = -c / dx;
+	if(dx > 0 && root > *x0)
+		*x0 = root > *x1 ? *x1 + 1 : std::max(*x0, (GLint)floor(root) - 1);
+	else if(dx < 0 && root < *x1)
+		*x1 = root < *x0 ? *x0 - 1 : std::min(*x1, (GLint)ceil(root) + 1);
+	return *x0 <= *x1;
+}
+
+template<typename real>
+void Rasterizer<real>::rasterize_rows(const vector<Object<real>*> &objects, const vector<Footprint> &prints, Camera &camera, GLint row_begin, GLint row_end)
+{
+	// Objects in order with a strict depth test, so ties go to the lowest
+	// index just as they do for traced rays
+	for(GLuint i = 0; i < objects.size(); i++)
+	{
+		const Footprint &print = prints[i];
+		if(print.hidden)
+			continue;
+		GLint y0 = std::max(row_begin, print.y_min), y1 = std::min(row_end - 1, print.y_max);
+		for(GLint y = y0; y <= y1; y++)
+		{
+			GLint x0 = print.x_min, x1 = print.x_max;
+			real *depths = &inverse_depths[y*width];
+			GLint *row_ids = &ids[y*width];
+			if(print.shape == FLAT)
+			{
+				// Between the edges and in front of the eye
+				const Linear &inverse_depth = print.inverse_depth;
+				bool covered = clip_span(inverse_depth.c + y*inverse_depth.dy, inverse_depth.dx, &x0, &x1);
+				for(GLuint e = 0; e < print.edge_count && covered; e++)
+					covered = clip_span(print.edges[e].c + y*print.edges[e].dy, print.edges[e].dx, &x0, &x1);
+				if(!covered)
+					continue;
+				for(GLint x = x0; x <= x1; x++)
+				{
+					real inverse = inverse_depth.at(x, y);
+					if(inverse <= depths[x] || inverse <= 0)
+						continue;
+					bool inside = true;
+					for(GLuint e = 0; e < print.edge_count && inside; e++)
+						inside = print.edges[e].at(x, y) >= 0;
+					if(inside)
+					{
+						depths[x] = inverse;
+						row_ids[x] = i;
+					}
+				}
+			}
+			else if(print.shape == ROUND)
+			{
+				// The nearer root, which must be in front as a traced ray's
+				// must
+				for(GLint x = x0; x <= x1; x++)
+				{
+					rvec3<real> d = direction(x, y);
+					real a = dot(d, d), half_b = print.half_b.at(x, y);
+					real discriminant = half_b*half_b - a*print.c;
+					if(discriminant < 0)
+						continue;
+					real root = -half_b - sqrt(discriminant);
+					if(root <= 0)
+						continue;
+					real inverse = a / root;
+					if(inverse > depths[x])
+					{
+						depths[x] = inverse;
+						row_ids[x] = i;
+					}
+				}
+			}
+			else
+			{
+				for(GLint x = x0; x <= x1; x++)
+				{
+					Ray<real> ray(rvec3<real>(0.0), rvec3<real>(0.0));
+					camera.generate_ray(x, y, &ray);
+					rvec3<real> point, normal;
+					real t_val;
+					if(!objects[i]->intersect(ray, &point, &t_val, &normal) || t_val <= std::numeric_limits<real>::epsilon())
+						continue;
+					real inverse = length(direction(x, y)) / t_val;
+					if(inverse > depths[x])
+					{
+						depths[x] = inverse;
+						row_ids[x] = i;
+						points[y*width + x] = point;
+						normals[y*width + x] = normal;
+					}
+				}
+			}
+		}
+	}
+
+	// Hit points and normals of the nearest flat and round objects, other
+	// objects gave theirs
+	for(GLint y = row_begin; y < row_end; y++)
+	{
+		for(GLint x = 0; x < width; x++)
+		{
+			GLint pixel = y*width + x;
+			if(ids[pixel] < 0)
+				continue;
+			const Footprint &print = prints[ids[pixel]];
+			if(print.shape == OTHER)
+				continue;
+			points[pixel] = eye + direction(x, y) / inverse_depths[pixel];
+			normals[pixel] = print.shape == FLAT ? print.flat_normal : normalize(points[pixel] - print.center);
+		}
+	}
+}
+
+template<typename real>
+void Rasterizer<real>::render(const vector<Object<real>*> &objects, Camera &camera)
+{
+	// Buffers are only allocated once the mode is used
+	width = camera.width();
+	height = camera.height();
+	ids.resize(width * height);
+	inverse_depths.resize(width * height);
+	points.resize(width * height);
+	normals.resize(width * height);
+	eye = rvec3<real>(camera.position);
+	camera.pixel_directions<real>(&corner, &right, &up);
+
+	vector<Footprint> prints(objects.size());
+	for(GLuint i = 0; i < objects.size(); i++)
+		footprint(objects[i], camera, &prints[i]);
+
+	GLuint bands = (height + RASTER_BAND - 1) / RASTER_BAND;
+	run_workers(bands, [&](GLuint band)
+	{
+		GLint row_begin = band * RASTER_BAND;
+		GLint row_end = std::min(height, (GLint)(band + 1) * RASTER_BAND);
+		for(GLint y = row_begin; y < row_end; y++)
+		{
+			for(GLint x = 0; x < width; x++)
+			{
+				GLint pixel = y*width + x;
+				inverse_depths[pixel] = length(direction(x, y)) / (real)RASTER_FAR;
+				ids[pixel] = -1;
+			}
+		}
+		rasterize_rows(objects, prints, camera, row_begin, row_end);
+		return true;
+	});
+}
+
+template class Rasterizer<GLfloat>;
+template class Rasterizer<GLdouble>;
@@ -0,0 +1,84 @@
+/*
+ * Rasterizer.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#ifndef RASTERIZER_H
+#define RASTERIZER_H
+
+#include <glm/glm.hpp>
+#include <GLFW/glfw3.h>
+#include <vector>
+
+#include "Camera.h"
+#include "Precision.h"
+#include "Primitives.h"
+
+using namespace std;
+using namespace glm;
+
+// Finds the primary hit of every pixel without tracing primary rays. Each
+// object is scan converted into a visibility buffer of nearest object,
+// hit point and normal. The direction through a pixel is linear in its
+// coordinates, so over a triangle or plane the inverse of the distance
+// along it is too, and so are the triangle's edge tests against the eye.
+// Triangles and planes are filled row by row between their edges with the
+// inverse distance stepped across the row, spheres over the rectangle of
+// their box with a quadratic per pixel. Other objects, such as streamed
+// meshes, fall back to their own intersection test over their rectangle.
+// Where two surfaces meet exactly on a pixel's ray either may be kept, as
+// for traced rays.
+template<typename real>
+class Rasterizer
+{
+	public:
+	    Rasterizer();
+	    void render(const vector<Object<real>*> &objects, Camera &camera);
+	    // Object seen at a pixel, -1 for none
+	    GLint object(GLint x, GLint y) const { return ids[y*width + x]; }
+	    const rvec3<real> &point(GLint x, GLint y) const { return points[y*width + x]; }
+	    const rvec3<real> &normal(GLint x, GLint y) const { return normals[y*width + x]; }
+	private:
+	    // c + x*dx + y*dy at pixel (x, y)
+	    struct Linear
+	    {
+	        real c, dx, dy;
+	        real at(real x, real y) const { return c + x*dx + y*dy; }
+	    };
+	    enum Shape { FLAT, ROUND, OTHER };
+	    // How an object is scan converted
+	    struct Footprint
+	    {
+	        Shape shape;
+	        bool hidden;
+	        // Pixel rectangle it can cover
+	        GLint x_min, x_max, y_min, y_max;
+	        // Flat: inverse distance along the pixel's direction, the edges
+	        // of a triangle (none for a plane), each non-negative inside,
+	        // and the normal
+	        Linear inverse_depth;
+	        Linear edges[3];
+	        GLuint edge_count;
+	        rvec3<real> flat_normal;
+	        // Round: half the linear term of the quadratic, the constant
+	        // term and the centre
+	        Linear half_b;
+	        real c;
+	        rvec3<real> center;
+	    };
+	    // Of the camera's image, rows are packed
+	    GLint width, height;
+	    vector<GLint> ids;
+	    // Inverse distance along each pixel's direction, larger is nearer
+	    vector<real> inverse_depths;
+	    vector<rvec3<real> > points;
+	    vector<rvec3<real> > normals;
+	    // The direction through pixel (x, y) is corner + x*right + y*up
+	    rvec3<real> eye, corner, right, up;
+	    rvec3<real> direction(GLint x, GLint y) const { return corner + (real)x*right + (real)y*up; }
+	    void footprint(Object<real> *object, Camera &camera, Footprint *print);
+	    void rasterize_rows(const vector<Object<real>*> &objects, const vector<Footprint> &prints, Camera &camera, GLint row_begin, GLint row_end);
+};
+
+#endif
@@ -6,10 +6,17 @@
  */
 #include "Ray.h"
 
-Ray::Ray(glm::vec3 origin_, glm::vec3 direction_)
+template<typename real>
+Ray<real>::Ray(rvec3<real> origin_, rvec3<real> direction_)
 {
 	origin = origin_;
 	direction = direction_;
+	cone_width = 0;
+	cone_spread = 0;
 }
 
+template class Ray<GLfloat>;
+template class Ray<GLdouble>;
+
+
 
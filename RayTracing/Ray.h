@@ -8,14 +8,20 @@
 #define RAY_H
 
 #include <glm/glm.hpp>
+#include "Precision.h"
 
 using namespace glm;
+template<typename real>
 class Ray
 {
     public:
-	    Ray(vec3 origin_, vec3 direction_);
-	    vec3 origin;
-	    vec3 direction;
+	    Ray(rvec3<real> origin_, rvec3<real> direction_);
+	    rvec3<real> origin;
+	    rvec3<real> direction;
+	    // Cone around the ray covering its pixel: width at the origin and
+	    // growth per unit of distance, for picking texture detail
+	    real cone_width;
+	    real cone_spread;
 };
 
 #endif
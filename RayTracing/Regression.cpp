@@ -0,0 +1,229 @@
+/*
+ * Regression.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#include "Regression.h"
+#include "ImageBuffer.h"
+#include "Scene.h"
+
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+#include <sys/stat.h>
+
+// Window edge and step, in pixels, of the structural similarity
+#define SSIM_WINDOW 8
+#define SSIM_STEP 4
+
+Regression::Regression()
+{
+	for(GLuint i = 1; i <= 3; i++)
+		scene_files.push_back("scene" + to_string(i) + ".txt");
+	directory = "regression";
+	update = false;
+	perceptual = false;
+	max_error = 2E-3f;
+	min_psnr = 60;
+	min_ssim = 0.99;
+	time_threshold = 0.2;
+	runs = 3;
+}
+
+static GLfloat luminance(const vec3 &c)
+{
+	return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+}
+
+ImageDiff Regression::compare(const vector<vec3> &image, const vector<vec3> &reference, GLint width, GLint height, bool perceptual)
+{
+	ImageDiff diff;
+	diff.max_error = 0;
+	GLdouble squared = 0;
+	for(size_t i = 0; i < image.size(); i++)
+	{
+		vec3 d = abs(image[i] - reference[i]);
+		diff.max_error = std::max(diff.max_error, std::max(d.r, std::max(d.g, d.b)));
+		squared += d.r*d.r + d.g*d.g + d.b*d.b;
+	}
+	GLdouble mse = squared / (3.0 * image.size());
+	diff.psnr = mse > 0 ? 10 * log10(1 / mse) : numeric_limits<GLdouble>::infinity();
+
+	// Overlapping windows, each scored on the mean, variance and covariance
+	// of its luminance
+	diff.ssim = 1;
+	if(!perceptual)
+		return diff;
+	const GLdouble c1 = 0.01 * 0.01, c2 = 0.03 * 0.03;
+	GLdouble total = 0;
+	GLuint windows = 0;
+	for(GLint y0 = 0; y0 + SSIM_WINDOW <= height; y0 += SSIM_STEP)
+	{
+		for(GLint x0 = 0; x0 + SSIM_WINDOW <= width; x0 += SSIM_STEP)
+		{
+			GLdouble sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+			for(GLint y = y0; y < y0 + SSIM_WINDOW; y++)
+			{
+				for(GLint x = x0; x < x0 + SSIM_WINDOW; x++)
+				{
+					GLdouble a = luminance(image[y*width + x]), b = luminance(reference[y*width + x]);
+					sa += a; sb += b;
+					saa += a*a; sbb += b*b; sab += a*b;
+				}
+			}
+			GLdouble n = SSIM_WINDOW * SSIM_WINDOW;
+			GLdouble ma = sa / n, mb = sb / n;
+			GLdouble va = saa / n - ma*ma, vb = sbb / n - mb*mb, cov = sab / n - ma*mb;
+			total += ((2*ma*mb + c1) * (2*cov + c2)) / ((ma*ma + mb*mb + c1) * (va + vb + c2));
+			windows++;
+		}
+	}
+	if(windows > 0)
+		diff.ssim = total / windows;
+	return diff;
+}
+
+string Regression::reference_name(const string &scene_file) const
+{
+	string name = scene_file.substr(scene_file.find_last_of('/') + 1);
+	return directory + "/" + name.substr(0, name.find_last_of('.')) + ".pfm";
+}
+
+map<string, GLdouble> Regression::read_baseline() const
+{
+	map<string, GLdouble> seconds;
+	ifstream input((directory + "/baseline.txt").c_str());
+	string scene_file;
+	GLdouble time;
+	while(input >> scene_file >> time)
+		seconds[scene_file] = time;
+	return seconds;
+}
+
+bool Regression::write_baseline(const map<string, GLdouble> &seconds) const
+{
+	ofstream output((directory + "/baseline.txt").c_str(), ios::trunc);
+	for(map<string, GLdouble>::const_iterator it = seconds.begin(); it != seconds.end(); ++it)
+		output << it->first << " " << it->second << endl;
+	return output.good();
+}
+
+int Regression::run()
+{
+	if(update)
+		mkdir(directory.c_str(), 0755);
+	map<string, GLdouble> baseline = read_baseline();
+	ofstream history((directory + "/history.txt").c_str(), ios::app);
+	if(!history)
+	{
+		cout << "Regression ERROR: Could not open " << directory << "/history.txt, does the directory exist?" << endl;
+		return -1;
+	}
+
+	GLuint failures = 0;
+	bool new_baseline = false;
+	for(GLuint i = 0; i < scene_files.size(); i++)
+	{
+		// Each scene is checked in the precision it picks for itself, then
+		// rendered and timed in the other one for comparison
+		Scene scene(true);
+		scene.parse(scene_files[i]);
+		bool failed = false;
+		GLdouble own_seconds = 0;
+		for(GLuint pass = 0; pass < 2; pass++)
+		{
+			bool own = pass == 0;
+			if(!own)
+				scene.set_precision(scene.double_precision() ? PRECISION_FLOAT : PRECISION_DOUBLE);
+			string key = scene_files[i] + (scene.double_precision() ? ":double" : ":float");
+
+			// The fastest of a few renders, to keep scheduling noise out of
+			// the timing
+			GLdouble seconds = numeric_limits<GLdouble>::infinity();
+			for(GLuint r = 0; r < std::max(runs, 1u); r++)
+			{
+				chrono::steady_clock::time_point start = chrono::steady_clock::now();
+				scene.draw();
+				seconds = std::min(seconds, chrono::duration<GLdouble>(chrono::steady_clock::now() - start).count());
+			}
+			if(own)
+				own_seconds = seconds;
+
+			GLint width = scene.image.Width(), height = scene.image.Height();
+			vector<vec3> image(width * height);
+			for(GLint y = 0; y < height; y++)
+				for(GLint x = 0; x < width; x++)
+					image[y*width + x] = scene.image.GetPixel(x, y);
+
+			if(update)
+			{
+				if(own && !ImageBuffer::SavePixelsPFM(reference_name(scene_files[i]), width, height, &image[0]))
+					failed = true;
+				baseline[key] = seconds;
+				cout << "Regression " << key << ": " << (own ? "reference updated, " : "baseline updated, ") << seconds << "s" << endl;
+				continue;
+			}
+
+			// The other precision only has to keep its time, its image is
+			// reported against the same reference
+			vector<vec3> reference;
+			GLint reference_width, reference_height;
+			string verdict;
+			ImageDiff diff = { 0, 0, 0 };
+			if(!ImageBuffer::LoadPixelsPFM(reference_name(scene_files[i]), &reference_width, &reference_height, &reference))
+			{
+				verdict = "FAIL (no reference, run with --update)";
+			}
+			else if(reference_width != width || reference_height != height)
+			{
+				verdict = "FAIL (reference is " + to_string(reference_width) + "x" + to_string(reference_height) + ")";
+			}
+			else
+			{
+				diff = compare(image, reference, width, height, perceptual);
+				if(own && (diff.max_error > max_error || diff.psnr < min_psnr || (perceptual && diff.ssim < min_ssim)))
+					verdict = "FAIL (image drifted)";
+				else if(baseline.count(key) && seconds > baseline[key] * (1 + time_threshold))
+					verdict = "FAIL (slower than baseline)";
+				else
+					verdict = "PASS";
+			}
+			// Times only mean something on the machine they were taken on,
+			// so the first passing run on a machine records them
+			bool recorded = false;
+			if(verdict == "PASS" && !baseline.count(key))
+			{
+				baseline[key] = seconds;
+				new_baseline = recorded = true;
+			}
+			if(verdict != "PASS")
+				failed = true;
+
+			cout << "Regression " << key << ": max error " << diff.max_error << ", PSNR " << diff.psnr << " dB";
+			if(perceptual)
+				cout << ", SSIM " << diff.ssim;
+			cout << ", " << seconds << "s";
+			if(!own)
+				cout << " (" << seconds / own_seconds << "x the scene's own precision)";
+			if(recorded)
+				cout << " (baseline recorded)";
+			else if(baseline.count(key))
+				cout << " (baseline " << baseline[key] << "s)";
+			cout << " " << verdict << endl;
+			history << time(NULL) << " " << key << " " << seconds << " " << diff.max_error << " " << diff.psnr << " "
+			        << diff.ssim << " " << (verdict == "PASS" ? "PASS" : "FAIL") << endl;
+		}
+		if(failed)
+			failures++;
+	}
+
+	if((update || new_baseline) && !write_baseline(baseline))
+		failures++;
+	cout << "Regression " << (failures == 0 ? "passed" : "FAILED") << ", " << failures << " of " << scene_files.size() << " scenes failed" << endl;
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+/*
+ * Regression.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#ifndef REGRESSION_H
+#define REGRESSION_H
+
+#include <glm/glm.hpp>
+#include <GLFW/glfw3.h>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+// How far a render is from its reference image
+struct ImageDiff
+{
+	GLfloat max_error;
+	// Peak signal to noise ratio in dB for a peak of 1, infinite if equal
+	GLdouble psnr;
+	// Mean structural similarity of luminance, 1 if equal
+	GLdouble ssim;
+};
+
+// Renders reference scenes and checks them against stored golden images
+// and render times. The directory holds sceneN.pfm references, baseline.txt
+// with their render times, and history.txt, which every run appends to.
+// The references are committed; render times are recorded by the first
+// passing run on each machine. Run with update set to record new references
+// and baseline times. Every scene is also rendered in the precision it does
+// not pick, which is timed against its own baseline and whose drift from
+// the reference is reported.
+class Regression
+{
+	public:
+	    Regression();
+	    vector<string> scene_files;
+	    string directory;
+	    bool update;
+	    // Also compare structural similarity, slower than the other metrics
+	    bool perceptual;
+	    GLfloat max_error;
+	    GLdouble min_psnr;
+	    GLdouble min_ssim;
+	    // Fails when a render is this fraction slower than its baseline
+	    GLdouble time_threshold;
+	    // Renders per scene, the fastest one is timed
+	    GLuint runs;
+	    // Returns 0 if every scene passed
+	    int run();
+
+	    static ImageDiff compare(const vector<vec3> &image, const vector<vec3> &reference, GLint width, GLint height, bool perceptual);
+	private:
+	    // Render seconds by scene file and precision, e.g. scene1.txt:float
+	    map<string, GLdouble> read_baseline() const;
+	    bool write_baseline(const map<string, GLdouble> &seconds) const;
+	    string reference_name(const string &scene_file) const;
+};
+
+#endif
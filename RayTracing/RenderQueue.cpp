@@ -0,0 +1,103 @@
+/*
+ * RenderQueue.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#include "RenderQueue.h"
+#include "ImageBuffer.h"
+#include "Parallel.h"
+#include "Scene.h"
+
+#include <thread>
+
+RenderQueue::Job::Job(Scene *scene_, const Camera &view_, const string &output_file_, const Progress &progress_)
+: scene(scene_), view(view_), output_file(output_file_), progress(progress_), next_tile(0), tiles_done(0)
+{
+	tile_count = ((view.width() + TILE_SIZE - 1) / TILE_SIZE) * ((view.height() + TILE_SIZE - 1) / TILE_SIZE);
+}
+
+RenderQueue::RenderQueue()
+: next_pending(0), turn(0), saved(0)
+{
+}
+
+GLuint RenderQueue::submit(Scene *scene, const Camera &view, const string &output_file, const Progress &progress)
+{
+	jobs.emplace_back(scene, view, output_file, progress);
+	return jobs.size() - 1;
+}
+
+// Hands out the next tile of the active jobs in turn, activating queued jobs
+// as the active ones run out of tiles
+bool RenderQueue::next_tile(GLuint *job_index, GLuint *tile)
+{
+	lock_guard<mutex> guard(schedule_lock);
+	while(active.size() < QUEUE_ACTIVE_JOBS && next_pending < jobs.size())
+	{
+		Job &job = jobs[next_pending];
+		job.pixels.resize(job.view.width() * job.view.height());
+		active.push_back(next_pending++);
+	}
+	if(active.empty())
+		return false;
+
+	turn %= active.size();
+	Job &job = jobs[active[turn]];
+	*job_index = active[turn];
+	*tile = job.next_tile++;
+	// The next job in turn moves into this slot when this one is used up
+	if(job.next_tile == job.tile_count)
+		active.erase(active.begin() + turn);
+	else
+		turn++;
+	return true;
+}
+
+void RenderQueue::finish(Job &job)
+{
+	bool ok;
+	GLint width = job.view.width(), height = job.view.height();
+	if(job.output_file.size() > 4 && job.output_file.compare(job.output_file.size() - 4, 4, ".pfm") == 0)
+		ok = ImageBuffer::SavePixelsPFM(job.output_file, width, height, &job.pixels[0]);
+	else
+		ok = ImageBuffer::SavePixels(job.output_file, width, height, &job.pixels[0]);
+	vector<vec3>().swap(job.pixels);
+	if(ok)
+		saved++;
+}
+
+GLuint RenderQueue::run()
+{
+	active.clear();
+	next_pending = 0;
+	turn = 0;
+	saved = 0;
+
+	// One loop per core, each taking tiles from whichever job is next
+	run_workers(std::max(1u, std::thread::hardware_concurrency()), [&](GLuint)
+	{
+		vector<vec3> colours(TILE_SIZE * TILE_SIZE);
+		GLuint job_index, tile;
+		while(next_tile(&job_index, &tile))
+		{
+			Job &job = jobs[job_index];
+			GLint x0, y0, w, h;
+			Scene::tile_rect(job.view, tile, &x0, &y0, &w, &h);
+			job.scene->trace_tile(job.view, tile, &colours[0]);
+			for(GLint y = 0; y < h; y++)
+				std::copy(&colours[y*w], &colours[y*w] + w, &job.pixels[(y0 + y) * job.view.width() + x0]);
+
+			// Whoever finishes the last tile saves the image
+			GLuint done = ++job.tiles_done;
+			if(job.progress)
+				job.progress(job_index, done, job.tile_count);
+			if(done == job.tile_count)
+				finish(job);
+		}
+		return true;
+	});
+
+	jobs.clear();
+	return saved;
+}
@@ -0,0 +1,72 @@
+/*
+ * RenderQueue.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <glm/glm.hpp>
+#include <GLFW/glfw3.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Camera.h"
+
+using namespace std;
+using namespace glm;
+
+class Scene;
+
+// How many jobs have images allocated and tiles handed out at once
+#define QUEUE_ACTIVE_JOBS 4
+
+// Renders many scenes, or many views of the same scene, on one set of
+// threads. Tiles of the active jobs are handed out in turn, so every job
+// makes progress and a thread never idles while any job has tiles left.
+// Views only read their scene, so they share its objects, BVH and textures.
+// A finished job is saved by the thread that traced its last tile.
+class RenderQueue
+{
+	public:
+	    // Called on a render thread each time a tile of job finishes
+	    typedef function<void(GLuint job, GLuint tiles_done, GLuint tile_count)> Progress;
+	    RenderQueue();
+	    // Queues a view of a scene, saved to output_file as a pfm if it ends
+	    // in .pfm and through Magick++ otherwise. Returns the job's number.
+	    GLuint submit(Scene *scene, const Camera &view, const string &output_file, const Progress &progress = Progress());
+	    // Renders every queued job and empties the queue. Returns how many
+	    // were saved.
+	    GLuint run();
+	private:
+	    struct Job
+	    {
+	        Job(Scene *scene_, const Camera &view_, const string &output_file_, const Progress &progress_);
+	        Scene *scene;
+	        Camera view;
+	        string output_file;
+	        Progress progress;
+	        GLuint tile_count;
+	        GLuint next_tile;
+	        atomic<GLuint> tiles_done;
+	        vector<vec3> pixels;
+	    };
+	    bool next_tile(GLuint *job_index, GLuint *tile);
+	    void finish(Job &job);
+
+	    // Jobs are never moved once queued, threads hold on to them
+	    deque<Job> jobs;
+	    mutex schedule_lock;
+	    // Jobs with tiles still to hand out, visited round robin
+	    vector<GLuint> active;
+	    GLuint next_pending;
+	    GLuint turn;
+	    atomic<GLuint> saved;
+};
+
+#endif
@@ -0,0 +1,183 @@
+/*
+ * Reprojection.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#include "Reprojection.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+
+// Pixels shaded per job, small so a frame stops close to its deadline
+#define REPROJECT_CHUNK 64
+
+static GLdouble seconds_now()
+{
+	return chrono::duration<GLdouble>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template<typename real>
+Reprojection<real>::Reprojection()
+: camera(50), valid(false)
+{
+	last_stats.reused = last_stats.shaded = last_stats.pending = 0;
+}
+
+template<typename real>
+void Reprojection<real>::reset()
+{
+	valid = false;
+}
+
+template<typename real>
+void Reprojection<real>::reproject(const Camera &view)
+{
+	GLint width = view.width(), height = view.height();
+	if(order.size() != (size_t)(width * height))
+	{
+		order.resize(width * height);
+		for(GLuint i = 0; i < order.size(); i++)
+			order[i] = i;
+		shuffle(order.begin(), order.end(), minstd_rand(1));
+	}
+
+	previous.swap(samples);
+	Sample empty = { vec3(0.0), rvec3<real>(0.0), 0, false };
+	samples.assign(width * height, empty);
+	vector<real> depths(width * height, std::numeric_limits<real>::max());
+	vector<char> filled(width * height, 0);
+	bool reuse = valid;
+	camera = view;
+	valid = true;
+	last_stats.reused = 0;
+	if(!reuse)
+		return;
+
+	// Every old sample lands on the pixel nearest its point in the new
+	// view, the nearest point to the camera winning. Holes the last frame
+	// never traced have no point to move.
+	for(GLuint i = 0; i < previous.size(); i++)
+	{
+		const Sample &old = previous[i];
+		if(!old.shaded)
+			continue;
+		dvec2 pixel;
+		if(!view.project(dvec3(old.point), &pixel))
+			continue;
+		GLint x = (GLint)floor(pixel.x + 0.5), y = (GLint)floor(pixel.y + 0.5);
+		if(x < 0 || y < 0 || x >= width || y >= height)
+			continue;
+		GLint target = y*width + x;
+		real depth = length(old.point - rvec3<real>(view.position));
+		if(depth >= depths[target])
+			continue;
+		depths[target] = depth;
+		samples[target] = old;
+		samples[target].age = std::min(old.age + 1, (GLuint)REPROJECT_MAX_AGE);
+		filled[target] = 1;
+	}
+
+	// Holes stay unshaded, showing a filled neighbour until they are traced
+	for(GLint y = 0; y < height; y++)
+	{
+		for(GLint x = 0; x < width; x++)
+		{
+			GLint pixel = y*width + x;
+			if(filled[pixel])
+			{
+				last_stats.reused++;
+				continue;
+			}
+			samples[pixel].shaded = false;
+			GLint neighbours[4][2] = { { x - 1, y }, { x + 1, y }, { x, y - 1 }, { x, y + 1 } };
+			for(GLuint n = 0; n < 4; n++)
+			{
+				GLint nx = neighbours[n][0], ny = neighbours[n][1];
+				if(nx >= 0 && ny >= 0 && nx < width && ny < height && filled[ny*width + nx])
+				{
+					samples[pixel].colour = samples[ny*width + nx].colour;
+					break;
+				}
+			}
+		}
+	}
+}
+
+template<typename real>
+void Reprojection<real>::shade(Tracer<real> &tracer, const Camera &view, GLuint pixel)
+{
+	Sample &sample = samples[pixel];
+	Ray<real> ray(rvec3<real>(0.0), rvec3<real>(0.0));
+	view.generate_ray(pixel % view.width(), pixel / view.width(), &ray);
+
+	// A miss is kept far along its ray, so it reprojects like a distant
+	// background
+	vec3 colour(0.0);
+	rvec3<real> normal;
+	GLint object = tracer.first_hit(ray, &sample.point, &normal);
+	if(object >= 0)
+		tracer.trace_hit(ray, object, sample.point, normal, &colour, 10);
+	else
+		sample.point = ray.origin + normalize(ray.direction) * (real)REPROJECT_FAR;
+	sample.colour = colour;
+	sample.age = 0;
+	sample.shaded = true;
+}
+
+template<typename real>
+bool Reprojection<real>::render(Tracer<real> &tracer, const Camera &view, GLdouble budget_seconds, vector<vec3> *colours)
+{
+	GLdouble deadline = seconds_now() + budget_seconds;
+	last_stats.reused = 0;
+	if(!valid || !view.same_view(camera))
+		reproject(view);
+
+	// Unshaded pixels go first, then reused ones from the oldest, each
+	// group in shuffled order
+	const GLuint urgencies = REPROJECT_MAX_AGE + 2;
+	vector<GLuint> starts(urgencies + 1, 0);
+	vector<GLuint> urgency(samples.size());
+	for(GLuint i = 0; i < samples.size(); i++)
+	{
+		urgency[i] = samples[i].shaded ? samples[i].age : urgencies - 1;
+		starts[urgencies - urgency[i]]++;
+	}
+	for(GLuint u = 1; u <= urgencies; u++)
+		starts[u] += starts[u - 1];
+	vector<GLuint> todo(samples.size() - (starts[urgencies] - starts[urgencies - 1]));
+	for(GLuint i = 0; i < order.size(); i++)
+	{
+		GLuint u = urgency[order[i]];
+		if(u > 0)
+			todo[starts[urgencies - 1 - u]++] = order[i];
+	}
+
+	// The first chunk always runs, so even an overloaded frame makes progress
+	atomic<GLuint> shaded(0);
+	GLuint chunks = (todo.size() + REPROJECT_CHUNK - 1) / REPROJECT_CHUNK;
+	run_workers(chunks, [&](GLuint chunk)
+	{
+		if(chunk > 0 && seconds_now() >= deadline)
+			return false;
+		GLuint end = std::min((GLuint)todo.size(), (chunk + 1) * REPROJECT_CHUNK);
+		for(GLuint i = chunk * REPROJECT_CHUNK; i < end; i++)
+			shade(tracer, view, todo[i]);
+		shaded += end - chunk * REPROJECT_CHUNK;
+		return true;
+	});
+	last_stats.shaded = shaded;
+	last_stats.pending = todo.size() - shaded;
+
+	colours->resize(samples.size());
+	for(GLuint i = 0; i < samples.size(); i++)
+		(*colours)[i] = samples[i].colour;
+	return last_stats.pending == 0;
+}
+
+template class Reprojection<GLfloat>;
+template class Reprojection<GLdouble>;
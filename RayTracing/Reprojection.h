@@ -0,0 +1,77 @@
+/*
+ * Reprojection.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#ifndef REPROJECTION_H
+#define REPROJECTION_H
+
+#include <glm/glm.hpp>
+#include <GLFW/glfw3.h>
+#include <vector>
+
+#include "Camera.h"
+#include "Precision.h"
+#include "Tracer.h"
+
+using namespace std;
+using namespace glm;
+
+// How far along its ray a pixel that hit nothing is placed
+#define REPROJECT_FAR 1E5
+
+// Frames a reused pixel is counted as aging, older ones are no more urgent
+#define REPROJECT_MAX_AGE 64
+
+// Keeps the shaded pixels of the last interactive frame with the surface
+// points they show. When the view changes each point is projected into the
+// new view, the nearest one to the camera keeping its pixel, at no cost in
+// rays. Pixels nothing lands on were uncovered and are traced first, then
+// reused ones are traced again oldest first, for as long as the frame's
+// time allows. Once the view holds still the frame converges to exactly
+// what a full render gives. Surfaces coming into view from outside the
+// last frame can hide behind reused pixels until those are retraced.
+template<typename real>
+class Reprojection
+{
+	public:
+	    struct Stats
+	    {
+	        GLuint reused;
+	        GLuint shaded;
+	        // Still to shade for this view
+	        GLuint pending;
+	    };
+	    Reprojection();
+	    // Renders view into colours (rows packed) in about budget seconds.
+	    // Returns true once every pixel is shaded for this view, when there
+	    // is nothing left to refine.
+	    bool render(Tracer<real> &tracer, const Camera &view, GLdouble budget_seconds, vector<vec3> *colours);
+	    // Forgets the previous frame, for when the scene itself changed
+	    void reset();
+	    const Stats &stats() const { return last_stats; }
+	private:
+	    struct Sample
+	    {
+	        vec3 colour;
+	        rvec3<real> point;
+	        // Views the colour was reused for since it was shaded
+	        GLuint age;
+	        // Otherwise colour is a stand-in from the previous frame
+	        bool shaded;
+	    };
+	    void reproject(const Camera &view);
+	    void shade(Tracer<real> &tracer, const Camera &view, GLuint pixel);
+
+	    Camera camera;
+	    bool valid;
+	    vector<Sample> samples;
+	    vector<Sample> previous;
+	    // Pixels in a fixed shuffled order, so a frame that runs out of time
+	    // leaves its unshaded pixels spread over the image
+	    vector<GLuint> order;
+	    Stats last_stats;
+};
+
+#endif
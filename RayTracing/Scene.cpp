@@ -9,54 +9,611 @@
 #include "Tracer.h"
 #include "Camera.h"
 #include "Primitives.h"
+#include "ChunkedMesh.h"
 #include "Ray.h"
 #include "Window.h"
+#include "Parallel.h"
 
+#include <algorithm>
 #include <fstream>
+#include <iostream>
 #include <vector>
+#include <sstream>
 #include <streambuf>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
 
 using namespace glm;
 using namespace std;
 
+// Statements are applied keyword by keyword: lights, then objects in the
+// order keyframes and textures number them, then the rest
+const string Scene::scene_keywords[SCENE_KEYWORDS] = { "light", "area_light", "sphere_light", "sphere", "triangle", "plane", "mesh", "keyframe", "texture", "camera" };
+
 GLuint Scene::scene_count = 0;
 
-Scene::Scene()
+Scene::Scene(bool headless)
+: camera(50) // 50 degree FOV
 {
-	image.Initialize();
+	if(!headless)
+		image.Initialize();
 	scene_id = scene_count++;
+	scene_hash = 0;
+	checkpoint_interval = 0;
+	hdr_output = false;
+	hdr_stream = false;
+	hdr_streamed = false;
+	worker_count = 0;
+	frame_time = 0;
+	raster_primary = false;
+	denoise = false;
+	sort_rays = false;
+	texture_count = 0;
+	full_redraw = true;
+	precision = PRECISION_AUTO;
+	use_double = false;
 }
 
-void Scene::draw()
+void Scene::enable_denoise()
+{
+	denoise = true;
+}
+
+void Scene::enable_ray_sorting()
+{
+	sort_rays = true;
+}
+
+void Scene::set_texture_budget(size_t bytes)
+{
+	texture_cache.set_budget(bytes);
+}
+
+void Scene::enable_raster_primary()
+{
+	raster_primary = true;
+}
+
+void Scene::enable_workers(GLuint count)
+{
+	worker_count = count;
+}
+
+void Scene::enable_hdr_output(bool stream)
+{
+	hdr_output = true;
+	hdr_stream = stream;
+	floats.tracer.clamp_colours = false;
+	doubles.tracer.clamp_colours = false;
+}
+
+string Scene::output_name(GLint frame) const
+{
+	string filename = "scene";
+	filename.append(to_string(scene_id + 1));
+	if(frame >= 0)
+	{
+		char suffix[16];
+		snprintf(suffix, sizeof(suffix), "_frame%04d", frame);
+		filename.append(suffix);
+	}
+	// A crop never overwrites the full frame
+	if(camera.cropped())
+		filename.append("_crop");
+	filename.append(hdr_output ? ".pfm" : ".png");
+	return filename;
+}
+
+void Scene::enable_checkpoint(const string &file, GLdouble interval_seconds)
+{
+	checkpoint_file = file;
+	checkpoint_interval = interval_seconds;
+}
+
+void Scene::set_resolution(GLint width, GLint height)
+{
+	if(width <= 0 || height <= 0)
+		return;
+	// The pose and a crop window carry over, the window clipped to the new
+	// frame
+	Camera resized(degrees(camera.fov), width, height);
+	resized.position = camera.position;
+	resized.orientation = camera.orientation;
+	if(camera.cropped())
+		resized.set_crop(camera.crop_x, camera.crop_y, camera.crop_width, camera.crop_height);
+	camera = resized;
+	// Workers pick up the new camera when they are next started
+	coordinator.stop();
+}
+
+void Scene::set_pose(const dvec3 &position, const dmat3 &orientation)
+{
+	camera.position = position;
+	camera.orientation = orientation;
+	coordinator.stop();
+}
+
+void Scene::set_fov(GLfloat degrees)
+{
+	camera.fov = radians((GLdouble)degrees);
+	coordinator.stop();
+}
+
+void Scene::set_crop(GLint x, GLint y, GLint width, GLint height)
+{
+	camera.set_crop(x, y, width, height);
+	coordinator.stop();
+}
+
+void Scene::tile_rect(const Camera &camera, GLuint tile, GLint *x0, GLint *y0, GLint *w, GLint *h)
+{
+	GLuint tiles_x = (camera.width() + TILE_SIZE - 1) / TILE_SIZE;
+	*x0 = (tile % tiles_x) * TILE_SIZE;
+	*y0 = (tile / tiles_x) * TILE_SIZE;
+	*w = std::min(TILE_SIZE, camera.width() - *x0);
+	*h = std::min(TILE_SIZE, camera.height() - *y0);
+}
+
+GLuint Scene::tile_total() const
 {
-	Camera camera(50); // 50 degree FOV
+	return ((camera.width() + TILE_SIZE - 1) / TILE_SIZE) * ((camera.height() + TILE_SIZE - 1) / TILE_SIZE);
+}
+
+void Scene::fit_image()
+{
+	if(image.Width() != camera.width() || image.Height() != camera.height())
+		image.Resize(camera.width(), camera.height());
+}
 
-	// Loop through each pixel finding the direction vector
-	for(GLint y = 0; y < WINDOW_HEIGHT; y++)
+void Scene::trace_tile(GLuint tile, vec3 *colours)
+{
+	if(use_double)
+		trace_tile(doubles, tile, colours);
+	else
+		trace_tile(floats, tile, colours);
+}
+
+void Scene::trace_tile(const Camera &view, GLuint tile, vec3 *colours)
+{
+	if(use_double)
+		trace_tile(doubles, view, tile, colours);
+	else
+		trace_tile(floats, view, tile, colours);
+}
+
+template<typename real>
+void Scene::trace_tile(Geometry<real> &geometry, GLuint tile, vec3 *colours)
+{
+	if(sort_rays && !raster_primary)
+	{
+		trace_tile_batch(geometry, camera, tile, colours, denoise);
+		return;
+	}
+
+	GLint x0, y0, w, h;
+	tile_rect(tile, &x0, &y0, &w, &h);
+
+	for(GLint y = 0; y < h; y++)
 	{
 		// Trace each ray
-		for(GLuint x = 0; x < WINDOW_WIDTH; x++)
+		for(GLint x = 0; x < w; x++)
+		{
+			vec3 pixel_colour(0.0);
+			Ray<real> ray(rvec3<real>(0.0), rvec3<real>(0.0));
+			HitFeatures features = { vec3(0.0), vec3(0.0), 0 };
+
+			camera.generate_ray(x0 + x, y0 + y, &ray);
+			if(!raster_primary)
+			{
+				geometry.tracer.trace(ray, &pixel_colour, 10, -1, denoise ? &features : NULL);
+			}
+			else
+			{
+				GLint object = geometry.rasterizer.object(x0 + x, y0 + y);
+				if(object >= 0)
+				{
+					const rvec3<real> &point = geometry.rasterizer.point(x0 + x, y0 + y), &normal = geometry.rasterizer.normal(x0 + x, y0 + y);
+					if(denoise)
+						geometry.tracer.hit_features(ray, object, point, normal, &features);
+					geometry.tracer.trace_hit(ray, object, point, normal, &pixel_colour, 10);
+				}
+			}
+			colours[y*w + x] = pixel_colour;
+			if(denoise)
+				denoiser.set_features(x0 + x, y0 + y, features.albedo, features.normal, features.depth);
+		}
+	}
+	if(denoise)
+		tile_features[tile] = 1;
+}
+
+template<typename real>
+void Scene::trace_tile(Geometry<real> &geometry, const Camera &view, GLuint tile, vec3 *colours)
+{
+	if(sort_rays)
+	{
+		trace_tile_batch(geometry, view, tile, colours, false);
+		return;
+	}
+
+	GLint x0, y0, w, h;
+	tile_rect(view, tile, &x0, &y0, &w, &h);
+	for(GLint y = 0; y < h; y++)
+	{
+		for(GLint x = 0; x < w; x++)
 		{
 			vec3 pixel_colour(0.0);
-			Ray ray(vec3(0.0), vec3(0.0));
+			Ray<real> ray(rvec3<real>(0.0), rvec3<real>(0.0));
+			view.generate_ray(x0 + x, y0 + y, &ray);
+			geometry.tracer.trace(ray, &pixel_colour, 10, -1);
+			colours[y*w + x] = pixel_colour;
+		}
+	}
+}
+
+template<typename real>
+void Scene::trace_tile_batch(Geometry<real> &geometry, const Camera &view, GLuint tile, vec3 *colours, bool features)
+{
+	GLint x0, y0, w, h;
+	tile_rect(view, tile, &x0, &y0, &w, &h);
+	vector<Ray<real> > rays;
+	rays.reserve(w * h);
+	for(GLint y = 0; y < h; y++)
+	{
+		for(GLint x = 0; x < w; x++)
+		{
+			Ray<real> ray(rvec3<real>(0.0), rvec3<real>(0.0));
+			view.generate_ray(x0 + x, y0 + y, &ray);
+			rays.push_back(ray);
+		}
+	}
 
+	HitFeatures none = { vec3(0.0), vec3(0.0), 0 };
+	vector<HitFeatures> hit_features(features ? rays.size() : 0, none);
+	geometry.tracer.trace_batch(rays, colours, 10, features ? &hit_features[0] : NULL);
+	if(!features)
+		return;
+	for(GLint y = 0; y < h; y++)
+		for(GLint x = 0; x < w; x++)
+		{
+			const HitFeatures &f = hit_features[y*w + x];
+			denoiser.set_features(x0 + x, y0 + y, f.albedo, f.normal, f.depth);
+		}
+	tile_features[tile] = 1;
+}
+
+// Features for a tile that was rendered elsewhere or resumed, primary rays only
+template<typename real>
+void Scene::feature_tile(Geometry<real> &geometry, GLuint tile)
+{
+	GLint x0, y0, w, h;
+	tile_rect(tile, &x0, &y0, &w, &h);
+	for(GLint y = y0; y < y0 + h; y++)
+	{
+		for(GLint x = x0; x < x0 + w; x++)
+		{
+			Ray<real> ray(rvec3<real>(0.0), rvec3<real>(0.0));
+			HitFeatures features = { vec3(0.0), vec3(0.0), 0 };
 			camera.generate_ray(x, y, &ray);
-			tracer.trace(ray, &pixel_colour, 10, -1);
-			// Set imagebuffer pixel colour
-			image.SetPixel(x, y, pixel_colour);
+			geometry.tracer.primary_features(ray, &features);
+			denoiser.set_features(x, y, features.albedo, features.normal, features.depth);
+		}
+	}
+}
+
+void Scene::render_tile(GLuint tile, vec3 *colours)
+{
+	GLint x0, y0, w, h;
+	tile_rect(tile, &x0, &y0, &w, &h);
+	vector<GLint> &shaded = tile_objects[tile];
+	shaded.clear();
+	log_shaded_objects(&shaded);
+	trace_tile(tile, colours);
+	log_shaded_objects(NULL);
+	sort(shaded.begin(), shaded.end());
+	shaded.erase(unique(shaded.begin(), shaded.end()), shaded.end());
+	tile_logged[tile] = 1;
+	// Set imagebuffer pixel colours
+	image.SetTile(x0, y0, w, h, colours);
+}
+
+static GLdouble seconds_now()
+{
+	return chrono::duration<GLdouble>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Scene::draw()
+{
+	fit_image();
+	GLuint tile_count = tile_total();
+	tile_objects.resize(tile_count);
+	tile_logged.assign(tile_count, 0);
+	dirty_tiles.assign(tile_count, 0);
+	full_redraw = false;
+
+	// Render straight into the journal so a checkpoint never copies pixels
+	bool checkpointing = !checkpoint_file.empty() &&
+	                     checkpoint.open(checkpoint_file, camera.width(), camera.height(), TILE_SIZE, frame_hash(), checkpoint_interval);
+	if(checkpointing)
+		image.AttachStorage(checkpoint.pixels());
+
+	vector<GLuint> tiles;
+	for(GLuint i = 0; i < tile_count; i++)
+	{
+		if(!checkpointing || !checkpoint.done(i))
+			tiles.push_back(i);
+	}
+
+	// Tiles resumed from a checkpoint are not rendered again, so they are
+	// written out with the rest of the current image when the stream opens
+	if(hdr_output && hdr_stream)
+		image.BeginStream(output_name(), checkpointing);
+
+	// Tiles traced here write their features as they go, the rest are
+	// filled in before filtering
+	if(denoise)
+	{
+		denoiser.resize(image.Width(), image.Height());
+		tile_features.assign(tile_count, 0);
+	}
+
+	// Primary hits for the tiles rendered here come from the visibility
+	// buffer, workers still trace theirs
+	if(raster_primary)
+		rasterize();
+
+	// Worker processes take tiles first. Whatever they could not finish,
+	// because every one of them died, is rendered here instead.
+	if(worker_count > 0)
+	{
+		if(coordinator.live_workers() == 0 && coordinator.start(worker_count, source_text, !hdr_output, use_double, camera))
+			coordinator.set_time(frame_time);
+		tiles = coordinator.render(tiles, [&](GLuint tile, const vec3 *colours)
+		{
+			GLint x0, y0, w, h;
+			tile_rect(tile, &x0, &y0, &w, &h);
+			image.SetTile(x0, y0, w, h, colours);
+			if(checkpointing)
+				checkpoint.complete(tile);
+		});
+	}
+
+	// Each thread takes the next unrendered tile until none are left
+	run_workers(tiles.size(), [&](GLuint i)
+	{
+		vector<vec3> colours(TILE_SIZE * TILE_SIZE);
+		render_tile(tiles[i], &colours[0]);
+		if(checkpointing)
+			checkpoint.complete(tiles[i]);
+		return true;
+	});
+
+	if(checkpointing)
+		checkpoint.sync();
+
+	if(denoise)
+	{
+		run_workers(tile_count, [&](GLuint tile)
+		{
+			if(tile_features[tile])
+				return true;
+			if(use_double)
+				feature_tile(doubles, tile);
+			else
+				feature_tile(floats, tile);
+			return true;
+		});
+
+		// The journal keeps the raw frame, so a resumed render is not
+		// filtered twice
+		if(checkpointing)
+			image.AttachStorage(NULL);
+		denoiser.apply(image);
+	}
+
+	if(hdr_output && hdr_stream)
+		hdr_streamed = image.EndStream();
+
+	// Hit rate and resident size per frame, for sizing the cache budget
+	if(texture_count > 0)
+	{
+		TextureCache::Stats stats = texture_cache.stats();
+		uint64_t lookups = stats.hits + stats.misses;
+		cout << "TextureCache: " << stats.hits << " hits, " << stats.misses << " misses ("
+		     << (lookups ? 100.0 * stats.hits / lookups : 0.0) << "% hit rate), " << stats.evictions << " evictions, "
+		     << stats.resident_bytes / 1024 << " of " << stats.budget_bytes / 1024 << " KB resident" << endl;
+		texture_cache.reset_stats();
+	}
+}
+
+// Traces one ray per block x block square of a tile and fills the square with
+// it. Squares whose ray was traced by the previous, twice as coarse pass
+// keep that colour instead of tracing it again.
+template<typename real>
+void Scene::render_tile_blocks(Geometry<real> &geometry, GLuint tile, GLint block, bool first_pass, vec3 *colours)
+{
+	GLint x0, y0, w, h;
+	tile_rect(tile, &x0, &y0, &w, &h);
+
+	for(GLint by = 0; by < h; by += block)
+	{
+		for(GLint bx = 0; bx < w; bx += block)
+		{
+			vec3 pixel_colour(0.0);
+			if(!first_pass && bx % (2*block) == 0 && by % (2*block) == 0)
+			{
+				pixel_colour = image.GetPixel(x0 + bx, y0 + by);
+			}
+			else
+			{
+				Ray<real> ray(rvec3<real>(0.0), rvec3<real>(0.0));
+				camera.generate_ray(x0 + bx, y0 + by, &ray);
+				geometry.tracer.trace(ray, &pixel_colour, 10, -1);
+			}
+			for(GLint y = by; y < std::min(by + block, h); y++)
+				for(GLint x = bx; x < std::min(bx + block, w); x++)
+					colours[y*w + x] = pixel_colour;
 		}
 	}
+	image.SetTile(x0, y0, w, h, colours);
+}
+
+void Scene::draw_progressive(GLdouble budget_seconds, const function<void()> &present)
+{
+	fit_image();
+	full_redraw = true;
+	GLuint tile_count = tile_total();
+	GLdouble deadline = seconds_now() + budget_seconds;
+
+	// The coarsest pass always runs to completion so there is something to
+	// show. Later passes stop taking tiles at the deadline; unrefined tiles
+	// keep the previous pass's blocks, so the image stays complete.
+	for(GLint block = TILE_SIZE / 2; block >= 1; block /= 2)
+	{
+		bool first_pass = (block == TILE_SIZE / 2);
+		run_workers(tile_count, [&](GLuint tile)
+		{
+			if(!first_pass && seconds_now() >= deadline)
+				return false;
+			vector<vec3> colours(TILE_SIZE * TILE_SIZE);
+			if(use_double)
+				render_tile_blocks(doubles, tile, block, first_pass, &colours[0]);
+			else
+				render_tile_blocks(floats, tile, block, first_pass, &colours[0]);
+			return true;
+		});
+
+		// Only the rows this pass reached get uploaded by Render
+		present();
+		if(seconds_now() >= deadline)
+			break;
+	}
 }
+
+bool Scene::draw_interactive(GLdouble budget_seconds)
+{
+	fit_image();
+	full_redraw = true;
+	bool converged = use_double ? doubles.reprojection.render(doubles.tracer, camera, budget_seconds, &interactive_colours)
+	                            : floats.reprojection.render(floats.tracer, camera, budget_seconds, &interactive_colours);
+	image.SetTile(0, 0, camera.width(), camera.height(), &interactive_colours[0]);
+	return converged;
+}
+
 void Scene::commit()
 {
 	image.Render();
-	string filename = "scene";
-	filename.append(to_string(scene_id + 1));
-	filename.append(".png");
-	image.SaveToFile(filename);
+	// A stream that failed part way is written again from the image, and
+	// the journal is only dropped once one of the writes succeeded
+	bool saved;
+	if(hdr_output)
+		saved = (hdr_stream && hdr_streamed) || image.SaveToPFM(output_name());
+	else
+		saved = image.SaveToFile(output_name());
+	if(saved && !checkpoint_file.empty())
+	{
+		// The frame is safely on disk, the journal is no longer needed
+		image.AttachStorage(NULL);
+		checkpoint.discard();
+	}
 }
 
-void Scene::parse(string file)
+uint64_t Scene::frame_hash() const
+{
+	// Frames of an animation are different renders of the same scene text,
+	// as are other views or windows of it
+	uint32_t time_bits;
+	memcpy(&time_bits, &frame_time, sizeof(time_bits));
+	uint64_t hash = (scene_hash ^ time_bits) * 1099511628211ULL;
+	GLfloat fov = camera.fov;
+	uint32_t fov_bits;
+	memcpy(&fov_bits, &fov, sizeof(fov_bits));
+	GLint view[7] = { camera.frame_width, camera.frame_height, camera.crop_x, camera.crop_y, camera.crop_width, camera.crop_height, (GLint)fov_bits };
+	for(GLuint i = 0; i < 7; i++)
+		hash = (hash ^ (uint32_t)view[i]) * 1099511628211ULL;
+	GLdouble pose[12] = { camera.position.x, camera.position.y, camera.position.z };
+	for(GLuint i = 0; i < 9; i++)
+		pose[3 + i] = camera.orientation[i / 3][i % 3];
+	const unsigned char *pose_bytes = (const unsigned char *)pose;
+	for(GLuint i = 0; i < sizeof(pose); i++)
+		hash = (hash ^ pose_bytes[i]) * 1099511628211ULL;
+	// The precisions round hits differently, and clamped tiles of an LDR
+	// run are no use to an HDR one or the other way round, so neither mixes
+	GLuint mode = (use_double ? 1 : 0) | (hdr_output ? 2 : 0);
+	return (hash ^ mode) * 1099511628211ULL;
+}
+
+void Scene::set_time(GLfloat time)
+{
+	frame_time = time;
+	floats.reprojection.reset();
+	doubles.reprojection.reset();
+	if(animation.empty())
+		return;
+	if(use_double)
+	{
+		animation.apply(doubles.tracer.objects, time);
+		doubles.tracer.update_acceleration();
+	}
+	else
+	{
+		animation.apply(floats.tracer.objects, time);
+		floats.tracer.update_acceleration();
+	}
+	if(coordinator.live_workers() > 0)
+		coordinator.set_time(time);
+}
+
+void Scene::render_sequence(GLuint frames, GLfloat fps, const function<void()> &present)
+{
+	// One frame is encoded while the next traces; the encoder works on its
+	// own copy of the pixels
+	vector<vec3> encoding;
+	thread encoder;
+	bool streaming = hdr_stream;
+	hdr_stream = false;
+
+	for(GLuint frame = 0; frame < frames; frame++)
+	{
+		set_time(frame / fps);
+		draw();
+		present();
+
+		if(encoder.joinable())
+			encoder.join();
+		GLint width = image.Width(), height = image.Height();
+		encoding.resize(width * height);
+		for(GLint y = 0; y < height; y++)
+			for(GLint x = 0; x < width; x++)
+				encoding[y * width + x] = image.GetPixel(x, y);
+		string name = output_name(frame);
+		bool pfm = hdr_output;
+		encoder = thread([&encoding, name, pfm, width, height]()
+		{
+			if(pfm)
+				ImageBuffer::SavePixelsPFM(name, width, height, &encoding[0]);
+			else
+				ImageBuffer::SavePixels(name, width, height, &encoding[0]);
+		});
+
+		// The frame is copied out, its journal is done with
+		if(!checkpoint_file.empty())
+		{
+			image.AttachStorage(NULL);
+			checkpoint.discard();
+		}
+	}
+	if(encoder.joinable())
+		encoder.join();
+	hdr_stream = streaming;
+}
+
+// Scene text with comment lines dropped and lines joined
+static string read_scene_file(const string &file)
 {
   ifstream input(file.c_str());
   string str, line;
@@ -68,48 +625,412 @@ void Scene::parse(string file)
     }
     str += line;
   }
-  string object_names[4] = { "light", "sphere", "triangle", "plane" };
-  for (GLint i = 0; i < 4; i++)
+  return str;
+}
+
+// FNV-1a of the scene text, identifies the render a checkpoint belongs to
+static uint64_t hash_text(const string &str)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (GLuint i = 0; i < str.length(); i++)
+  {
+    hash ^= (unsigned char)str[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+void Scene::parse(string file)
+{
+  parse_text(read_scene_file(file));
+}
+
+void Scene::set_precision(ScenePrecision precision_)
+{
+  precision = precision_;
+  if (!source_text.empty())
+    parse_text(source_text);
+}
+
+// Largest coordinate of any bounded object
+template<typename real>
+static GLdouble scene_extent(const vector<Object<real>*> &objects)
+{
+  GLdouble extent = 0;
+  for (GLuint i = 0; i < objects.size(); i++)
   {
+    if (!objects[i]->bounded())
+      continue;
+    Bounds<real> b = objects[i]->bounds();
+    for (GLint axis = 0; axis < 3; axis++)
+      extent = std::max(extent, (GLdouble)std::max(fabs(b.min_point[axis]), fabs(b.max_point[axis])));
+  }
+  return extent;
+}
+
+void Scene::parse_text(const string &str)
+{
+  // Reloading drops the previous scene's objects all at once, and workers
+  // holding the old scene text are restarted on the next draw
+  clear_geometry();
+  coordinator.stop();
+  full_redraw = true;
+  source_text = str;
+  scene_hash = hash_text(str);
+  split_statements(str, statements);
+
+  // Far from the origin float hit points are too coarse to clear their own
+  // surface, such scenes are parsed again in double
+  use_double = precision == PRECISION_DOUBLE;
+  if (!use_double)
+  {
+    parse_geometry(floats);
+    GLdouble extent = scene_extent(floats.tracer.objects);
+    if (precision == PRECISION_AUTO && extent > FLOAT_SCENE_LIMIT)
+    {
+      cout << "Scene: coordinates reach " << extent << ", tracing in double precision" << endl;
+      clear_geometry();
+      use_double = true;
+    }
+  }
+  if (use_double)
+    parse_geometry(doubles);
+}
+
+void Scene::clear_geometry()
+{
+  floats.tracer.objects.clear();
+  floats.tracer.lights.clear();
+  floats.reprojection.reset();
+  doubles.tracer.objects.clear();
+  doubles.tracer.lights.clear();
+  doubles.reprojection.reset();
+  arena.release();
+  animation = Animation();
+  texture_count = 0;
+}
+
+template<typename real>
+void Scene::parse_geometry(Geometry<real> &geometry)
+{
+  for (GLuint keyword = 0; keyword < SCENE_KEYWORDS; keyword++)
+  {
+    for (GLuint i = 0; i < statements[keyword].size(); i++)
+      parse_statement(geometry, keyword, statements[keyword][i]);
+  }
+
+  // Pose at the current time, then build the BVH over the objects
+  if (!animation.empty())
+    animation.apply(geometry.tracer.objects, frame_time);
+  geometry.tracer.build_acceleration();
+}
+
+void Scene::rasterize()
+{
+  if (use_double)
+    doubles.rasterizer.render(doubles.tracer.objects, camera);
+  else
+    floats.rasterizer.render(floats.tracer.objects, camera);
+}
+
+// Every statement of the scene text by keyword, each from its keyword up to
+// its closing brace
+void Scene::split_statements(const string &str, vector<string> *statements)
+{
+  for (GLuint keyword = 0; keyword < SCENE_KEYWORDS; keyword++)
+  {
+    statements[keyword].clear();
+    const string &name = scene_keywords[keyword];
     GLint starting_pos = 0;
     GLint found_pos = 0;
-    while ((found_pos = str.find(object_names[i], starting_pos)) != string::npos)
+    while ((found_pos = str.find(name, starting_pos)) != string::npos)
     {
-      GLint end_pos = str.find('}', found_pos);
-      if (object_names[i] == "light")
-      {
-        float f1, f2, f3, f4, f5, f6;
-        sscanf(str.substr(found_pos, end_pos + 1).c_str(), "%*s { %f %f %f %f %f %f}", &f1, &f2, &f3, &f4, &f5, &f6);
-		Light *l = new Light(vec3(f1, f2, f3), vec3(f4, f5, f6));
-	    tracer.lights.push_back(l);
-      }
-      else if (object_names[i] == "sphere")
-      {
-        float c1, c2, c3, r, cr1, cr2, cr3, cs1, cs2, cs3, p, ref;
-        sscanf(str.substr(found_pos, end_pos + 1).c_str(), "%*s { %f %f %f %f %f %f %f %f %f %f %f %f}", &c1, &c2, &c3, &r, &cr1, &cr2, &cr3, &cs1, &cs2, &cs3, &p, &ref);
-		Sphere *s = new Sphere(vec3(c1, c2, c3), r, vec3(cr1, cr2, cr3), vec3(cs1, cs2, cs3), p, ref);
-	    tracer.objects.push_back(s);
-      }
-      else if (object_names[i] == "triangle")
+      // Only match whole keywords, so a mesh file named "sphere.bin" isn't a sphere
+      GLint after_pos = found_pos + name.length();
+      if ((found_pos > 0 && !isspace(str[found_pos - 1]) && str[found_pos - 1] != '}') ||
+          (after_pos < (GLint)str.length() && !isspace(str[after_pos]) && str[after_pos] != '{'))
       {
-        float f1, f2, f3, f4, f5, f6, f7, f8, f9, cr1, cr2, cr3, cs1, cs2, cs3, p, r;
-        sscanf(str.substr(found_pos, end_pos + 1).c_str(), "%*s { %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f}", &f1, &f2, &f3, &f4, &f5, &f6, &f7, &f8, &f9, &cr1, &cr2, &cr3, &cs1, &cs2, &cs3, &p, &r);
-		Triangle *t = new Triangle(vec3(f1, f2, f3), vec3(f4, f5, f6), vec3(f7, f8, f9), vec3(cr1, cr2, cr3), vec3(cs1, cs2, cs3), p, r);
-	    tracer.objects.push_back(t);
+        starting_pos = after_pos;
+        continue;
       }
-      else if (object_names[i] == "plane")
-      {
-        float n1, n2, n3, p1, p2, p3, cr1, cr2, cr3, cs1, cs2, cs3, p, r;
-        sscanf(str.substr(found_pos, end_pos + 1).c_str(), "%*s { %f %f %f %f %f %f %f %f %f %f %f %f %f %f}", &n1, &n2, &n3, &p1, &p2, &p3,  &cr1, &cr2, &cr3, &cs1, &cs2, &cs3, &p, &r);
-		Plane *pl = new Plane(vec3(n1, n2, n3), vec3(p1, p2, p3), vec3(cr1, cr2, cr3), vec3(cs1, cs2, cs3), p, r);
-	    tracer.objects.push_back(pl);
-      }
-      starting_pos = end_pos+1;
+      size_t end_pos = str.find('}', found_pos);
+      if (end_pos == string::npos)
+        break;
+      statements[keyword].push_back(str.substr(found_pos, end_pos - found_pos + 1));
+      starting_pos = end_pos + 1;
     }
   }
+}
 
+template<typename real>
+void Scene::parse_statement(Geometry<real> &geometry, GLuint keyword, const string &statement)
+{
+  if (scene_keywords[keyword] == "light")
+  {
+    double f1, f2, f3;
+    float f4, f5, f6;
+    sscanf(statement.c_str(), "%*s { %lf %lf %lf %f %f %f}", &f1, &f2, &f3, &f4, &f5, &f6);
+		Light<real> *l = arena.create<Light<real> >(rvec3<real>(f1, f2, f3), vec3(f4, f5, f6));
+	    geometry.tracer.lights.push_back(l);
+  }
+  else if (scene_keywords[keyword] == "area_light")
+  {
+    double c1, c2, c3, u1, u2, u3, v1, v2, v3;
+    float f1, f2, f3;
+    GLuint samples = 1;
+    sscanf(statement.c_str(), "%*s { %lf %lf %lf %lf %lf %lf %lf %lf %lf %f %f %f %u}", &c1, &c2, &c3, &u1, &u2, &u3, &v1, &v2, &v3, &f1, &f2, &f3, &samples);
+		Light<real> *l = arena.create<Light<real> >(rvec3<real>(c1, c2, c3), rvec3<real>(u1, u2, u3), rvec3<real>(v1, v2, v3), vec3(f1, f2, f3), samples);
+	    geometry.tracer.lights.push_back(l);
+  }
+  else if (scene_keywords[keyword] == "sphere_light")
+  {
+    double c1, c2, c3, r;
+    float f1, f2, f3;
+    GLuint samples = 1;
+    sscanf(statement.c_str(), "%*s { %lf %lf %lf %lf %f %f %f %u}", &c1, &c2, &c3, &r, &f1, &f2, &f3, &samples);
+		Light<real> *l = arena.create<Light<real> >(rvec3<real>(c1, c2, c3), (real)r, vec3(f1, f2, f3), samples);
+	    geometry.tracer.lights.push_back(l);
+  }
+  else if (scene_keywords[keyword] == "sphere")
+  {
+    double c1, c2, c3, r;
+    float cr1, cr2, cr3, cs1, cs2, cs3, p, ref;
+    sscanf(statement.c_str(), "%*s { %lf %lf %lf %lf %f %f %f %f %f %f %f %f}", &c1, &c2, &c3, &r, &cr1, &cr2, &cr3, &cs1, &cs2, &cs3, &p, &ref);
+		Sphere<real> *s = arena.create<Sphere<real> >(rvec3<real>(c1, c2, c3), (real)r, vec3(cr1, cr2, cr3), vec3(cs1, cs2, cs3), p, ref);
+	    geometry.tracer.objects.push_back(s);
+  }
+  else if (scene_keywords[keyword] == "triangle")
+  {
+    double f1, f2, f3, f4, f5, f6, f7, f8, f9;
+    float cr1, cr2, cr3, cs1, cs2, cs3, p, r;
+    sscanf(statement.c_str(), "%*s { %lf %lf %lf %lf %lf %lf %lf %lf %lf %f %f %f %f %f %f %f %f}", &f1, &f2, &f3, &f4, &f5, &f6, &f7, &f8, &f9, &cr1, &cr2, &cr3, &cs1, &cs2, &cs3, &p, &r);
+		Triangle<real> *t = arena.create<Triangle<real> >(rvec3<real>(f1, f2, f3), rvec3<real>(f4, f5, f6), rvec3<real>(f7, f8, f9), vec3(cr1, cr2, cr3), vec3(cs1, cs2, cs3), p, r);
+	    geometry.tracer.objects.push_back(t);
+  }
+  else if (scene_keywords[keyword] == "plane")
+  {
+    double n1, n2, n3, p1, p2, p3;
+    float cr1, cr2, cr3, cs1, cs2, cs3, p, r;
+    sscanf(statement.c_str(), "%*s { %lf %lf %lf %lf %lf %lf %f %f %f %f %f %f %f %f}", &n1, &n2, &n3, &p1, &p2, &p3,  &cr1, &cr2, &cr3, &cs1, &cs2, &cs3, &p, &r);
+		Plane<real> *pl = arena.create<Plane<real> >(rvec3<real>(n1, n2, n3), rvec3<real>(p1, p2, p3), vec3(cr1, cr2, cr3), vec3(cs1, cs2, cs3), p, r);
+	    geometry.tracer.objects.push_back(pl);
+  }
+  else if (scene_keywords[keyword] == "mesh")
+  {
+    // Packed mesh file streamed from disk, budget is in megabytes
+    char mesh_file[256];
+    float budget, cr1, cr2, cr3, cs1, cs2, cs3, p, r;
+    sscanf(statement.c_str(), "%*s { %255s %f %f %f %f %f %f %f %f %f}", mesh_file, &budget, &cr1, &cr2, &cr3, &cs1, &cs2, &cs3, &p, &r);
+		ChunkedMesh<real> *m = arena.create<ChunkedMesh<real> >(mesh_file, (size_t)(budget * 1024 * 1024), vec3(cr1, cr2, cr3), vec3(cs1, cs2, cs3), p, r);
+		// A mesh that failed to open stays in the arena until the scene goes
+		if (m->loaded())
+		    geometry.tracer.objects.push_back(m);
+  }
+  else if (scene_keywords[keyword] == "keyframe")
+  {
+    // Object index counts spheres, then triangles, planes and meshes in file order
+    GLuint index;
+    float time;
+    double t1, t2, t3, yaw;
+    sscanf(statement.c_str(), "%*s { %u %f %lf %lf %lf %lf}", &index, &time, &t1, &t2, &t3, &yaw);
+		animation.add_keyframe(index, time, dvec3(t1, t2, t3), yaw);
+  }
+  else if (scene_keywords[keyword] == "texture")
+  {
+    // Packed texture file for an object, numbered as for keyframes
+    GLuint index;
+    char texture_file[256];
+    double repeat = 1;
+    sscanf(statement.c_str(), "%*s { %u %255s %lf}", &index, texture_file, &repeat);
+		Texture *t = arena.create<Texture>(texture_file, &texture_cache);
+		if (t->loaded() && index < geometry.tracer.objects.size())
+		{
+		    geometry.tracer.objects[index]->texture = t;
+		    geometry.tracer.objects[index]->texture_repeat = (real)repeat;
+		    texture_count++;
+		}
+  }
+  else if (scene_keywords[keyword] == "camera")
+  {
+    // Frame size in pixels and horizontal field of view in degrees
+    GLint width, height;
+    float fov;
+    if (sscanf(statement.c_str(), "%*s { %d %d %f}", &width, &height, &fov) == 3)
+    {
+      set_resolution(width, height);
+      set_fov(fov);
+    }
+  }
 }
 
+// Words between a statement's braces
+static vector<string> statement_values(const string &statement)
+{
+  vector<string> values;
+  size_t open_pos = statement.find('{'), close_pos = statement.rfind('}');
+  if (open_pos == string::npos || close_pos == string::npos || close_pos < open_pos)
+    return values;
+  istringstream input(statement.substr(open_pos + 1, close_pos - open_pos - 1));
+  string value;
+  while (input >> value)
+    values.push_back(value);
+  return values;
+}
 
+template<typename real>
+bool Scene::update_material(Geometry<real> &geometry, GLuint keyword, GLuint object_index, const string &before, const string &after)
+{
+  // Geometry comes first in a primitive's statement, the material after it
+  const string &name = scene_keywords[keyword];
+  GLuint shape = name == "sphere" ? 4 : name == "triangle" ? 9 : 6;
+  vector<string> old_values = statement_values(before), new_values = statement_values(after);
+  if (old_values.size() != new_values.size() || new_values.size() < shape + 8 ||
+      !equal(old_values.begin(), old_values.begin() + shape, new_values.begin()))
+    return false;
+
+  // Read as single floats, just as parsing the statement would
+  GLfloat material[8];
+  for (GLuint i = 0; i < 8; i++)
+    material[i] = strtof(new_values[shape + i].c_str(), NULL);
+  Object<real> *object = geometry.tracer.objects[object_index];
+  object->diffuse_colour = vec3(material[0], material[1], material[2]);
+  object->specular_colour = vec3(material[3], material[4], material[5]);
+  object->phong_exponent = material[6];
+  object->reflectance = material[7];
+
+  // Only the tiles the object was shaded in can look different. Tiles this
+  // process did not render have no record and are redrawn regardless.
+  for (GLuint tile = 0; tile < dirty_tiles.size(); tile++)
+  {
+    if (!tile_logged[tile] || binary_search(tile_objects[tile].begin(), tile_objects[tile].end(), (GLint)object_index))
+      dirty_tiles[tile] = 1;
+  }
+  return true;
+}
+
+bool Scene::reload(const string &file)
+{
+  string str = read_scene_file(file);
+  if (str == source_text)
+    return false;
+
+  // Anything but edits to existing lights and primitives parses anew, as
+  // does an animated scene, whose objects are posed from their statements
+  vector<string> edited[SCENE_KEYWORDS];
+  split_statements(str, edited);
+  bool incremental = animation.empty();
+  for (GLuint keyword = 0; keyword < SCENE_KEYWORDS && incremental; keyword++)
+  {
+    const string &name = scene_keywords[keyword];
+    bool fixed = name == "mesh" || name == "keyframe" || name == "texture" || name == "camera";
+    if (edited[keyword].size() != statements[keyword].size() || (fixed && edited[keyword] != statements[keyword]))
+      incremental = false;
+  }
+  if (!incremental)
+  {
+    parse_text(str);
+    cout << "Scene reloaded " << file << endl;
+    return true;
+  }
+
+  GLuint changes = use_double ? reload_statements(doubles, edited) : reload_statements(floats, edited);
+  source_text = str;
+  scene_hash = hash_text(str);
+  floats.reprojection.reset();
+  doubles.reprojection.reset();
+  coordinator.stop();
+  // An edit taking a float scene past what it renders cleanly parses it
+  // anew, in double
+  if (precision == PRECISION_AUTO && !use_double && scene_extent(floats.tracer.objects) > FLOAT_SCENE_LIMIT)
+  {
+    parse_text(str);
+    cout << "Scene reloaded " << file << endl;
+    return true;
+  }
+  cout << "Scene reloaded " << changes << " changed statements of " << file << endl;
+  return true;
+}
 
+template<typename real>
+GLuint Scene::reload_statements(Geometry<real> &geometry, vector<string> *edited)
+{
+  // Lights and objects are numbered in keyword order, as parse_text adds
+  // them. Meshes come last and never change here, so they need no count.
+  GLuint light_index = 0, object_index = 0, changes = 0;
+  bool lights_changed = false, geometry_changed = false;
+  for (GLuint keyword = 0; keyword < SCENE_KEYWORDS; keyword++)
+  {
+    const string &name = scene_keywords[keyword];
+    bool light = name == "light" || name == "area_light" || name == "sphere_light";
+    bool primitive = name == "sphere" || name == "triangle" || name == "plane";
+    for (GLuint i = 0; i < edited[keyword].size(); i++)
+    {
+      if (edited[keyword][i] != statements[keyword][i])
+      {
+        changes++;
+        if (light)
+        {
+          parse_statement(geometry, keyword, edited[keyword][i]);
+          geometry.tracer.lights[light_index] = geometry.tracer.lights.back();
+          geometry.tracer.lights.pop_back();
+          lights_changed = true;
+        }
+        else if (primitive && !update_material(geometry, keyword, object_index, statements[keyword][i], edited[keyword][i]))
+        {
+          // The replaced object stays in the arena until the next full parse
+          parse_statement(geometry, keyword, edited[keyword][i]);
+          Object<real> *replaced = geometry.tracer.objects[object_index];
+          Object<real> *object = geometry.tracer.objects.back();
+          geometry.tracer.objects.pop_back();
+          object->texture = replaced->texture;
+          object->texture_repeat = replaced->texture_repeat;
+          geometry.tracer.objects[object_index] = object;
+          geometry_changed = true;
+        }
+      }
+      if (light)
+        light_index++;
+      if (primitive)
+        object_index++;
+    }
+    statements[keyword].swap(edited[keyword]);
+  }
+
+  // New geometry and lighting can show anywhere through shadows and
+  // reflections
+  if (geometry_changed)
+    geometry.tracer.update_acceleration();
+  if (lights_changed || geometry_changed)
+    full_redraw = true;
+  return changes;
+}
 
+void Scene::draw_changes()
+{
+	// Only a plain traced frame can be patched tile by tile, a filtered or
+	// journaled one is drawn whole
+	if(full_redraw || denoise || worker_count > 0 || hdr_stream || !checkpoint_file.empty() ||
+	   dirty_tiles.size() != tile_total() || image.Width() != camera.width() || image.Height() != camera.height())
+	{
+		draw();
+		return;
+	}
+
+	vector<GLuint> tiles;
+	for(GLuint i = 0; i < dirty_tiles.size(); i++)
+	{
+		if(dirty_tiles[i])
+			tiles.push_back(i);
+	}
+	if(tiles.empty())
+		return;
+	if(raster_primary)
+		rasterize();
+	run_workers(tiles.size(), [&](GLuint i)
+	{
+		vector<vec3> colours(TILE_SIZE * TILE_SIZE);
+		render_tile(tiles[i], &colours[0]);
+		return true;
+	});
+	dirty_tiles.assign(dirty_tiles.size(), 0);
+}
@@ -9,22 +9,193 @@
 
 #include "ImageBuffer.h"
 #include "Tracer.h"
+#include "Camera.h"
+#include "Checkpoint.h"
+#include "Coordinator.h"
+#include "Animation.h"
+#include "Arena.h"
+#include "Rasterizer.h"
+#include "Denoiser.h"
+#include "Texture.h"
+#include "Reprojection.h"
 #include <string>
-//TODO, make window height and width a property of the scene, base the normalization off of this
+#include <functional>
+#include <stdint.h>
 using namespace std;
 
+// Edge length in pixels of the tiles the image is rendered in
+#define TILE_SIZE 32
+
+// Statement keywords a scene file can use
+#define SCENE_KEYWORDS 10
+
+// Largest coordinate single precision geometry renders cleanly
+#define FLOAT_SCENE_LIMIT 1E4
+
+// Scalar type a scene's geometry is traced in, see Precision.h
+enum ScenePrecision { PRECISION_AUTO, PRECISION_FLOAT, PRECISION_DOUBLE };
+
 class Scene
 {
 	public:
         static GLuint scene_count;
 	    ImageBuffer image;
-	    Tracer tracer;
-	    Scene();
+	    // A headless scene never touches OpenGL, for worker processes
+	    explicit Scene(bool headless = false);
 	    void parse(string file);
+	    // Parses scene text with comments already stripped, as sent to workers
+	    void parse_text(const string &str);
+	    // Geometry is traced in float unless the scene's coordinates reach
+	    // past FLOAT_SCENE_LIMIT, or in the precision set here. A scene
+	    // already parsed is parsed again.
+	    void set_precision(ScenePrecision precision_);
+	    bool double_precision() const { return use_double; }
+	    // Reads the scene file again and applies only the statements that
+	    // changed. Edited lights and primitives are updated in place, a
+	    // material edit only marks the tiles the object was seen in for
+	    // redrawing. Added or removed statements, and edits to meshes,
+	    // keyframes, textures or the camera, parse the scene anew. Returns
+	    // false if the file did not change.
+	    bool reload(const string &file);
 	    void draw();
+	    // Renders only the tiles reloads left out of date, or the whole frame
+	    // if a change could show anywhere
+	    void draw_changes();
+	    // Coarse to fine passes until the time budget runs out, calling
+	    // present after each pass. The image is complete after every pass.
+	    void draw_progressive(GLdouble budget_seconds, const function<void()> &present);
+	    // One frame of interactive navigation in about budget seconds, reusing
+	    // the last frame's pixels that still show the same surfaces. Returns
+	    // true once the frame is complete for the current view.
+	    bool draw_interactive(GLdouble budget_seconds);
 	    void commit();
+	    // Poses animated objects at time seconds and updates the BVH to match
+	    void set_time(GLfloat time);
+	    // Renders frames at fps from time 0, presenting each one. Every frame
+	    // is saved to sceneN_frameXXXX on a second thread while the next one
+	    // renders.
+	    void render_sequence(GLuint frames, GLfloat fps, const function<void()> &present);
+	    // Journal finished tiles to a file so a killed render can resume
+	    void enable_checkpoint(const string &file, GLdouble interval_seconds);
+	    // Write unclamped linear colour to sceneN.pfm instead of a png,
+	    // optionally streaming each tile to the file as it finishes
+	    void enable_hdr_output(bool stream);
+	    // Render tiles on this many local worker processes
+	    void enable_workers(GLuint count);
+	    // Find primary hits by rasterizing the scene, tracing only from them
+	    void enable_raster_primary();
+	    // Filter the finished frame guided by albedo, normal and depth
+	    void enable_denoise();
+	    // Trace each tile's rays a bounce at a time, reflections binned by
+	    // origin and direction for coherence. Same image, different speed.
+	    void enable_ray_sorting();
+	    // Memory for resident texture tiles, shared by the scene's textures
+	    void set_texture_budget(size_t bytes);
+	    // Frame size in pixels and horizontal field of view in degrees. The
+	    // scene file sets them with camera { width height fov }.
+	    void set_resolution(GLint width, GLint height);
+	    void set_fov(GLfloat degrees);
+	    // Camera position and orientation, see Camera
+	    void set_pose(const dvec3 &position, const dmat3 &orientation);
+	    // Render and save only this window of the frame, e.g. to redo a small
+	    // region of a large frame. An empty window renders the whole frame.
+	    void set_crop(GLint x, GLint y, GLint width, GLint height);
+	    // Traces one tile into colours (rows packed) without touching the image
+	    void trace_tile(GLuint tile, vec3 *colours);
+	    // The same for another view of the scene, tracing every pixel. Only
+	    // reads the scene, so several views can render at once.
+	    void trace_tile(const Camera &view, GLuint tile, vec3 *colours);
+	    const Camera &view() const { return camera; }
+	    // sceneN.png, or .pfm for hdr output, with a frame number if given
+	    string output_name(GLint frame = -1) const;
+	    // Tiles cover the camera's image, the crop window if one is set
+	    void tile_rect(GLuint tile, GLint *x0, GLint *y0, GLint *w, GLint *h) const { tile_rect(camera, tile, x0, y0, w, h); }
+	    static void tile_rect(const Camera &camera, GLuint tile, GLint *x0, GLint *y0, GLint *w, GLint *h);
 	private:
+	    Camera camera;
+	    // The lights and objects in one precision, with what traces them.
+	    // Only the one the scene was last parsed into holds any.
+	    template<typename real>
+	    struct Geometry
+	    {
+	        Tracer<real> tracer;
+	        Rasterizer<real> rasterizer;
+	        Reprojection<real> reprojection;
+	    };
+	    Geometry<GLfloat> floats;
+	    Geometry<GLdouble> doubles;
+	    ScenePrecision precision;
+	    bool use_double;
+	    // Drops every light and object, with their keyframes and textures
+	    void clear_geometry();
+	    // Creates the lights and objects of the parsed statements, posed at
+	    // the current time, and builds the BVH over them
+	    template<typename real>
+	    void parse_geometry(Geometry<real> &geometry);
+	    // Visibility buffer of the camera's view for raster primary hits
+	    void rasterize();
+	    template<typename real>
+	    void trace_tile(Geometry<real> &geometry, GLuint tile, vec3 *colours);
+	    template<typename real>
+	    void trace_tile(Geometry<real> &geometry, const Camera &view, GLuint tile, vec3 *colours);
+	    GLuint tile_total() const;
+	    // Matches the image to the camera before rendering into it
+	    void fit_image();
+	    // Declared before the arena, textures hand their tiles back to it
+	    TextureCache texture_cache;
+	    GLuint texture_count;
+	    // Owns every light and object the scene was parsed into
+	    Arena arena;
 	    GLuint scene_id;
+	    uint64_t scene_hash;
+	    bool hdr_output;
+	    bool hdr_stream;
+	    // Whether the last frame's stream got every tile into its file
+	    bool hdr_streamed;
+	    string checkpoint_file;
+	    GLdouble checkpoint_interval;
+	    Checkpoint checkpoint;
+	    string source_text;
+	    GLuint worker_count;
+	    Coordinator coordinator;
+	    bool raster_primary;
+	    bool denoise;
+	    Denoiser denoiser;
+	    bool sort_rays;
+	    // Traces a tile with Tracer::trace_batch, features go to the denoiser
+	    template<typename real>
+	    void trace_tile_batch(Geometry<real> &geometry, const Camera &view, GLuint tile, vec3 *colours, bool features);
+	    vector<char> tile_features;
+	    template<typename real>
+	    void feature_tile(Geometry<real> &geometry, GLuint tile);
+	    vector<vec3> interactive_colours;
+	    static const string scene_keywords[SCENE_KEYWORDS];
+	    // The scene's statements by keyword, as last parsed or reloaded
+	    vector<string> statements[SCENE_KEYWORDS];
+	    static void split_statements(const string &str, vector<string> *statements);
+	    // Creates what the statement describes, appending lights and objects
+	    template<typename real>
+	    void parse_statement(Geometry<real> &geometry, GLuint keyword, const string &statement);
+	    // Copies a primitive's material from its new statement if only the
+	    // material changed, false if its geometry did too
+	    template<typename real>
+	    bool update_material(Geometry<real> &geometry, GLuint keyword, GLuint object_index, const string &before, const string &after);
+	    // Applies edited statements to the lights and primitives in place,
+	    // returning how many changed
+	    template<typename real>
+	    GLuint reload_statements(Geometry<real> &geometry, vector<string> *edited);
+	    // Objects each tile's pixels shaded, sorted, for the tiles last
+	    // rendered on this process
+	    vector<vector<GLint> > tile_objects;
+	    vector<char> tile_logged;
+	    vector<char> dirty_tiles;
+	    bool full_redraw;
+	    Animation animation;
+	    GLfloat frame_time;
+	    uint64_t frame_hash() const;
+	    void render_tile(GLuint tile, vec3 *colours);
+	    template<typename real>
+	    void render_tile_blocks(Geometry<real> &geometry, GLuint tile, GLint block, bool first_pass, vec3 *colours);
 };
 
 #endif
@@ -0,0 +1,423 @@
+/*
+ * Texture.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#include "Texture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <Magick++.h>
+
+// On disk layout: header, level table, then every tile of level 0 row by
+// row, then those of level 1 and so on down to 1x1. Tiles hold 8 bit RGB.
+#define TEXTURE_MAGIC "MJSTEX01"
+
+struct TextureHeader
+{
+	char magic[8];
+	uint32_t width;
+	uint32_t height;
+	uint32_t level_count;
+	uint32_t tile_size;
+};
+
+struct LevelRecord
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t tiles_x;
+	uint32_t first_tile;
+};
+
+// --------------------------------------------------------------------------
+// Cache
+
+static uint64_t tile_key(const Texture &texture, GLuint tile)
+{
+	return ((uint64_t)texture.id() << 32) | tile;
+}
+
+TextureCache::TextureCache(size_t budget_bytes_)
+{
+	for(GLuint i = 0; i < TEXTURE_CACHE_SHARDS; i++)
+	{
+		shards[i].budget_bytes = budget_bytes_ / TEXTURE_CACHE_SHARDS;
+		shards[i].resident = 0;
+		memset(&shards[i].counters, 0, sizeof(shards[i].counters));
+	}
+}
+
+// Neighbouring tiles of a texture land in different shards
+TextureCache::Shard &TextureCache::shard_of(uint64_t key)
+{
+	uint64_t h = key * 0x9E3779B97F4A7C15ULL;
+	return shards[(h >> 32) % TEXTURE_CACHE_SHARDS];
+}
+
+void TextureCache::set_budget(size_t budget_bytes_)
+{
+	for(GLuint i = 0; i < TEXTURE_CACHE_SHARDS; i++)
+	{
+		lock_guard<mutex> guard(shards[i].lock);
+		shards[i].budget_bytes = budget_bytes_ / TEXTURE_CACHE_SHARDS;
+		evict(shards[i], 0);
+	}
+}
+
+TextureCache::Stats TextureCache::stats()
+{
+	Stats total;
+	memset(&total, 0, sizeof(total));
+	for(GLuint i = 0; i < TEXTURE_CACHE_SHARDS; i++)
+	{
+		lock_guard<mutex> guard(shards[i].lock);
+		total.hits += shards[i].counters.hits;
+		total.misses += shards[i].counters.misses;
+		total.evictions += shards[i].counters.evictions;
+		total.resident_bytes += shards[i].resident;
+		total.budget_bytes += shards[i].budget_bytes;
+	}
+	return total;
+}
+
+void TextureCache::reset_stats()
+{
+	for(GLuint i = 0; i < TEXTURE_CACHE_SHARDS; i++)
+	{
+		lock_guard<mutex> guard(shards[i].lock);
+		memset(&shards[i].counters, 0, sizeof(shards[i].counters));
+	}
+}
+
+const unsigned char *TextureCache::acquire(const Texture &texture, GLuint tile)
+{
+	uint64_t key = tile_key(texture, tile);
+	Shard &shard = shard_of(key);
+	unique_lock<mutex> guard(shard.lock);
+	unordered_map<uint64_t, Entry>::iterator found = shard.entries.find(key);
+	if(found != shard.entries.end())
+	{
+		// A tile another thread is still reading counts as a hit, it is
+		// only read once
+		shard.counters.hits++;
+		Entry &entry = found->second;
+		entry.pins++;
+		shard.lru.splice(shard.lru.begin(), shard.lru, entry.lru_position);
+		while(entry.loading)
+			shard.loaded.wait(guard);
+		if(entry.data.empty())
+		{
+			entry.pins--;
+			return NULL;
+		}
+		return &entry.data[0];
+	}
+
+	// Claim the tile and its share of the budget, then read it unlocked.
+	// The entry is pinned, so it stays put while the lock is dropped.
+	shard.counters.misses++;
+	evict(shard, texture.tile_bytes());
+	Entry &entry = shard.entries[key];
+	entry.pins = 1;
+	entry.loading = true;
+	shard.resident += texture.tile_bytes();
+	shard.lru.push_front(key);
+	entry.lru_position = shard.lru.begin();
+	guard.unlock();
+
+	vector<unsigned char> data(texture.tile_bytes());
+	bool read = texture.read_tile(tile, &data[0]);
+
+	guard.lock();
+	entry.loading = false;
+	shard.loaded.notify_all();
+	if(!read)
+	{
+		// Kept empty so later samples don't read it again
+		shard.resident -= texture.tile_bytes();
+		entry.pins--;
+		return NULL;
+	}
+	entry.data.swap(data);
+	return &entry.data[0];
+}
+
+void TextureCache::release(const Texture &texture, GLuint tile)
+{
+	uint64_t key = tile_key(texture, tile);
+	Shard &shard = shard_of(key);
+	lock_guard<mutex> guard(shard.lock);
+	shard.entries[key].pins--;
+}
+
+void TextureCache::forget(const Texture &texture)
+{
+	for(GLuint i = 0; i < TEXTURE_CACHE_SHARDS; i++)
+	{
+		Shard &shard = shards[i];
+		lock_guard<mutex> guard(shard.lock);
+		for(list<uint64_t>::iterator it = shard.lru.begin(); it != shard.lru.end();)
+		{
+			if((*it >> 32) != texture.id())
+			{
+				++it;
+				continue;
+			}
+			shard.resident -= shard.entries[*it].data.size();
+			shard.entries.erase(*it);
+			it = shard.lru.erase(it);
+		}
+	}
+}
+
+// Drops least recently used tiles of a shard until the incoming one fits
+// its budget. Tiles pinned by a sample in flight or still loading are
+// skipped, so the budget is soft while every resident tile is in use.
+void TextureCache::evict(Shard &shard, size_t incoming_bytes)
+{
+	list<uint64_t>::iterator it = shard.lru.end();
+	while(shard.resident + incoming_bytes > shard.budget_bytes && it != shard.lru.begin())
+	{
+		--it;
+		Entry &victim = shard.entries[*it];
+		if(victim.pins > 0)
+			continue;
+		shard.resident -= victim.data.size();
+		shard.counters.evictions++;
+		shard.entries.erase(*it);
+		it = shard.lru.erase(it);
+	}
+}
+
+// --------------------------------------------------------------------------
+// Texture
+
+atomic<GLuint> Texture::texture_count(0);
+
+Texture::Texture(const string &texture_file, TextureCache *cache_)
+{
+	cache = cache_;
+	texture_id = texture_count++;
+	data_offset = 0;
+
+	fd = open(texture_file.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		cout << "Texture ERROR: Could not open " << texture_file << endl;
+		return;
+	}
+
+	TextureHeader header;
+	if(pread(fd, &header, sizeof(header), 0) != sizeof(header) || memcmp(header.magic, TEXTURE_MAGIC, 8) != 0 ||
+	   header.tile_size != TEXTURE_TILE || header.level_count == 0)
+	{
+		cout << "Texture ERROR: " << texture_file << " is not a packed texture" << endl;
+		close(fd);
+		fd = -1;
+		return;
+	}
+
+	vector<LevelRecord> records(header.level_count);
+	size_t table_bytes = records.size() * sizeof(LevelRecord);
+	if(pread(fd, &records[0], table_bytes, sizeof(header)) != (ssize_t)table_bytes)
+	{
+		cout << "Texture ERROR: Truncated level table in " << texture_file << endl;
+		close(fd);
+		fd = -1;
+		return;
+	}
+
+	levels.resize(records.size());
+	for(GLuint i = 0; i < records.size(); i++)
+	{
+		// An empty level would leave nothing to wrap texel coordinates around
+		if(records[i].width == 0 || records[i].height == 0)
+		{
+			cout << "Texture ERROR: Level " << i << " of " << texture_file << " is empty" << endl;
+			close(fd);
+			fd = -1;
+			return;
+		}
+		levels[i].width = records[i].width;
+		levels[i].height = records[i].height;
+		levels[i].tiles_x = records[i].tiles_x;
+		levels[i].first_tile = records[i].first_tile;
+	}
+	data_offset = sizeof(header) + table_bytes;
+}
+
+Texture::~Texture()
+{
+	cache->forget(*this);
+	if(fd >= 0)
+		close(fd);
+}
+
+bool Texture::read_tile(GLuint tile, unsigned char *data) const
+{
+	return pread(fd, data, tile_bytes(), data_offset + (uint64_t)tile * tile_bytes()) == (ssize_t)tile_bytes();
+}
+
+vec3 Texture::texel(const Level &level, GLint x, GLint y, TileRef *ref) const
+{
+	GLint tile = level.first_tile + (y / TEXTURE_TILE) * level.tiles_x + x / TEXTURE_TILE;
+	if(tile != ref->tile)
+	{
+		if(ref->data)
+			cache->release(*this, ref->tile);
+		ref->data = cache->acquire(*this, tile);
+		ref->tile = tile;
+	}
+	if(!ref->data)
+		return vec3(1.0);
+	const unsigned char *p = ref->data + ((y % TEXTURE_TILE) * TEXTURE_TILE + x % TEXTURE_TILE) * 3;
+	return vec3(p[0], p[1], p[2]) / 255.0f;
+}
+
+vec3 Texture::bilinear(GLuint level_index, const dvec2 &uv, TileRef *ref) const
+{
+	const Level &level = levels[level_index];
+	GLdouble x = (uv.x - floor(uv.x)) * level.width - 0.5;
+	GLdouble y = (uv.y - floor(uv.y)) * level.height - 0.5;
+	GLint x0 = (GLint)floor(x), y0 = (GLint)floor(y);
+	GLfloat fx = x - x0, fy = y - y0;
+
+	// Wrap the 2x2 neighbourhood around the edges
+	GLint w = level.width, h = level.height;
+	GLint xa = (x0 + w) % w, xb = (x0 + 1) % w;
+	GLint ya = (y0 + h) % h, yb = (y0 + 1) % h;
+	vec3 top = mix(texel(level, xa, ya, ref), texel(level, xb, ya, ref), fx);
+	vec3 bottom = mix(texel(level, xa, yb, ref), texel(level, xb, yb, ref), fx);
+	return mix(top, bottom, fy);
+}
+
+vec3 Texture::sample(const dvec2 &uv, GLdouble width) const
+{
+	if(fd < 0)
+		return vec3(1.0);
+
+	GLdouble texels = width * std::max(levels[0].width, levels[0].height);
+	GLdouble lod = texels > 1 ? std::min(log2(texels), (GLdouble)(levels.size() - 1)) : 0;
+	GLuint fine = (GLuint)lod;
+	GLfloat blend = lod - fine;
+
+	TileRef ref = { -1, NULL };
+	vec3 colour = bilinear(fine, uv, &ref);
+	if(blend > 0 && fine + 1 < levels.size())
+		colour = mix(colour, bilinear(fine + 1, uv, &ref), blend);
+	if(ref.data)
+		cache->release(*this, ref.tile);
+	return colour;
+}
+
+// --------------------------------------------------------------------------
+// Packing
+
+bool Texture::pack(const string &image_file, const string &texture_file)
+{
+	Magick::Image image;
+	vector<unsigned char> pixels;
+	uint32_t width, height;
+	try
+	{
+		image.read(image_file);
+		width = image.columns();
+		height = image.rows();
+		pixels.resize(width * height * 3);
+		image.write(0, 0, width, height, "RGB", Magick::CharPixel, &pixels[0]);
+	}
+	catch(Magick::Error &error)
+	{
+		cout << "Texture ERROR: Could not read " << image_file << ": " << error.what() << endl;
+		return false;
+	}
+	if(width == 0 || height == 0)
+	{
+		cout << "Texture ERROR: " << image_file << " is empty" << endl;
+		return false;
+	}
+
+	// Each level averages 2x2 texels of the one above, down to 1x1. Sizes
+	// halve rounding down, so an odd edge's last texel is left out, and a
+	// side already one texel long repeats that texel.
+	vector<vector<unsigned char> > chain(1, pixels);
+	vector<LevelRecord> records;
+	uint32_t first_tile = 0;
+	for(uint32_t w = width, h = height;; w = std::max(w / 2, 1u), h = std::max(h / 2, 1u))
+	{
+		if(!records.empty())
+		{
+			const vector<unsigned char> &above = chain.back();
+			const LevelRecord &prev = records.back();
+			vector<unsigned char> level(w * h * 3);
+			for(uint32_t y = 0; y < h; y++)
+				for(uint32_t x = 0; x < w; x++)
+					for(uint32_t c = 0; c < 3; c++)
+					{
+						uint32_t x0 = std::min(2 * x, prev.width - 1), x1 = std::min(2 * x + 1, prev.width - 1);
+						uint32_t y0 = std::min(2 * y, prev.height - 1), y1 = std::min(2 * y + 1, prev.height - 1);
+						uint32_t sum = above[(y0 * prev.width + x0) * 3 + c] + above[(y0 * prev.width + x1) * 3 + c] +
+						               above[(y1 * prev.width + x0) * 3 + c] + above[(y1 * prev.width + x1) * 3 + c];
+						level[(y * w + x) * 3 + c] = (sum + 2) / 4;
+					}
+			chain.push_back(level);
+		}
+
+		LevelRecord record;
+		record.width = w;
+		record.height = h;
+		record.tiles_x = (w + TEXTURE_TILE - 1) / TEXTURE_TILE;
+		record.first_tile = first_tile;
+		first_tile += record.tiles_x * ((h + TEXTURE_TILE - 1) / TEXTURE_TILE);
+		records.push_back(record);
+		if(w == 1 && h == 1)
+			break;
+	}
+
+	TextureHeader header;
+	memcpy(header.magic, TEXTURE_MAGIC, 8);
+	header.width = width;
+	header.height = height;
+	header.level_count = records.size();
+	header.tile_size = TEXTURE_TILE;
+
+	ofstream output(texture_file.c_str(), ios::binary | ios::trunc);
+	if(!output)
+	{
+		cout << "Texture ERROR: Could not write " << texture_file << endl;
+		return false;
+	}
+	output.write((const char *)&header, sizeof(header));
+	output.write((const char *)&records[0], records.size() * sizeof(LevelRecord));
+
+	// Tiles past the right or bottom edge are padded with black
+	vector<unsigned char> tile(TEXTURE_TILE * TEXTURE_TILE * 3);
+	for(GLuint i = 0; i < records.size(); i++)
+	{
+		const LevelRecord &record = records[i];
+		uint32_t tiles_y = (record.height + TEXTURE_TILE - 1) / TEXTURE_TILE;
+		for(uint32_t ty = 0; ty < tiles_y; ty++)
+			for(uint32_t tx = 0; tx < record.tiles_x; tx++)
+			{
+				std::fill(tile.begin(), tile.end(), 0);
+				for(uint32_t y = 0; y < TEXTURE_TILE && ty * TEXTURE_TILE + y < record.height; y++)
+				{
+					uint32_t columns = std::min((uint32_t)TEXTURE_TILE, record.width - tx * TEXTURE_TILE);
+					memcpy(&tile[y * TEXTURE_TILE * 3], &chain[i][((ty * TEXTURE_TILE + y) * record.width + tx * TEXTURE_TILE) * 3], columns * 3);
+				}
+				output.write((const char *)&tile[0], tile.size());
+			}
+	}
+
+	cout << "Texture packed " << width << "x" << height << " into " << records.size() << " levels of " << first_tile << " tiles" << endl;
+	return output.good();
+}
@@ -0,0 +1,134 @@
+/*
+ * Texture.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: matt
+ */
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <glm/glm.hpp>
+#include <GLFW/glfw3.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+// Texel edge length of the square tiles a texture is stored in
+#define TEXTURE_TILE 32
+
+// Default memory for resident texture tiles, in bytes
+#define TEXTURE_CACHE_BUDGET (64 * 1024 * 1024)
+
+// Independently locked parts of the cache, tiles are spread over them by key
+#define TEXTURE_CACHE_SHARDS 16
+
+class Texture;
+
+// Tiles of every texture in a scene, read from disk the first time a ray
+// needs them and dropped least-recently-used first once the resident size
+// goes over the budget. Shared by all render threads: tiles are split over
+// shards that each have their own lock, LRU list and share of the budget,
+// and a tile is read with no lock held while threads wanting the same one
+// wait for it.
+class TextureCache
+{
+	public:
+	    struct Stats
+	    {
+	        uint64_t hits;
+	        uint64_t misses;
+	        uint64_t evictions;
+	        size_t resident_bytes;
+	        size_t budget_bytes;
+	    };
+	    explicit TextureCache(size_t budget_bytes_ = TEXTURE_CACHE_BUDGET);
+	    void set_budget(size_t budget_bytes_);
+	    Stats stats();
+	    void reset_stats();
+	    // Pins a tile in memory, reading it on a miss. NULL if it could not
+	    // be read. Every tile acquired must be released.
+	    const unsigned char *acquire(const Texture &texture, GLuint tile);
+	    void release(const Texture &texture, GLuint tile);
+	    // Drops the tiles of a texture that is going away
+	    void forget(const Texture &texture);
+	private:
+	    struct Entry
+	    {
+	        // Empty if the tile could not be read
+	        vector<unsigned char> data;
+	        GLuint pins;
+	        // Set while the thread that missed the tile is reading it
+	        bool loading;
+	        list<uint64_t>::iterator lru_position;
+	    };
+	    struct Shard
+	    {
+	        mutex lock;
+	        // Signalled whenever one of the shard's tiles finishes loading
+	        condition_variable loaded;
+	        unordered_map<uint64_t, Entry> entries;
+	        list<uint64_t> lru;
+	        size_t budget_bytes;
+	        size_t resident;
+	        Stats counters;
+	    };
+	    Shard &shard_of(uint64_t key);
+	    void evict(Shard &shard, size_t incoming_bytes);
+
+	    Shard shards[TEXTURE_CACHE_SHARDS];
+};
+
+// Image texture in a packed file of mip levels, each cut into tiles. Only
+// the level table is held here, texels come through the cache.
+class Texture
+{
+	public:
+	    Texture(const string &texture_file, TextureCache *cache_);
+	    ~Texture();
+	    bool loaded() const { return fd >= 0; }
+	    GLuint id() const { return texture_id; }
+	    size_t tile_bytes() const { return TEXTURE_TILE * TEXTURE_TILE * 3; }
+	    bool read_tile(GLuint tile, unsigned char *data) const;
+	    // Trilinear colour at uv, which wraps, for a footprint width uv units
+	    // across. The mip level is the one whose texels are that wide. Taken
+	    // in double so surface coordinates of either precision keep theirs.
+	    vec3 sample(const dvec2 &uv, GLdouble width) const;
+
+	    // Converts an image file into a packed, tiled mip chain
+	    static bool pack(const string &image_file, const string &texture_file);
+
+	private:
+	    struct Level
+	    {
+	        uint32_t width, height;
+	        uint32_t tiles_x;
+	        uint32_t first_tile;
+	    };
+	    // The tile a sample currently has pinned, so neighbouring texels in
+	    // the same tile take the cache lock once
+	    struct TileRef
+	    {
+	        GLint tile;
+	        const unsigned char *data;
+	    };
+	    vec3 texel(const Level &level, GLint x, GLint y, TileRef *ref) const;
+	    vec3 bilinear(GLuint level_index, const dvec2 &uv, TileRef *ref) const;
+
+	    int fd;
+	    uint64_t data_offset;
+	    vector<Level> levels;
+	    TextureCache *cache;
+	    GLuint texture_id;
+	    // Textures are also made by reload threads, so ids are drawn atomically
+	    static atomic<GLuint> texture_count;
+};
+
+#endif
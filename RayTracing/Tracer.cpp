@@ -5,121 +5,355 @@
  *      Author: matt
  */
 #include "Tracer.h"
+#include "Texture.h"
 
-void Tracer::trace(const Ray &ray, glm::vec3 *pixel_colour, GLuint recursion_depth, GLint recursive_object_index)
+#include <cstring>
+#include <stdint.h>
+
+static thread_local vector<GLint> *shaded_log = NULL;
+
+void log_shaded_objects(vector<GLint> *log)
+{
+	shaded_log = log;
+}
+
+template<typename real>
+void Tracer<real>::trace(const Ray<real> &ray, glm::vec3 *pixel_colour, GLuint recursion_depth, GLint recursive_object_index, HitFeatures *features)
 {
 	if(recursion_depth == 0)
 	{
 		return;
 	}
 
-	GLfloat min_t_val, t_val;
-	GLint intersect_obj_index = -1;
-	vec3 intersection_point, tmp_point;
-	min_t_val = 1E6;
-	for(GLuint i= 0; i < objects.size(); i++)
+	rvec3<real> intersection_point, normal;
+	real min_t_val = 1E6;
+	// For reflected rays, exclude object reflected ray was generated from
+	GLint intersect_obj_index = bvh.closest_hit(objects, ray, recursive_object_index, std::numeric_limits<real>::epsilon(), &min_t_val, &intersection_point, &normal);
+
+	if(intersect_obj_index < 0)
+	{
+		return;
+	}
+
+	if(features)
+		hit_features(ray, intersect_obj_index, intersection_point, normal, features);
+	trace_hit(ray, intersect_obj_index, intersection_point, normal, pixel_colour, recursion_depth);
+}
+
+template<typename real>
+void Tracer<real>::trace_hit(const Ray<real> &ray, GLint intersect_obj_index, const rvec3<real> &intersection_point, const rvec3<real> &normal, vec3 *pixel_colour, GLuint recursion_depth)
+{
+	shade_lights(ray, intersect_obj_index, intersection_point, normal, pixel_colour);
+
+	//Handle mirror reflection
+	if(objects.at(intersect_obj_index)->reflectance > 0)
 	{
-		// For reflected rays, exclude object reflected ray was generated from
-		if( i != recursive_object_index)
+		vec3 reflection_colour(0.0);
+		trace(reflection_ray(ray, intersection_point, normal), &reflection_colour, recursion_depth - 1, intersect_obj_index);
+		*pixel_colour += (objects.at(intersect_obj_index)->reflectance * reflection_colour);
+	}
+
+	clamp_colour(pixel_colour);
+}
+
+template<typename real>
+void Tracer<real>::shade_lights(const Ray<real> &ray, GLint intersect_obj_index, const rvec3<real> &intersection_point, const rvec3<real> &normal, vec3 *pixel_colour)
+{
+	if(shaded_log)
+		shaded_log->push_back(intersect_obj_index);
+
+	// Ambient comes with the first light, then each light adds as much of
+	// its diffuse and specular as the point sees of it
+	Ray<real> lray(rvec3<real>(0.0), rvec3<real>(0.0));
+	vec3 lcolour(0.0);
+	if(lights.empty())
+		*pixel_colour += shade(intersection_point, normal, intersect_obj_index, ray, lray, lcolour, 0, true);
+	for(GLuint i = 0; i < lights.size(); i++)
+	{
+		lights[i]->generate_light_ray(intersection_point, &lray, &lcolour);
+		GLfloat visibility = light_visibility(*lights[i], intersection_point, intersect_obj_index);
+		*pixel_colour += shade(intersection_point, normal, intersect_obj_index, ray, lray, lcolour, visibility, i == 0);
+	}
+}
+
+template<typename real>
+Ray<real> Tracer<real>::reflection_ray(const Ray<real> &ray, const rvec3<real> &point, const rvec3<real> &normal)
+{
+	Ray<real> reflected(point, reflect(ray.direction, normal));
+	// The cone carries on from its width here, as off a flat mirror
+	reflected.cone_width = ray.cone_width + ray.cone_spread * length(point - ray.origin);
+	reflected.cone_spread = ray.cone_spread;
+	return reflected;
+}
+
+template<typename real>
+void Tracer<real>::clamp_colour(vec3 *colour) const
+{
+    if(clamp_colours)
+    {
+        if(colour->x > 1.0) colour->x = 1.0;
+        if(colour->y > 1.0) colour->y = 1.0;
+        if(colour->z > 1.0) colour->z = 1.0;
+    }
+}
+
+template<typename real>
+void Tracer<real>::trace_batch(const vector<Ray<real> > &rays, vec3 *colours, GLuint recursion_depth, HitFeatures *features)
+{
+	// Node i is the colour of ray i, later nodes are reflections
+	vector<PathNode> nodes;
+	vector<BatchRay> wave;
+	for(GLuint i = 0; i < rays.size(); i++)
+	{
+		PathNode node = { -1, false, 0, vec3(0.0) };
+		nodes.push_back(node);
+		BatchRay batch_ray = { rays[i], i, -1 };
+		wave.push_back(batch_ray);
+	}
+
+	// Primary rays come in pixel order, which is coherent already
+	for(GLuint depth = recursion_depth; depth > 0 && !wave.empty(); depth--)
+	{
+		if(depth < recursion_depth)
+			bin_rays(&wave);
+		vector<BatchRay> next;
+		for(GLuint i = 0; i < wave.size(); i++)
 		{
-		    // Find intersection points of each object in the scene with viewing ray
-		    if(objects.at(i)->intersect(ray, &tmp_point, &t_val))
-		    {
-			    if(t_val < min_t_val && t_val > std::numeric_limits<float>::epsilon())
-			    {
-				    min_t_val = t_val;
-				    intersect_obj_index = i;
-				    intersection_point = tmp_point;
-			    }
-		    }
+			const BatchRay &batch_ray = wave[i];
+			rvec3<real> point, normal;
+			real min_t_val = 1E6;
+			GLint object_index = bvh.closest_hit(objects, batch_ray.ray, batch_ray.exclude, std::numeric_limits<real>::epsilon(), &min_t_val, &point, &normal);
+			if(object_index < 0)
+				continue;
+
+			PathNode &node = nodes[batch_ray.node];
+			node.hit = true;
+			if(features && depth == recursion_depth)
+				hit_features(batch_ray.ray, object_index, point, normal, &features[batch_ray.node]);
+			shade_lights(batch_ray.ray, object_index, point, normal, &node.colour);
+
+			// A reflection on the last bounce would add nothing
+			node.reflectance = objects.at(object_index)->reflectance;
+			if(node.reflectance > 0 && depth > 1)
+			{
+				BatchRay reflected = { reflection_ray(batch_ray.ray, point, normal), (GLuint)nodes.size(), object_index };
+				PathNode child = { (GLint)batch_ray.node, false, 0, vec3(0.0) };
+				nodes.push_back(child);
+				next.push_back(reflected);
+			}
 		}
+		wave.swap(next);
 	}
 
-	if(intersect_obj_index < 0)
+	// Reflections come after their parents, so walking back finishes each
+	// node before it is added to its parent, clamped as trace would
+	for(GLint i = nodes.size() - 1; i >= 0; i--)
 	{
+		if(nodes[i].hit)
+			clamp_colour(&nodes[i].colour);
+		if(nodes[i].parent >= 0)
+		{
+			PathNode &parent = nodes[nodes[i].parent];
+			parent.colour += parent.reflectance * nodes[i].colour;
+		}
+		else
+			colours[i] = nodes[i].colour;
+	}
+}
+
+// Spreads the bits of a RAY_BIN_CELLS cell coordinate three apart
+static GLuint spread_bits(GLuint v)
+{
+	GLuint spread = 0;
+	for(GLuint bit = 0; (1u << bit) < RAY_BIN_CELLS; bit++)
+		spread |= ((v >> bit) & 1) << (3 * bit);
+	return spread;
+}
+
+// Counting sort into bins of direction octant, then origin cell in Morton
+// order over the rays' bounds. Rays keep their order within a bin.
+template<typename real>
+void Tracer<real>::bin_rays(vector<BatchRay> *rays)
+{
+	if(rays->size() < 2)
 		return;
+	rvec3<real> low = (*rays)[0].ray.origin, high = low;
+	for(GLuint i = 1; i < rays->size(); i++)
+	{
+		low = glm::min(low, (*rays)[i].ray.origin);
+		high = glm::max(high, (*rays)[i].ray.origin);
 	}
+	rvec3<real> extent = high - low;
 
-	Ray lray(vec3(0.0), vec3(0.0));
-	vec3 lcolour(0.0);
-	GLint shadow_obj_index = -1;
-	vec3 shadow_point;
-	min_t_val = 1E6;
-	bool in_shadow = false;
-	for(GLint i= 0; i < lights.size(); i++)
+	const GLuint cell_count = RAY_BIN_CELLS * RAY_BIN_CELLS * RAY_BIN_CELLS;
+	vector<GLuint> bins(rays->size());
+	vector<GLuint> starts(8 * cell_count + 1, 0);
+	for(GLuint i = 0; i < rays->size(); i++)
 	{
-		lights.at(i)->generate_light_ray(intersection_point, &lray, &lcolour);
-	    for(GLint j= 0; j < objects.size(); j++)
-	    {
-	    	// Exclude the object we are shading
-			if(j != intersect_obj_index)
-			{
-	    	    // Find intersection points of each object in the scene with light ray
-	    	    if(objects.at(j)->intersect(lray, &tmp_point, &t_val))
-	    	    {
-				    if(t_val < min_t_val && t_val > 0)
-				    {
-					    min_t_val = t_val;
-					    shadow_obj_index = j;
-					    shadow_point = tmp_point;
-				    }
-	    	    }
-	    	}
-	    }
+		const Ray<real> &ray = (*rays)[i].ray;
+		GLuint octant = (ray.direction.x < 0) | ((ray.direction.y < 0) << 1) | ((ray.direction.z < 0) << 2);
+		GLuint cell = 0;
+		for(GLuint axis = 0; axis < 3; axis++)
+		{
+			GLuint c = extent[axis] > 0 ? (GLuint)((ray.origin[axis] - low[axis]) / extent[axis] * RAY_BIN_CELLS) : 0;
+			cell |= spread_bits(std::min(c, (GLuint)RAY_BIN_CELLS - 1)) << axis;
+		}
+		bins[i] = octant * cell_count + cell;
+		starts[bins[i] + 1]++;
 	}
+	for(GLuint b = 1; b < starts.size(); b++)
+		starts[b] += starts[b - 1];
+
+	vector<BatchRay> sorted(rays->size(), (*rays)[0]);
+	for(GLuint i = 0; i < rays->size(); i++)
+		sorted[starts[bins[i]]++] = (*rays)[i];
+	rays->swap(sorted);
+}
+
+// Whether anything but exclude lies between point and target
+template<typename real>
+bool Tracer<real>::occluded(const rvec3<real> &point, const rvec3<real> &target, GLint exclude)
+{
+	Ray<real> sray(point, target - point);
+	real min_t_val = 1E6;
+	rvec3<real> blocker_point;
+	GLint blocker = bvh.closest_hit(objects, sray, exclude, 0, &min_t_val, &blocker_point, NULL);
+	return blocker >= 0 && length(blocker_point - point) < length(sray.direction) && min_t_val > std::numeric_limits<real>::epsilon();
+}
 
-	GLfloat t_light =  length(lray.direction);
-	GLfloat t_tmp =  length(shadow_point - intersection_point);
-	if(shadow_obj_index >= 0 && t_tmp < t_light && min_t_val > std::numeric_limits<float>::epsilon())
+// Offset of the light sample pattern for a shaded point, hashed from its
+// position so neighbouring pixels get different patterns and the same
+// point always gets the same one
+template<typename real>
+static rvec2<real> sample_offset(const rvec3<real> &point)
+{
+	vec3 p(point);
+	uint32_t bits[3];
+	memcpy(bits, &p[0], sizeof(bits));
+	uint32_t h[2] = { 2166136261u, 0x9E3779B9u };
+	for(GLuint k = 0; k < 2; k++)
 	{
-		in_shadow = true;
+		for(GLuint i = 0; i < 3; i++)
+			h[k] = (h[k] ^ bits[i]) * 16777619u;
+		h[k] ^= h[k] >> 16;
+		h[k] *= 0x85EBCA6Bu;
+		h[k] ^= h[k] >> 13;
+		h[k] *= 0xC2B2AE35u;
+		h[k] ^= h[k] >> 16;
 	}
+	return rvec2<real>(h[0] / (real)4294967296.0, h[1] / (real)4294967296.0);
+}
 
-	*pixel_colour += shade(intersection_point, intersect_obj_index, ray, lray, lcolour, in_shadow);
+template<typename real>
+GLfloat Tracer<real>::light_visibility(const Light<real> &light, const rvec3<real> &point, GLint exclude)
+{
+	if(light.shape == Light<real>::POINT || light.samples <= 1)
+		return occluded(point, light.point, exclude) ? 0.0f : 1.0f;
 
-	//Handle mirror reflection
-	if(objects.at(intersect_obj_index)->reflectance > 0)
+	// Points the first few samples find wholly lit or wholly shadowed are
+	// taken to be so, only penumbrae get the full count
+	rvec2<real> offset = sample_offset<real>(point);
+	GLuint lit = 0, taken;
+	for(taken = 0; taken < light.samples; taken++)
 	{
-		Ray reflection_ray(intersection_point, reflect(ray.direction, objects.at(intersect_obj_index)->normal(intersection_point)));
-		vec3 reflection_colour(0.0);
-		trace(reflection_ray, &reflection_colour, recursion_depth - 1, intersect_obj_index);
-		*pixel_colour += (objects.at(intersect_obj_index)->reflectance * reflection_colour);
+		if(taken == SHADOW_MIN_SAMPLES && (lit == 0 || lit == taken))
+			break;
+		if(!occluded(point, light.sample_point(taken, offset, point), exclude))
+			lit++;
 	}
+	return (GLfloat)lit / taken;
+}
+
+template<typename real>
+void Tracer<real>::hit_features(const Ray<real> &ray, GLint object_index, const rvec3<real> &point, const rvec3<real> &normal, HitFeatures *features)
+{
+	features->albedo = surface_colour(ray, object_index, point, normal);
+	features->normal = vec3(normal);
+	features->depth = length(point - ray.origin);
+}
 
-    if(pixel_colour->x > 1.0) pixel_colour->x = 1.0;
-    if(pixel_colour->y > 1.0) pixel_colour->y = 1.0;
-    if(pixel_colour->z > 1.0) pixel_colour->z = 1.0;
+template<typename real>
+GLint Tracer<real>::first_hit(const Ray<real> &ray, rvec3<real> *point, rvec3<real> *normal)
+{
+	real min_t_val = 1E6;
+	return bvh.closest_hit(objects, ray, -1, std::numeric_limits<real>::epsilon(), &min_t_val, point, normal);
+}
+
+template<typename real>
+void Tracer<real>::primary_features(const Ray<real> &ray, HitFeatures *features)
+{
+	rvec3<real> point, normal;
+	GLint object_index = first_hit(ray, &point, &normal);
+	if(object_index >= 0)
+		hit_features(ray, object_index, point, normal, features);
+}
 
+template<typename real>
+void Tracer<real>::build_acceleration()
+{
+	bvh.build(objects);
 }
 
-vec3 Tracer::shade(const vec3 &intersection, const GLint &object_index, const Ray &cray, const Ray &lray, const vec3 &light_colour, const bool &in_shadow)
+template<typename real>
+void Tracer<real>::update_acceleration()
+{
+	// Refitting keeps the tree shape, which only suits small motions. Once
+	// the boxes have grown well past a fresh build, build again.
+	bvh.refit(objects);
+	if(bvh.cost() > 1.5f * bvh.built_cost())
+		bvh.build(objects);
+}
+
+template<typename real>
+vec3 Tracer<real>::surface_colour(const Ray<real> &ray, GLint object_index, const rvec3<real> &point, const rvec3<real> &normal)
+{
+	Object<real> *object = objects.at(object_index);
+	rvec2<real> coords;
+	real span;
+	if(!object->texture || !object->uv(point, &coords, &span))
+		return object->diffuse_colour;
+
+	// Width of the ray's cone where it lands, stretched where it meets the
+	// surface at a glancing angle
+	real slope = glm::max((real)0.05, (real)fabs(dot(normal, normalize(ray.direction))));
+	real width = (ray.cone_width + ray.cone_spread * length(point - ray.origin)) / slope;
+	return object->diffuse_colour * object->texture->sample(dvec2(coords * object->texture_repeat), width * object->texture_repeat / span);
+}
+
+template<typename real>
+vec3 Tracer<real>::shade(const rvec3<real> &intersection, const rvec3<real> &normal, const GLint &object_index, const Ray<real> &cray, const Ray<real> &lray, const vec3 &light_colour, GLfloat visibility, bool ambient)
 {
 	vec3 colour(0.0);
-	Object *object = objects.at(object_index);
+	Object<real> *object = objects.at(object_index);
+	vec3 diffuse_colour = surface_colour(cray, object_index, intersection, normal);
 
 	// Ambient
-    colour += object->diffuse_colour * (GLfloat)0.4;
+    if(ambient)
+        colour += diffuse_colour * (GLfloat)0.4;
 
-    if(in_shadow)
+    if(visibility <= 0)
     	return colour;
 
     // Diffuse
-    colour += object->diffuse_colour * (light_colour*(GLfloat)glm::max((GLfloat)0.0, dot(normalize(object->normal(intersection)), normalize(lray.direction))));
+    colour += visibility * diffuse_colour * (light_colour*(GLfloat)glm::max((real)0.0, dot(normal, normalize(lray.direction))));
 
     // Specular
     if(object->phong_exponent > 0)
     {
-    	if (dot(lray.direction, object->normal(intersection)) > 0.0)
+    	if (dot(lray.direction, normal) > 0.0)
     	{
-            vec3 reflected = normalize(reflect(lray.direction , object->normal(intersection)));
-            colour += object->specular_colour * (light_colour*pow((GLfloat)glm::max((GLfloat)0.0, dot(normalize(cray.direction), reflected)), object->phong_exponent));
+            rvec3<real> reflected = normalize(reflect(lray.direction , normal));
+            colour += visibility * object->specular_colour * (light_colour*pow((GLfloat)glm::max((real)0.0, dot(normalize(cray.direction), reflected)), object->phong_exponent));
     	}
     }
 
-    for(GLuint i = 0; i < colour.length(); i++) { if(colour[i] > 1.0) colour[i] = 1.0; }
+    if(clamp_colours)
+    {
+        for(GLuint i = 0; i < colour.length(); i++) { if(colour[i] > 1.0) colour[i] = 1.0; }
+    }
 
 	return colour;
 }
 
-
-
+template class Tracer<GLfloat>;
+template class Tracer<GLdouble>;
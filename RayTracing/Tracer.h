@@ -11,6 +11,7 @@
 #include <GLFW/glfw3.h>
 #include <vector>
 
+#include "BVH.h"
 #include "Light.h"
 #include "Ray.h"
 #include "Primitives.h"
@@ -18,13 +19,80 @@
 using namespace std;
 using namespace glm;
 
+// What a primary ray saw, to guide the denoiser. All zero for a miss.
+struct HitFeatures
+{
+	vec3 albedo;
+	vec3 normal;
+	GLfloat depth;
+};
+
+// Cells per axis of the grid secondary rays are binned by origin in
+#define RAY_BIN_CELLS 4
+
+// Objects shaded on the calling thread, by a tracer of either precision, are
+// appended to log until it is set back to NULL, e.g. to find what a tile of
+// the image shows
+void log_shaded_objects(vector<GLint> *log);
+
+template<typename real>
 class Tracer
 {
     public:
-	    vector<Light*> lights;
-	    vector<Object*> objects;
-	    void trace(const Ray &ray, vec3 *colour, GLuint recursion_depth, GLint recursive_object_index);
-	    vec3 shade(const vec3 &intersection, const GLint &object_index, const Ray &cray, const Ray &ray, const vec3 &light_colour, const bool &in_shadow);
+	    Tracer() : clamp_colours(true) {}
+	    vector<Light<real>*> lights;
+	    // Clamp to displayable [0,1] colours, off for linear HDR output
+	    bool clamp_colours;
+	    vector<Object<real>*> objects;
+	    // Call after objects are added, and update after they move
+	    void build_acceleration();
+	    void update_acceleration();
+	    void trace(const Ray<real> &ray, vec3 *colour, GLuint recursion_depth, GLint recursive_object_index, HitFeatures *features = NULL);
+	    // Shading, shadows and reflections for a primary hit already found,
+	    // e.g. by the rasterizer
+	    void trace_hit(const Ray<real> &ray, GLint object_index, const rvec3<real> &point, const rvec3<real> &normal, vec3 *colour, GLuint recursion_depth);
+	    // Traces a batch of primary rays breadth first, giving the same colours
+	    // as trace. Each bounce's hits are shaded before any reflection off
+	    // them is traced, and the reflection rays are binned by direction
+	    // octant and origin cell so rays traced one after another take
+	    // similar paths through the BVH. Features are one per ray if given.
+	    void trace_batch(const vector<Ray<real> > &rays, vec3 *colours, GLuint recursion_depth, HitFeatures *features = NULL);
+	    void hit_features(const Ray<real> &ray, GLint object_index, const rvec3<real> &point, const rvec3<real> &normal, HitFeatures *features);
+	    // Nearest object along a primary ray, where it is hit and the normal
+	    // there, -1 for none
+	    GLint first_hit(const Ray<real> &ray, rvec3<real> *point, rvec3<real> *normal);
+	    // Features alone, without shading
+	    void primary_features(const Ray<real> &ray, HitFeatures *features);
+	    // Diffuse colour at a hit, from the object's texture if it has one
+	    vec3 surface_colour(const Ray<real> &ray, GLint object_index, const rvec3<real> &point, const rvec3<real> &normal);
+	    // Ambient if asked for, plus the light's diffuse and specular scaled
+	    // by how much of the light is visible
+	    vec3 shade(const rvec3<real> &intersection, const rvec3<real> &normal, const GLint &object_index, const Ray<real> &cray, const Ray<real> &ray, const vec3 &light_colour, GLfloat visibility, bool ambient);
+	private:
+	    // A ray of a batch, shading into path node
+	    struct BatchRay
+	    {
+	        Ray<real> ray;
+	        GLuint node;
+	        GLint exclude;
+	    };
+	    // Colour gathered by one ray of a path, reflected into its parent's
+	    struct PathNode
+	    {
+	        GLint parent;
+	        bool hit;
+	        GLfloat reflectance;
+	        vec3 colour;
+	    };
+	    static void bin_rays(vector<BatchRay> *rays);
+	    // Direct lighting at a hit, every light with ambient once
+	    void shade_lights(const Ray<real> &ray, GLint object_index, const rvec3<real> &point, const rvec3<real> &normal, vec3 *colour);
+	    Ray<real> reflection_ray(const Ray<real> &ray, const rvec3<real> &point, const rvec3<real> &normal);
+	    void clamp_colour(vec3 *colour) const;
+	    BVH<real> bvh;
+	    bool occluded(const rvec3<real> &point, const rvec3<real> &target, GLint exclude);
+	    // Fraction of a light the point sees, 0 or 1 for a point light
+	    GLfloat light_visibility(const Light<real> &light, const rvec3<real> &point, GLint exclude);
 };
 
 
@@ -9,6 +9,7 @@
 #define WINDOW_H
 
 
+// Default frame size, scenes and the command line can set their own
 #define WINDOW_WIDTH 512
 #define WINDOW_HEIGHT 512
 
@@ -15,6 +15,7 @@
 #include <string>
 #include <iterator>
 #include <algorithm>
+#include <cstdio>
 #include <string>
 
 // specify that we want the OpenGL core profile before including GLFW headers
@@ -25,7 +26,12 @@
 #include <GraphicsMagick/Magick++.h>
 #include "ImageBuffer.h"
 #include "Primitives.h"
+#include "ChunkedMesh.h"
+#include "Coordinator.h"
 #include "Scene.h"
+#include "RenderQueue.h"
+#include "Regression.h"
+#include "FileWatcher.h"
 
 using namespace std;
 
@@ -126,12 +132,117 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 	}
 }
 
+// scrolling dollies the interactive camera
+double scroll_offset = 0;
+
+void ScrollCallback(GLFWwindow*, double, double y_offset)
+{
+    scroll_offset += y_offset;
+}
+
+// Moves the interactive camera: WASD and QE fly it along its own axes, the
+// arrow keys turn it, and dragging with the left button orbits it about a
+// point ahead, which scrolling moves towards. Returns true if it moved.
+bool Navigate(GLFWwindow *window, Scene *scene, GLdouble seconds)
+{
+    static GLdouble last_x = 0, last_y = 0, orbit_distance = 5;
+    static bool dragging = false;
+
+    Camera view = scene->view();
+    GLdouble step = 2.0 * seconds, angle = seconds;
+    dvec3 offset(0.0);
+    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) offset.z -= step;
+    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) offset.z += step;
+    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) offset.x -= step;
+    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) offset.x += step;
+    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS) offset.y -= step;
+    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS) offset.y += step;
+    if (scroll_offset != 0)
+    {
+        GLdouble dolly = std::min(0.5 * scroll_offset, orbit_distance - 0.5);
+        offset.z -= dolly;
+        orbit_distance -= dolly;
+        scroll_offset = 0;
+    }
+    view.move(offset);
+
+    GLdouble yaw = 0, pitch = 0;
+    if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) yaw += angle;
+    if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) yaw -= angle;
+    if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) pitch += angle;
+    if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) pitch -= angle;
+    if (yaw != 0 || pitch != 0)
+        view.turn(yaw, pitch);
+
+    double x, y;
+    glfwGetCursorPos(window, &x, &y);
+    bool pressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    if (pressed && dragging && (x != last_x || y != last_y))
+        view.orbit(view.position + view.forward() * orbit_distance, -0.005 * (x - last_x), -0.005 * (y - last_y));
+    dragging = pressed;
+    last_x = x;
+    last_y = y;
+
+    if (view.same_view(scene->view()))
+        return false;
+    scene->set_pose(view.position, view.orientation);
+    return true;
+}
+
 // ==========================================================================
 // PROGRAM ENTRY POINT
 
 int main(int argc, char *argv[])
 {   
+	// Worker processes started by a coordinator never open a window
+	if (argc >= 3 && string(argv[1]) == "--worker")
+		return Coordinator::run_worker(atoi(argv[2]));
+
+	// Pack an OBJ into a chunked mesh file for streaming, then exit
+	if (argc >= 4 && string(argv[1]) == "--pack")
+	{
+		GLuint chunk_triangles = (argc >= 5) ? atoi(argv[4]) : 65536;
+		return pack_chunked_mesh(argv[2], argv[3], chunk_triangles) ? 0 : -1;
+	}
+
 	Magick::InitializeMagick(NULL);
+
+	// Render the reference scenes, compare them with their golden images and
+	// baseline times, then exit non-zero if any drifted or slowed down
+	if (argc >= 2 && string(argv[1]) == "--regress")
+	{
+		Regression regression;
+		vector<string> scene_files;
+		for (int i = 2; i < argc; i++)
+		{
+			if (string(argv[i]) == "--update")
+				regression.update = true;
+			else if (string(argv[i]) == "--ssim")
+				regression.perceptual = true;
+			else if (string(argv[i]) == "--dir" && i + 1 < argc)
+				regression.directory = argv[++i];
+			else if (string(argv[i]) == "--max-error" && i + 1 < argc)
+				regression.max_error = atof(argv[++i]);
+			else if (string(argv[i]) == "--min-psnr" && i + 1 < argc)
+				regression.min_psnr = atof(argv[++i]);
+			else if (string(argv[i]) == "--min-ssim" && i + 1 < argc)
+				regression.min_ssim = atof(argv[++i]);
+			else if (string(argv[i]) == "--time-threshold" && i + 1 < argc)
+				regression.time_threshold = atof(argv[++i]);
+			else if (string(argv[i]) == "--runs" && i + 1 < argc)
+				regression.runs = atoi(argv[++i]);
+			else
+				scene_files.push_back(argv[i]);
+		}
+		if (!scene_files.empty())
+			regression.scene_files = scene_files;
+		return regression.run();
+	}
+
+	// Pack an image into a tiled mip-mapped texture file, then exit
+	if (argc >= 4 && string(argv[1]) == "--pack-texture")
+		return Texture::pack(argv[2], argv[3]) ? 0 : -1;
+
     // initialize the GLFW windowing system
     if (!glfwInit()) {
         cout << "ERROR: GLFW failed to initilize, TERMINATING" << endl;
@@ -154,6 +265,7 @@ int main(int argc, char *argv[])
 
     // set keyboard callback function and make our context current (active)
     glfwSetKeyCallback(window, KeyCallback);
+    glfwSetScrollCallback(window, ScrollCallback);
     glfwMakeContextCurrent(window);
 
     // query and print out information about our OpenGL environment
@@ -166,22 +278,208 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    // --checkpoint [seconds] journals finished tiles so killed renders resume
+    // --preview [ms] refines progressively and shows the best image in time
+    GLdouble checkpoint_interval = -1;
+    GLdouble preview_budget = -1;
+    // --hdr saves linear float pfm files, --hdr-stream writes tiles as they finish
+    enum { HDR_OFF, HDR_FILE, HDR_STREAM } hdr_output = HDR_OFF;
+    // --workers N renders tiles in N local worker processes
+    GLuint worker_count = 0;
+    // --raster finds primary hits by rasterizing instead of tracing
+    bool raster_primary = false;
+    // --denoise filters each finished frame
+    bool denoise = false;
+    // --interactive [fps] navigates the scene, reusing pixels between frames
+    GLdouble interactive_fps = 0;
+    // --watch reloads scene files when they are saved
+    bool watch = false;
+    // --sort-rays traces reflections a bounce at a time, binned for coherence
+    bool sort_rays = false;
+    // --texture-cache MB sets the memory for resident texture tiles
+    GLdouble texture_budget = -1;
+    // --resolution WxH and --fov degrees override the scene files' cameras,
+    // --crop x y w h renders only that window of the frame
+    GLint resolution[2] = { 0, 0 };
+    GLfloat fov = 0;
+    GLint crop[4] = { 0, 0, 0, 0 };
+    // --queue renders every scene at once on shared threads, then exits
+    bool queue_all = false;
+    // --animate N [fps] renders N frames of the scene's keyframes
+    GLuint animate_frames = 0;
+    GLfloat animate_fps = 24;
+    // --precision float|double traces every scene in that precision instead
+    // of choosing by the scene's extent
+    ScenePrecision precision = PRECISION_AUTO;
+    for (int i = 1; i < argc; i++)
+    {
+        if (string(argv[i]) == "--checkpoint")
+            checkpoint_interval = (i + 1 < argc && isdigit(argv[i+1][0])) ? atof(argv[++i]) : 30.0;
+        else if (string(argv[i]) == "--preview")
+            preview_budget = ((i + 1 < argc && isdigit(argv[i+1][0])) ? atof(argv[++i]) : 200.0) / 1000.0;
+        else if (string(argv[i]) == "--hdr")
+            hdr_output = HDR_FILE;
+        else if (string(argv[i]) == "--hdr-stream")
+            hdr_output = HDR_STREAM;
+        else if (string(argv[i]) == "--workers" && i + 1 < argc)
+            worker_count = atoi(argv[++i]);
+        else if (string(argv[i]) == "--raster")
+            raster_primary = true;
+        else if (string(argv[i]) == "--denoise")
+            denoise = true;
+        else if (string(argv[i]) == "--interactive")
+            interactive_fps = (i + 1 < argc && isdigit(argv[i+1][0])) ? atof(argv[++i]) : 15.0;
+        else if (string(argv[i]) == "--watch")
+            watch = true;
+        else if (string(argv[i]) == "--sort-rays")
+            sort_rays = true;
+        else if (string(argv[i]) == "--texture-cache" && i + 1 < argc)
+            texture_budget = atof(argv[++i]);
+        else if (string(argv[i]) == "--resolution" && i + 1 < argc)
+            sscanf(argv[++i], "%dx%d", &resolution[0], &resolution[1]);
+        else if (string(argv[i]) == "--fov" && i + 1 < argc)
+            fov = atof(argv[++i]);
+        else if (string(argv[i]) == "--crop" && i + 4 < argc)
+        {
+            for (int c = 0; c < 4; c++)
+                crop[c] = atoi(argv[++i]);
+        }
+        else if (string(argv[i]) == "--queue")
+            queue_all = true;
+        else if (string(argv[i]) == "--animate" && i + 1 < argc)
+        {
+            animate_frames = atoi(argv[++i]);
+            if (i + 1 < argc && isdigit(argv[i+1][0]))
+                animate_fps = atof(argv[++i]);
+        }
+        else if (string(argv[i]) == "--precision" && i + 1 < argc)
+        {
+            string name = argv[++i];
+            precision = name == "double" ? PRECISION_DOUBLE : name == "float" ? PRECISION_FLOAT : PRECISION_AUTO;
+        }
+    }
+
     Scene scenes[SCENE_MAX];
 	for(GLuint i = 0; i < SCENE_MAX; i++)
 	{
 		string filename = "scene" + std::to_string(i+1) + ".txt";
+		scenes[i].set_precision(precision);
 		scenes[i].parse(filename);
+		if(checkpoint_interval >= 0)
+		    scenes[i].enable_checkpoint("scene" + std::to_string(i+1) + ".ckpt", checkpoint_interval);
+		if(hdr_output != HDR_OFF)
+		    scenes[i].enable_hdr_output(hdr_output == HDR_STREAM);
+		if(worker_count > 0)
+		    scenes[i].enable_workers(worker_count);
+		if(raster_primary)
+		    scenes[i].enable_raster_primary();
+		if(denoise)
+		    scenes[i].enable_denoise();
+		if(sort_rays)
+		    scenes[i].enable_ray_sorting();
+		if(resolution[0] > 0 && resolution[1] > 0)
+		    scenes[i].set_resolution(resolution[0], resolution[1]);
+		if(fov > 0)
+		    scenes[i].set_fov(fov);
+		if(crop[2] > 0 && crop[3] > 0)
+		    scenes[i].set_crop(crop[0], crop[1], crop[2], crop[3]);
+		if(texture_budget > 0)
+		    scenes[i].set_texture_budget((size_t)(texture_budget * 1024 * 1024));
 	}
 
+    if (queue_all)
+    {
+        RenderQueue queue;
+        for (GLuint i = 0; i < SCENE_MAX; i++)
+        {
+            queue.submit(&scenes[i], scenes[i].view(), scenes[i].output_name(), [](GLuint job, GLuint done, GLuint count)
+            {
+                if (done == count)
+                    cout << "Scene " << job + 1 << " finished" << endl;
+            });
+        }
+        GLuint saved = queue.run();
+        DestroyShaders(&shader);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return saved == SCENE_MAX ? 0 : -1;
+    }
+
+    // saving a scene file wakes the event loop, which applies what changed
+    FileWatcher watcher;
+    if (watch)
+    {
+        for (GLuint i = 0; i < SCENE_MAX; i++)
+            watcher.watch("scene" + std::to_string(i+1) + ".txt");
+        watcher.start([]() { glfwPostEmptyEvent(); });
+    }
+
     // run an event-triggered main loop
+    GLdouble last_frame = glfwGetTime();
+    Scenes shown_scene = SCENE_MAX;
     while (!glfwWindowShouldClose(window))
     {
-        // call function to draw our scene
-		scenes[which_scene].draw();
-		scenes[which_scene].commit();
+        vector<string> edited = watcher.changed();
+        for (GLuint i = 0; i < edited.size(); i++)
+        {
+            for (GLuint s = 0; s < SCENE_MAX; s++)
+            {
+                if (edited[i] == "scene" + std::to_string(s+1) + ".txt")
+                    scenes[s].reload(edited[i]);
+            }
+        }
 
-        // scene is rendered to the back buffer, so swap to front for display
-        glfwSwapBuffers(window);
+        if (interactive_fps > 0)
+        {
+            // frames take a fixed time slice while the camera moves, then
+            // keep refining until the view is fully rendered
+            Scene &scene = scenes[which_scene];
+            GLdouble now = glfwGetTime();
+            bool moved = Navigate(window, &scene, std::min(now - last_frame, 0.1));
+            last_frame = now;
+            bool complete = scene.draw_interactive(1.0 / interactive_fps);
+            scene.image.Render();
+            glfwSwapBuffers(window);
+            if (moved || !complete)
+            {
+                glfwPollEvents();
+                continue;
+            }
+        }
+        else if (animate_frames > 0)
+        {
+            // each frame is shown as it finishes while the previous one saves
+            Scene &scene = scenes[which_scene];
+            scene.render_sequence(animate_frames, animate_fps, [&]()
+            {
+                scene.image.Render();
+                glfwSwapBuffers(window);
+            });
+        }
+        else if (preview_budget >= 0)
+        {
+            // every refinement pass is shown as soon as it is done
+            Scene &scene = scenes[which_scene];
+            scene.draw_progressive(preview_budget, [&]()
+            {
+                scene.image.Render();
+                glfwSwapBuffers(window);
+            });
+        }
+        else
+        {
+            // a scene is drawn whole when it is first shown, after that only
+            // what its file changed is drawn again
+            if (which_scene != shown_scene)
+                scenes[which_scene].draw();
+            else
+                scenes[which_scene].draw_changes();
+            shown_scene = which_scene;
+            scenes[which_scene].commit();
+
+            // scene is rendered to the back buffer, so swap to front for display
+            glfwSwapBuffers(window);
+        }
 
         // sleep until next event before drawing again
         glfwWaitEvents();